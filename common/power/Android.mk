@@ -46,7 +46,9 @@ endif
 
 LOCAL_SRC_FILES += powerhal_utils.cpp
 
-LOCAL_SHARED_LIBRARIES := liblog libcutils libutils
+LOCAL_C_INCLUDES += device/nvidia/drivers/input/include
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libinputdevices
 
 include $(NVIDIA_STATIC_LIBRARY)
 endif
@@ -22,62 +22,38 @@
 #include "powerhal.h"
 
 #include "nvos.h"
+#include "input_devices.h"
 
 #define PHS_DEBUG
 
 static int get_input_count(void)
 {
-    int i = 0;
-    int ret;
-    char path[80];
-    char name[32];
-
-    while(1)
-    {
-        sprintf(path, "/sys/class/input/input%d/name", i);
-        ret = access(path, F_OK);
-        if (ret < 0)
-            break;
-        memset(name, 0, 32);
-        sysfs_read(path, name, 32);
-        ALOGI("input device id:%d present with name:%s", i++, name);
-    }
-    return i;
+    return input_devices_count();
 }
 
 static void find_input_device_ids(struct powerhal_info *pInfo)
 {
-    int i = 0;
-    int status;
-    int count = 0;
-    char path[80];
+    struct input_device dev;
     char name[MAX_CHARS];
+    char *nl;
 
-    while (1)
-    {
-        sprintf(path, "/sys/class/input/input%d/name", i);
-        if (access(path, F_OK) < 0)
-            break;
-        else {
-            memset(name, 0, MAX_CHARS);
-            sysfs_read(path, name, MAX_CHARS);
-            for (int j = 0; j < pInfo->input_cnt; j++) {
-                status = (-1 == pInfo->input_devs[j].dev_id)
-                    && (0 == strncmp(name,
-                    pInfo->input_devs[j].dev_name, MAX_CHARS));
-                if (status) {
-                    ++count;
-                    pInfo->input_devs[j].dev_id = i;
-                    ALOGI("find_input_device_ids: %d %s",
-                        pInfo->input_devs[j].dev_id,
-                        pInfo->input_devs[j].dev_name);
-                }
-            }
-            ++i;
-        }
+    for (int j = 0; j < pInfo->input_cnt; j++) {
+        if (-1 != pInfo->input_devs[j].dev_id)
+            continue;
 
-        if (count == pInfo->input_cnt)
-            break;
+        /* names are listed as read from sysfs, with the trailing newline */
+        strncpy(name, pInfo->input_devs[j].dev_name, MAX_CHARS - 1);
+        name[MAX_CHARS - 1] = '\0';
+        nl = strchr(name, '\n');
+        if (nl)
+            *nl = '\0';
+
+        if (input_device_find(name, &dev) < 0)
+            continue;
+        pInfo->input_devs[j].dev_id = dev.input;
+        ALOGI("find_input_device_ids: %d %s",
+            pInfo->input_devs[j].dev_id,
+            pInfo->input_devs[j].dev_name);
     }
 }
 
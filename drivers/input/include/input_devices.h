@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUT_DEVICES_H
+#define INPUT_DEVICES_H
+
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Registry of the input devices in /sys/class/input, shared by the HALs
+ * that need to find an input device by name.
+ *
+ * The first lookup scans /sys/class/input once and maps every device name
+ * to its inputN, eventN and sysfs directory.  A lookup that misses rescans
+ * in case the device probed late, and input_devices_watch() keeps the
+ * registry up to date from uevents (or inotify on /dev/input if the uevent
+ * socket is not available).
+ */
+
+#define INPUT_DEVICE_NAME_MAX   80
+
+struct input_device {
+    char name[INPUT_DEVICE_NAME_MAX];
+    int input;                  /* N of /sys/class/input/inputN */
+    int event;                  /* N of /dev/input/eventN, -1 if none */
+    char sysfs[PATH_MAX];       /* resolved /sys/class/input/inputN */
+};
+
+/* look up under root instead of /, e.g. a fake tree for host benchmarks */
+void input_devices_set_root(const char *root);
+
+/* 0 and *dev filled in, or -ENODEV */
+int input_device_find(const char *name, struct input_device *dev);
+/* same, for the first device whose name starts with prefix */
+int input_device_find_prefix(const char *prefix, struct input_device *dev);
+/* number of input devices */
+int input_devices_count(void);
+
+/* open /dev/input/eventN of the named device, -errno on error */
+int input_device_open(const char *name, int flags);
+
+/*
+ * start following hotplug, returns 0 or -errno; if the hotplug source
+ * fails later, lookups fall back to rescanning and this may be called again
+ */
+int input_devices_watch(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* INPUT_DEVICES_H */
@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <cutils/log.h>
+
+#include "input_devices.h"
+
+#define INPUT_DEVICES_MAX       64
+#define SYSFS_INPUT_DIR         "/sys/class/input"
+#define DEV_INPUT_DIR           "/dev/input"
+#define UEVENT_BUFFER_SIZE      2048
+
+struct entry {
+    struct input_device dev;
+    int used;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct entry devices[INPUT_DEVICES_MAX];
+static int scanned;
+static int watching;
+static char root[PATH_MAX];
+
+static const char *root_path(const char *path, char *buf, size_t size)
+{
+    if (!root[0])
+        return path;
+    snprintf(buf, size, "%s%s", root, path);
+    return buf;
+}
+
+void input_devices_set_root(const char *path)
+{
+    pthread_mutex_lock(&lock);
+    snprintf(root, sizeof(root), "%s", path ? path : "");
+    scanned = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+static struct entry *find_input(int input)
+{
+    int i;
+
+    for (i = 0; i < INPUT_DEVICES_MAX; i++) {
+        if (devices[i].used && devices[i].dev.input == input)
+            return &devices[i];
+    }
+    return NULL;
+}
+
+static struct entry *find_event(int event)
+{
+    int i;
+
+    for (i = 0; i < INPUT_DEVICES_MAX; i++) {
+        if (devices[i].used && devices[i].dev.event == event)
+            return &devices[i];
+    }
+    return NULL;
+}
+
+static int read_name(int input, char *name, size_t size)
+{
+    char path[PATH_MAX];
+    char buf[PATH_MAX];
+    int fd, n;
+
+    snprintf(path, sizeof(path), SYSFS_INPUT_DIR "/input%d/name", input);
+    fd = open(root_path(path, buf, sizeof(buf)), O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    n = read(fd, name, size - 1);
+    close(fd);
+    if (n <= 0)
+        return -EIO;
+
+    name[n] = '\0';
+    if (name[n - 1] == '\n')
+        name[n - 1] = '\0';
+    return 0;
+}
+
+/* inputN an eventM node belongs to, from its device link */
+static int event_parent(int event)
+{
+    char path[PATH_MAX];
+    char buf[PATH_MAX];
+    char link[PATH_MAX];
+    const char *base;
+    int input, n;
+
+    snprintf(path, sizeof(path), SYSFS_INPUT_DIR "/event%d/device", event);
+    n = readlink(root_path(path, buf, sizeof(buf)), link, sizeof(link) - 1);
+    if (n <= 0)
+        return -1;
+    link[n] = '\0';
+
+    base = strrchr(link, '/');
+    base = base ? base + 1 : link;
+    if (sscanf(base, "input%d", &input) != 1)
+        return -1;
+    return input;
+}
+
+static struct entry *update_input(int input)
+{
+    struct entry *e = find_input(input);
+    char path[PATH_MAX];
+    char buf[PATH_MAX];
+    int i;
+
+    if (e == NULL) {
+        for (i = 0; i < INPUT_DEVICES_MAX && devices[i].used; i++)
+            ;
+        if (i == INPUT_DEVICES_MAX) {
+            ALOGE("%s: no room for input%d", __func__, input);
+            return NULL;
+        }
+        e = &devices[i];
+        memset(e, 0, sizeof(*e));
+        e->dev.input = input;
+        e->dev.event = -1;
+    }
+
+    if (read_name(input, e->dev.name, sizeof(e->dev.name)) < 0) {
+        e->used = 0;
+        return NULL;
+    }
+    snprintf(path, sizeof(path), SYSFS_INPUT_DIR "/input%d", input);
+    if (realpath(root_path(path, buf, sizeof(buf)), e->dev.sysfs) == NULL)
+        snprintf(e->dev.sysfs, sizeof(e->dev.sysfs), "%s", path);
+    e->used = 1;
+    return e;
+}
+
+static void update_event(int event)
+{
+    int input = event_parent(event);
+    struct entry *e;
+
+    if (input < 0)
+        return;
+    e = find_input(input);
+    if (e == NULL)
+        e = update_input(input);
+    if (e != NULL)
+        e->dev.event = event;
+}
+
+static void remove_input(int input)
+{
+    struct entry *e = find_input(input);
+
+    if (e != NULL)
+        e->used = 0;
+}
+
+static void remove_event(int event)
+{
+    struct entry *e = find_event(event);
+
+    if (e != NULL)
+        e->dev.event = -1;
+}
+
+/* one pass over /sys/class/input */
+static void scan_locked(void)
+{
+    char buf[PATH_MAX];
+    struct dirent *de;
+    DIR *dir;
+    int n;
+
+    memset(devices, 0, sizeof(devices));
+    scanned = 1;
+
+    dir = opendir(root_path(SYSFS_INPUT_DIR, buf, sizeof(buf)));
+    if (dir == NULL) {
+        ALOGE("%s: cannot open %s (%s)", __func__, SYSFS_INPUT_DIR,
+              strerror(errno));
+        return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "input%d", &n) == 1) {
+            if (find_input(n) == NULL)
+                update_input(n);
+        } else if (sscanf(de->d_name, "event%d", &n) == 1) {
+            update_event(n);
+        }
+    }
+    closedir(dir);
+}
+
+static int lookup(const char *name, int prefix, struct input_device *dev)
+{
+    size_t len = strlen(name);
+    int pass, i;
+
+    pthread_mutex_lock(&lock);
+    if (!scanned)
+        scan_locked();
+    /* a miss rescans once unless hotplug keeps the registry current */
+    for (pass = 0; pass < (watching ? 1 : 2); pass++) {
+        if (pass)
+            scan_locked();
+        for (i = 0; i < INPUT_DEVICES_MAX; i++) {
+            struct entry *e = &devices[i];
+
+            if (!e->used)
+                continue;
+            if (prefix ? strncmp(e->dev.name, name, len) :
+                         strcmp(e->dev.name, name))
+                continue;
+            if (dev != NULL)
+                *dev = e->dev;
+            pthread_mutex_unlock(&lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return -ENODEV;
+}
+
+int input_device_find(const char *name, struct input_device *dev)
+{
+    return lookup(name, 0, dev);
+}
+
+int input_device_find_prefix(const char *prefix, struct input_device *dev)
+{
+    return lookup(prefix, 1, dev);
+}
+
+int input_devices_count(void)
+{
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    if (!scanned)
+        scan_locked();
+    for (i = 0; i < INPUT_DEVICES_MAX; i++) {
+        if (devices[i].used)
+            count++;
+    }
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+int input_device_open(const char *name, int flags)
+{
+    struct input_device dev;
+    char path[PATH_MAX];
+    char buf[PATH_MAX];
+    int fd;
+
+    if (input_device_find(name, &dev) < 0 || dev.event < 0) {
+        ALOGE("couldn't find '%s' input device", name);
+        return -ENODEV;
+    }
+
+    snprintf(path, sizeof(path), DEV_INPUT_DIR "/event%d", dev.event);
+    fd = open(root_path(path, buf, sizeof(buf)), flags);
+    if (fd < 0) {
+        ALOGE("couldn't open %s (%s)", path, strerror(errno));
+        return -errno;
+    }
+    ALOGI("path open %s", path);
+    return fd;
+}
+
+/*****************************************************************************/
+
+/* "action@devpath\0KEY=value\0..." from the kobject uevent socket */
+static void handle_uevent(const char *msg, int len)
+{
+    const char *end = msg + len;
+    const char *devpath, *base, *s;
+    int input = 0, add, n;
+
+    devpath = strchr(msg, '@');
+    if (devpath == NULL)
+        return;
+    add = !strncmp(msg, "add", 3) || !strncmp(msg, "change", 6);
+    if (!add && strncmp(msg, "remove", 6))
+        return;
+
+    for (s = msg + strlen(msg) + 1; s < end; s += strlen(s) + 1) {
+        if (!strcmp(s, "SUBSYSTEM=input")) {
+            input = 1;
+            break;
+        }
+    }
+    if (!input)
+        return;
+
+    base = strrchr(devpath, '/');
+    base = base ? base + 1 : devpath + 1;
+
+    pthread_mutex_lock(&lock);
+    if (sscanf(base, "input%d", &n) == 1) {
+        if (add)
+            update_input(n);
+        else
+            remove_input(n);
+    } else if (sscanf(base, "event%d", &n) == 1) {
+        if (add)
+            update_event(n);
+        else
+            remove_event(n);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* events were lost: rebuild the registry from sysfs */
+static void rescan(void)
+{
+    pthread_mutex_lock(&lock);
+    scan_locked();
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * The hotplug source is gone: lookups go back to rescanning on a miss and
+ * the stale registry is dropped, input_devices_watch() may start over.
+ */
+static void watch_stopped(void)
+{
+    pthread_mutex_lock(&lock);
+    watching = 0;
+    scanned = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+static void *uevent_thread(void *arg)
+{
+    int fd = (long)arg;
+    char msg[UEVENT_BUFFER_SIZE + 2];
+    int n;
+
+    while (1) {
+        n = recv(fd, msg, UEVENT_BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                ALOGW("%s: uevents dropped, rescanning", __func__);
+                rescan();
+                continue;
+            }
+            ALOGE("%s: recv failed (%s)", __func__, strerror(errno));
+            break;
+        }
+        msg[n] = '\0';
+        msg[n + 1] = '\0';
+        handle_uevent(msg, n);
+    }
+    close(fd);
+    watch_stopped();
+    return NULL;
+}
+
+static void *inotify_thread(void *arg)
+{
+    int fd = (long)arg;
+    char buf[512];
+    int n, i, event;
+
+    while (1) {
+        n = read(fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("%s: read failed (%s)", __func__, strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; ) {
+            struct inotify_event *ev = (struct inotify_event *)&buf[i];
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                ALOGW("%s: events dropped, rescanning", __func__);
+                rescan();
+            } else if (ev->len && sscanf(ev->name, "event%d", &event) == 1) {
+                pthread_mutex_lock(&lock);
+                if (ev->mask & IN_CREATE)
+                    update_event(event);
+                else
+                    remove_event(event);
+                pthread_mutex_unlock(&lock);
+            }
+            i += sizeof(*ev) + ev->len;
+        }
+    }
+    close(fd);
+    watch_stopped();
+    return NULL;
+}
+
+static int open_uevent(void)
+{
+    struct sockaddr_nl addr;
+    int fd;
+
+    fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0)
+        return -errno;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = 0;
+    addr.nl_groups = 1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -errno;
+    }
+    return fd;
+}
+
+static int open_inotify(void)
+{
+    char buf[PATH_MAX];
+    int fd;
+
+    fd = inotify_init();
+    if (fd < 0)
+        return -errno;
+    if (inotify_add_watch(fd, root_path(DEV_INPUT_DIR, buf, sizeof(buf)),
+                          IN_CREATE | IN_DELETE) < 0) {
+        close(fd);
+        return -errno;
+    }
+    return fd;
+}
+
+int input_devices_watch(void)
+{
+    void *(*loop)(void *) = uevent_thread;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int fd = -1;
+    int err;
+
+    pthread_mutex_lock(&lock);
+    if (watching) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    if (!scanned)
+        scan_locked();
+
+    /* uevents describe the real tree, not a redirected root */
+    if (!root[0])
+        fd = open_uevent();
+    if (fd < 0) {
+        loop = inotify_thread;
+        fd = open_inotify();
+    }
+    if (fd < 0) {
+        pthread_mutex_unlock(&lock);
+        ALOGE("%s: no hotplug source (%s)", __func__, strerror(-fd));
+        return fd;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = pthread_create(&thread, &attr, loop, (void *)(long)fd);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        close(fd);
+        pthread_mutex_unlock(&lock);
+        return -err;
+    }
+    watching = 1;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
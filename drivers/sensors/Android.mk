@@ -21,15 +21,19 @@ ifneq ($(TARGET_SIMULATOR),true)
 include $(NVIDIA_DEFAULTS)
 LOCAL_MODULE := libsensors.base
 LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
-LOCAL_SRC_FILES := SensorBase.cpp SensorUtil.cpp InputEventReader.cpp
+LOCAL_SRC_FILES := SensorBase.cpp SensorUtil.cpp InputEventReader.cpp \
+                   SensorPollMux.cpp SensorEventRing.cpp \
+                   SensorSpscRing.cpp SensorReaderThread.cpp \
+                   SensorPollLoop.cpp SensorStats.cpp
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/driver/include
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/driver/include/linux
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/HAL/include
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mllite
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mllite/linux
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mpl
+LOCAL_C_INCLUDES += device/nvidia/drivers/input/include
 LOCAL_C_INCLUDES += $(LOCAL_PATH)
-LOCAL_SHARED_LIBRARIES := liblog libdl libcutils libutils
+LOCAL_SHARED_LIBRARIES := liblog libdl libcutils libutils libinputdevices
 LOCAL_CPPFLAGS+=-DLINUX=1
 LOCAL_NVIDIA_NO_WARNINGS_AS_ERRORS := 1
 include $(NVIDIA_SHARED_LIBRARY)
@@ -113,8 +117,9 @@ LOCAL_MODULE := libsensors.bmpx80
 LOCAL_MODULE_TAGS := optional
 LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
 LOCAL_SRC_FILES := bmpx80.cpp
+LOCAL_C_INCLUDES += device/nvidia/drivers/input/include
 LOCAL_C_INCLUDES += $(LOCAL_PATH)
-LOCAL_SHARED_LIBRARIES := liblog libsensors.base
+LOCAL_SHARED_LIBRARIES := liblog libsensors.base libinputdevices
 LOCAL_CPPFLAGS+=-DLINUX=1
 include $(NVIDIA_SHARED_LIBRARY)
 
@@ -164,7 +169,8 @@ LOCAL_CPPFLAGS+=-DLINUX=1
 include $(NVIDIA_SHARED_LIBRARY)
 
 subdir_makefiles := \
-	$(LOCAL_PATH)/mlsdk/Android.mk
+	$(LOCAL_PATH)/mlsdk/Android.mk \
+	$(LOCAL_PATH)/bench/Android.mk
 
 include $(subdir_makefiles)
 
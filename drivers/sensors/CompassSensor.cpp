@@ -18,6 +18,8 @@
 #define LOG_NDEBUG 0
 
 #include <cutils/log.h>
+#include <time.h>
+#include <sys/ioctl.h>
 
 #include "CompassSensor.h"
 #include "MPLSupport.h"
@@ -36,6 +38,16 @@ CompassSensor::CompassSensor(const char *name,
 {
     memset(mCachedCompassData, 0, sizeof(mCachedCompassData));
 
+    /*
+     * The MPL decimates and fuses on CLOCK_MONOTONIC, the clock of the MPU
+     * stamps and of getTimestamp(). Have the input layer stamp the compass
+     * the same way, or convert from CLOCK_REALTIME when it cannot.
+     */
+    int clockId = CLOCK_MONOTONIC;
+    mRealtimeStamps = data_fd < 0 ||
+                      ioctl(data_fd, EVIOCSCLOCKID, &clockId) < 0;
+    ALOGV_IF(mRealtimeStamps, "HAL:compass stamps converted from realtime");
+
     FILE *fptr;
     char path[80];
     sprintf(path, "%s/orientation", sysFs.path);
@@ -133,20 +145,29 @@ int CompassSensor::readSample(long *data, int64_t *timestamp)
     }
 
     input_event const* event;
+    size_t frame = mInputReader.readFrame(&event);
+
+    if (frame) {
+        for (; --frame; event++) {
+            int type = event->type;
+            if (type == EV_REL) {
+                processCompassEvent(event);
+            } else {
+                ALOGE("HAL:Compass Sensor: unknown event (type=%d, code=%d)",
+                      type, event->code);
+            }
+        }
+        *timestamp = mCompassTimestamp;
+        if (mRealtimeStamps) {
+            struct timespec t;
 
-    while (done == 0 && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_REL) {
-            processCompassEvent(event);
-        } else if (type == EV_SYN) {
-            *timestamp = mCompassTimestamp;
-            memcpy(data, mCachedCompassData, sizeof(mCachedCompassData));
-            done = 1;
-        } else {
-            ALOGE("HAL:Compass Sensor: unknown event (type=%d, code=%d)",
-                  type, event->code);
+            clock_gettime(CLOCK_REALTIME, &t);
+            *timestamp -= int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec -
+                          getTimestamp();
         }
-        mInputReader.next();
+        memcpy(data, mCachedCompassData, sizeof(mCachedCompassData));
+        done = 1;
+        mInputReader.nextFrame();
     }
 
     return done;
@@ -24,6 +24,7 @@ class CompassSensor : public NvsInput {
     signed char mCompassOrientation[9];
     long mCachedCompassData[3];
     int64_t mCompassTimestamp;
+    bool mRealtimeStamps;   // input events stamped with CLOCK_REALTIME
 
 public:
     CompassSensor(const char *name,
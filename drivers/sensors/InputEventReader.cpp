@@ -17,10 +17,12 @@
 #include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
+#include <string.h>
 #include <poll.h>
 
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <linux/input.h>
 
@@ -33,17 +35,28 @@
 struct input_event;
 
 InputEventCircularReader::InputEventCircularReader(size_t numEvents)
-    : mBuffer(new input_event[numEvents * 2]),
+    : mBuffer(new input_event[numEvents]),
       mBufferEnd(mBuffer + numEvents),
+      mFrame(new input_event[numEvents]),
       mHead(mBuffer),
       mCurr(mBuffer),
-      mFreeSpace(numEvents)
+      mFreeSpace(numEvents),
+      mFrameSize(0)
 {
 }
 
 InputEventCircularReader::~InputEventCircularReader()
 {
     delete [] mBuffer;
+    delete [] mFrame;
+}
+
+void InputEventCircularReader::reset()
+{
+    mHead = mBuffer;
+    mCurr = mBuffer;
+    mFreeSpace = mBufferEnd - mBuffer;
+    mFrameSize = 0;
 }
 
 #define INPUT_EVENT_DEBUG (0)
@@ -52,7 +65,23 @@ ssize_t InputEventCircularReader::fill(int fd)
     size_t numEventsRead = 0;
 
     if (mFreeSpace) {
-        const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
+        // free space runs from mHead to the end of the buffer and then
+        // wraps to the start, read both parts in one go.
+        struct iovec iov[2];
+        int iovcnt = 1;
+        size_t first = mBufferEnd - mHead;
+
+        if (first > (size_t)mFreeSpace)
+            first = mFreeSpace;
+        iov[0].iov_base = mHead;
+        iov[0].iov_len = first * sizeof(input_event);
+        if ((size_t)mFreeSpace > first) {
+            iov[1].iov_base = mBuffer;
+            iov[1].iov_len = (mFreeSpace - first) * sizeof(input_event);
+            iovcnt = 2;
+        }
+
+        const ssize_t nread = readv(fd, iov, iovcnt);
         if (nread < 0 || nread % sizeof(input_event)) {
             // we got a partial event!!
             if (INPUT_EVENT_DEBUG) {
@@ -69,11 +98,8 @@ ssize_t InputEventCircularReader::fill(int fd)
         if (numEventsRead) {
             mHead += numEventsRead;
             mFreeSpace -= numEventsRead;
-            if (mHead > mBufferEnd) {
-                size_t s = mHead - mBufferEnd;
-                memcpy(mBuffer, mBufferEnd, s * sizeof(input_event));
-                mHead = mBuffer + s;
-            }
+            if (mHead >= mBufferEnd)
+                mHead -= mBufferEnd - mBuffer;
         }
     }
 
@@ -85,15 +111,80 @@ ssize_t InputEventCircularReader::fill(int fd)
 ssize_t InputEventCircularReader::readEvent(input_event const** events)
 {
     *events = mCurr;
-    ssize_t available = (mBufferEnd - mBuffer) - mFreeSpace;
-    return available ? 1 : 0;
+    return available() ? 1 : 0;
 }
 
 void InputEventCircularReader::next()
 {
-    mCurr++;
-    mFreeSpace++;
-    if (mCurr >= mBufferEnd) {
+    consume(1);
+}
+
+size_t InputEventCircularReader::available() const
+{
+    return (mBufferEnd - mBuffer) - mFreeSpace;
+}
+
+size_t InputEventCircularReader::readSpan(input_event const** events) const
+{
+    size_t count = available();
+    size_t contiguous = mBufferEnd - mCurr;
+
+    *events = mCurr;
+    return count < contiguous ? count : contiguous;
+}
+
+void InputEventCircularReader::consume(size_t count)
+{
+    if (count > available())
+        count = available();
+    mCurr += count;
+    mFreeSpace += count;
+    if (mCurr >= mBufferEnd)
+        mCurr -= mBufferEnd - mBuffer;
+    if (!available()) {
+        // empty, restart at the front so the next fill is one span
+        mHead = mBuffer;
         mCurr = mBuffer;
     }
 }
+
+size_t InputEventCircularReader::readFrame(input_event const** events)
+{
+    size_t count = available();
+    input_event const* event = mCurr;
+
+    mFrameSize = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (event->type == EV_SYN) {
+            size_t n = i + 1;
+            size_t contiguous = mBufferEnd - mCurr;
+
+            if (n <= contiguous) {
+                *events = mCurr;
+            } else {
+                memcpy(mFrame, mCurr, contiguous * sizeof(input_event));
+                memcpy(mFrame + contiguous, mBuffer,
+                       (n - contiguous) * sizeof(input_event));
+                *events = mFrame;
+            }
+            mFrameSize = n;
+            return n;
+        }
+        if (++event >= mBufferEnd)
+            event = mBuffer;
+    }
+
+    if (!mFreeSpace) {
+        // a full ring without EV_SYN would never make progress
+        ALOGE("%s: dropping %zu events without EV_SYN",
+              __PRETTY_FUNCTION__, count);
+        consume(count);
+    }
+    return 0;
+}
+
+void InputEventCircularReader::nextFrame()
+{
+    consume(mFrameSize);
+    mFrameSize = 0;
+}
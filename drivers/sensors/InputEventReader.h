@@ -26,13 +26,23 @@
 
 struct input_event;
 
+/*
+ * Ring of input events read from an evdev fd.
+ *
+ * fill() reads straight into the free part of the ring, which may be split
+ * in two at the end of the buffer.  Events can be consumed one at a time
+ * (readEvent/next), as contiguous spans (readSpan/consume) or as whole
+ * EV_SYN terminated frames (readFrame/nextFrame).
+ */
 class InputEventCircularReader
 {
     struct input_event* const mBuffer;
     struct input_event* const mBufferEnd;
+    struct input_event* const mFrame;   // scratch for frames that wrap
     struct input_event* mHead;
     struct input_event* mCurr;
     ssize_t mFreeSpace;
+    size_t mFrameSize;
 
 public:
     InputEventCircularReader(size_t numEvents);
@@ -40,6 +50,17 @@ public:
     ssize_t fill(int fd);
     ssize_t readEvent(input_event const** events);
     void next();
+
+    /* number of events waiting in the ring */
+    size_t available() const;
+    /* contiguous events starting at the oldest one */
+    size_t readSpan(input_event const** events) const;
+    void consume(size_t count);
+    /* events of the oldest complete frame, its last one is the EV_SYN */
+    size_t readFrame(input_event const** events);
+    void nextFrame();
+    /* drop everything buffered, including a partial frame */
+    void reset();
 };
 
 /*****************************************************************************/
@@ -24,12 +24,17 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <sys/select.h>
 #include <sys/syscall.h>
 #include <dlfcn.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <string.h>
@@ -52,6 +57,40 @@
 /******************************************************************************/
 #define DEFAULT_MPL_GYRO_RATE           (20000L)     //us
 #define DEFAULT_MPL_COMPASS_RATE        (20000L)     //us
+#define MPL_GYRO_SENSITIVITY            (2000L << 15)
+/* enabled sensors the raw bypass can serve without the MPL */
+#define BYPASS_SENSORS  ((1 << MPLSensor::Gyro) | (1 << MPLSensor::Accelerometer))
+/* sensors computed from the 9 axis quaternion */
+#define FUSION_SENSORS  ((1 << MPLSensor::Orientation) \
+                         | (1 << MPLSensor::RotationVector) \
+                         | (1 << MPLSensor::LinearAccel) \
+                         | (1 << MPLSensor::Gravity))
+
+/* MPL algorithms that can be stopped and the sensors that need them run */
+static const struct {
+    const char *name;
+    inv_error_t (*start)(void);
+    inv_error_t (*stop)(void);
+    uint32_t users;
+    bool compassCal;        // only enabled without a calibrated compass
+} mplModules[] = {
+    { "9x_sensor_fusion", inv_start_9x_sensor_fusion,
+      inv_stop_9x_sensor_fusion, FUSION_SENSORS, false },
+    { "fast_nomot", inv_start_fast_nomot, inv_stop_fast_nomot,
+      (1 << MPLSensor::Gyro) | FUSION_SENSORS, false },
+    { "gyro_tc", inv_start_gyro_tc, inv_stop_gyro_tc,
+      (1 << MPLSensor::Gyro) | FUSION_SENSORS, false },
+    { "in_use_auto_calibration", inv_start_in_use_auto_calibration,
+      inv_stop_in_use_auto_calibration,
+      (1 << MPLSensor::Accelerometer) | FUSION_SENSORS, false },
+    { "vector_compass_cal", inv_start_vector_compass_cal,
+      inv_stop_vector_compass_cal, (1 << MPLSensor::MagneticField)
+      | (1 << MPLSensor::Orientation) | (1 << MPLSensor::RotationVector),
+      true },
+    { "heading_from_gyro", inv_start_heading_from_gyro,
+      inv_stop_heading_from_gyro,
+      (1 << MPLSensor::Orientation) | (1 << MPLSensor::RotationVector), true },
+};
 
 MPLSensor *MPLSensor::gMPLSensor = NULL;
 
@@ -83,9 +122,12 @@ MPLSensor* getCallbackObject() {
 
 } //end of extern C
 
-#ifdef INV_PLAYBACK_DBG
-static FILE *logfile = NULL;
-#endif
+/*
+ * Set to 1 to trace every MPL input to MPL_TRACE_FILE, the trace replays
+ * offline with mpl_replay.
+ */
+#define MPL_TRACE_PROP "persist.sensors.mpl_trace"
+#define MPL_TRACE_FILE "/data/mpl_trace.bin"
 
 /*******************************************************************************
  * MPLSensor class implementation
@@ -102,13 +144,19 @@ MPLSensor::MPLSensor(CompassSensor *compass)
                          mAccelAccuracy(0),
                          mCompassAccuracy(0),
                          mSampleCount(0),
+                         mMplModules(0),
                          mEnabled(0),
                          mOldEnabledMask(0),
                          mAccelInputReader(4),
-                         mGyroInputReader(32),
+                         mGyroInputReader(MAX_READ_FRAMES * MPU_FRAME_EVENTS),
+                         mGyroBacklog(false),
+                         mGyroReset(false),
                          mTempScale(0),
                          mTempOffset(0),
-                         mTempCurrentTime(0),
+                         mTempSeen(0),
+                         mTempThreaded(false),
+                         mTempStop(false),
+                         mTempWakeFd(-1),
                          mAccelScale(2),
                          mPendingMask(0),
                          mSensorMask(0),
@@ -127,6 +175,7 @@ MPLSensor::MPLSensor(CompassSensor *compass)
     unsigned long mSensorMask;
     int res;
     FILE *fptr;
+    char value[PROPERTY_VALUE_MAX];
 
     mCompassSensor = compass;
 
@@ -266,30 +315,7 @@ MPLSensor::MPLSensor(CompassSensor *compass)
     }
 
     /* read accel FSR to calcuate accel scale later */
-    ALOGV_IF(SYSFS_VERBOSE,
-            "HAL:sysfs:cat %s (%lld)", mpu.accl_fsr, getTimestamp());
-
-    fd = open(mpu.accl_fsr, O_RDONLY);
-    if (fd < 0) {
-        ALOGE("HAL:Error opening accel FSR");
-    } else {
-        char buf[6];
-        int count = 0;
-        memset(buf, 0, sizeof(buf));
-        count = read_attribute_sensor(fd, buf, sizeof(buf));
-        if (count < 1) {
-            ALOGE("HAL:Error reading accel FSR");
-        } else {
-            count = sscanf(buf, "%d", &mAccelScale);
-            mAccelScale >>= 12;
-            if (mAccelScale == 4)
-                mAccelScale--;
-            mAccelScale = 16 >> mAccelScale;
-            if (count)
-                ALOGV_IF(EXTRA_VERBOSE, "HAL:Accel FSR used %d", mAccelScale);
-        }
-        close(fd);
-    }
+    readAccelScale(&mAccelScale);
     if (mIntegratedAccel)
         lpa_delay_enable(LPA_POLL_PERIOD_THRESHOLD_US);
 
@@ -347,8 +373,24 @@ MPLSensor::MPLSensor(CompassSensor *compass)
 
     for (int i = 0; i < numSensors; i++) {
         mDelays[i] = 0;
+        mNextOutput[i] = 0;
     }
 
+    mFusionThreaded = false;
+    mFusionStop = false;
+    mFusionWakeFd = -1;
+    mFusionOutFd = -1;
+    mRawHead = 0;
+    mRawTail = 0;
+    mRawDropped = 0;
+    memset(mFusionRings, 0, sizeof(mFusionRings));
+    mBypass = false;
+    mNextMplRun = 0;
+
+    memset(&mTempSample, 0, sizeof(mTempSample));
+    if (gyro_temperature_fd >= 0)
+        startTempSampler();
+
     (void)inv_get_version(&ver_str);
     ALOGI("%s\n", ver_str);
 
@@ -364,11 +406,9 @@ MPLSensor::MPLSensor(CompassSensor *compass)
 
     inv_set_device_properties();
 
-#ifdef INV_PLAYBACK_DBG
-    logfile = fopen("/data/playback.bin", "wb");
-    if (logfile)
-        inv_turn_on_data_logging(logfile);
-#endif
+    property_get(MPL_TRACE_PROP, value, "0");
+    if (atoi(value) > 0)
+        inv_turn_on_data_logging(MPL_TRACE_FILE);
 }
 
 int MPLSensor::inv_constructor_init()
@@ -460,10 +500,108 @@ int MPLSensor::inv_constructor_default_enable()
         LOG_RESULT_LOCATION(result);
         return result;
     }
+
+    /* inv_start_mpl() starts everything enabled above */
+    mMplModules = 0;
+    for (size_t i = 0; i < sizeof(mplModules) / sizeof(mplModules[0]); i++) {
+        if (!mplModules[i].compassCal ||
+                (mCompassSensor != NULL &&
+                 !mCompassSensor->providesCalibration()))
+            mMplModules |= 1 << i;
+    }
     return result;
 }
 
+/**
+ *  Start the MPL algorithms the enabled sensors depend on and stop the
+ *  others, so e.g. a gyro only session does not run compass calibration
+ *  and 9 axis fusion on every sample. With nothing enabled no data reaches
+ *  the MPL, the modules are left as they are to keep their state.
+ *  Call with mMplMutex held.
+ */
+void MPLSensor::updateMplModules(uint32_t enabled)
+{
+    VFUNC_LOG;
+
+    if (!enabled)
+        return;
+
+    for (size_t i = 0; i < sizeof(mplModules) / sizeof(mplModules[0]); i++) {
+        bool running = mMplModules & (1 << i);
+        bool needed = mplModules[i].users & enabled;
+        inv_error_t result;
+
+        if (running == needed)
+            continue;
+        if (mplModules[i].compassCal &&
+                (mCompassSensor == NULL ||
+                 mCompassSensor->providesCalibration()))
+            continue;
+
+        if (needed) {
+            result = mplModules[i].start();
+            if (result) {
+                ALOGE("HAL:inv_start_%s failed (%d)",
+                        mplModules[i].name, result);
+                continue;
+            }
+            mMplModules |= 1 << i;
+        } else {
+            result = mplModules[i].stop();
+            if (result) {
+                ALOGE("HAL:inv_stop_%s failed (%d)",
+                        mplModules[i].name, result);
+                continue;
+            }
+            mMplModules &= ~(1 << i);
+        }
+        ALOGV_IF(ENG_VERBOSE, "HAL:MPL %s %s", mplModules[i].name,
+                needed ? "started" : "stopped");
+    }
+}
+
 /* TODO: create function pointers to calculate scale */
+/* accel full scale in g from the accel FSR node */
+int MPLSensor::readAccelScale(int *scale)
+{
+    VFUNC_LOG;
+
+    char buf[6];
+    int count, fsr;
+    int fd;
+
+    ALOGV_IF(SYSFS_VERBOSE,
+            "HAL:sysfs:cat %s (%lld)", mpu.accl_fsr, getTimestamp());
+    fd = open(mpu.accl_fsr, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("HAL:Error opening accel FSR");
+        return -errno;
+    }
+    memset(buf, 0, sizeof(buf));
+    count = read_attribute_sensor(fd, buf, sizeof(buf));
+    close(fd);
+    if (count < 1 || sscanf(buf, "%d", &fsr) != 1) {
+        ALOGE("HAL:Error reading accel FSR");
+        return -EINVAL;
+    }
+    fsr >>= 12;
+    if (fsr == 4)
+        fsr--;
+    *scale = 16 >> fsr;
+    ALOGV_IF(EXTRA_VERBOSE, "HAL:Accel FSR used %d", *scale);
+    return 0;
+}
+
+/* hand the accel scale to the MPL and to the bypass conversion */
+void MPLSensor::setAccelScale(int scale)
+{
+    mAccelScale = scale;
+    inv_set_accel_orientation_and_scale(
+            inv_orientation_matrix_to_scalar(mAccelOrientation),
+            mAccelScale << 15);
+    mAccelLsb = (mAccelScale << 15) * GRAVITY_EARTH / (1 << 30);
+}
+
 void MPLSensor::inv_set_device_properties()
 {
     VFUNC_LOG;
@@ -477,14 +615,15 @@ void MPLSensor::inv_set_device_properties()
 
     /* gyro setup */
     orient = inv_orientation_matrix_to_scalar(mGyroOrientation);
-    inv_set_gyro_orientation_and_scale(orient, 2000L << 15);
+    inv_set_gyro_orientation_and_scale(orient, MPL_GYRO_SENSITIVITY);
+    /* the MPL gives units = device_units * sensitivity / 2^30 */
+    mGyroLsb = MPL_GYRO_SENSITIVITY * (float)(M_PI / 180.) / (1 << 30);
 
     /* accel setup */
-    orient = inv_orientation_matrix_to_scalar(mAccelOrientation);
     // BMA250
     //inv_set_accl_orientation_and_scale(orient, 1LL << 22);
     // MPU6050
-    inv_set_accel_orientation_and_scale(orient, mAccelScale << 15);
+    setAccelScale(mAccelScale);
 
     /* compass setup */
     if (mCompassSensor != NULL) {
@@ -609,6 +748,9 @@ MPLSensor::~MPLSensor()
 {
     VFUNC_LOG;
 
+    stopFusionThread();
+    stopTempSampler();
+
 #if 0 // mCompassSensor removed
     delete mCompassSensor;
 #endif
@@ -637,10 +779,8 @@ MPLSensor::~MPLSensor()
         }
     }
 
-#ifdef INV_PLAYBACK_DBG
     inv_turn_off_data_logging();
-    fclose(logfile);
-#endif
+    inv_flush_calibration();
 }
 
 #define GY_ENABLED ((1 << Gyro) & enabled_sensors)
@@ -928,15 +1068,15 @@ int MPLSensor::enableSensors(unsigned long sensors, int en)
     return res;
 }
 
-/* Store calibration file */
+/* Store calibration file, written by the mllite cal writer thread */
 void MPLSensor::storeCalibration()
 {
     if ((mHaveGoodMpuCal == true) || (mAccelAccuracy >= 2)) {
-       int res = inv_store_calibration();
+       int res = inv_store_calibration_async();
        if (res) {
            ALOGE("HAL:Cannot store calibration on file");
        } else {
-           ALOGI("HAL:Cal file updated");
+           ALOGI("HAL:Cal file update queued");
        }
     }
 }
@@ -1101,16 +1241,38 @@ int MPLSensor::enable(int32_t handle, int en)
     if ((uint32_t(newState) << what) != (mEnabled & (1 << what))) {
         uint32_t sensor_type;
         short flags = newState;
+        bool gyroWasOn = mLocalSensorMask & INV_THREE_AXIS_GYRO;
+        bool accelWasOn = mLocalSensorMask & INV_THREE_AXIS_ACCEL;
         mEnabled &= ~(1 << what);
         mEnabled |= (uint32_t(flags) << what);
+        mNextOutput[what] = 0;
         ALOGV("HAL:handle = %d", handle);
         ALOGV("HAL:flags = %d", flags);
         computeLocalSensorMask(mEnabled);
-        ALOGV("HAL:enable : mEnabled = %d", mEnabled);
+        if (mTempThreaded && !gyroWasOn &&
+            (mLocalSensorMask & INV_THREE_AXIS_GYRO)) {
+            uint64_t one = 1;
+            write(mTempWakeFd, &one, sizeof(one));
+        }
+        mBypass = mEnabled && !(mEnabled & ~BYPASS_SENSORS);
+        updateMplModules(mEnabled);
+        ALOGV("HAL:enable : mEnabled = %d%s", mEnabled,
+                mBypass ? " (bypass)" : "");
         sen_mask = mLocalSensorMask & mMasterSensorMask;
         mSensorMask = sen_mask;
         ALOGV("HAL:sen_mask= 0x%0lx", sen_mask);
         enableSensors(sen_mask, flags);
+        if (!(sen_mask & (INV_THREE_AXIS_GYRO | INV_THREE_AXIS_ACCEL))) {
+            /* nothing more will come, drop what is left on the poll side */
+            mGyroBacklog = false;
+            mGyroReset = true;
+        }
+        /* the driver may have changed the range while the accel was off */
+        if (!accelWasOn && (mLocalSensorMask & INV_THREE_AXIS_ACCEL)) {
+            int scale;
+            if (!readAccelScale(&scale) && scale != mAccelScale)
+                setAccelScale(scale);
+        }
         if (LinearAccel == what && 0 != en) {
             resetAccelWindow();
         }
@@ -1120,16 +1282,6 @@ int MPLSensor::enable(int32_t handle, int en)
     }
     pthread_mutex_unlock(&mMplMutex);
 
-#ifdef INV_PLAYBACK_DBG
-    /* apparently the logging needs to be go through this sequence
-       to properly flush the log file */
-    inv_turn_off_data_logging();
-    fclose(logfile);
-    logfile = fopen("/data/playback.bin", "ab");
-    if (logfile)
-        inv_turn_on_data_logging(logfile);
-#endif
-
     return err;
 }
 
@@ -1191,6 +1343,7 @@ int MPLSensor::setDelay(int32_t handle, int64_t ns)
 
     /* store request rate to mDelays arrary for each sensor */
     mDelays[what] = ns;
+    mNextOutput[what] = 0;
     return update_delay();
 }
 
@@ -1320,6 +1473,59 @@ int MPLSensor::setLpaDelay(unsigned long us)
     return lpa_delay_enable(us);
 }
 
+int MPLSensor::enableProfile(bool enable)
+{
+    int err;
+
+    pthread_mutex_lock(&mMplMutex);
+    err = inv_enable_profile(enable);
+    if (!err)
+        inv_reset_profile();
+    pthread_mutex_unlock(&mMplMutex);
+    return err ? -ENOSYS : 0;
+}
+
+/* write the MPL profile as text to path, returns 0 or a negative errno */
+int MPLSensor::dumpProfile(const char *path)
+{
+    struct inv_profile_t prof[INV_MAX_PROFILE];
+    char tmp[PATH_MAX];
+    FILE *f;
+    int i, n;
+
+    pthread_mutex_lock(&mMplMutex);
+    n = inv_get_profile(prof, INV_MAX_PROFILE);
+    pthread_mutex_unlock(&mMplMutex);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        ALOGE("HAL:%s cannot open %s (%s)", __func__, tmp, strerror(errno));
+        return -errno;
+    }
+
+    fprintf(f, "MPL profile, times in ns\n");
+    for (i = 0; i < n; i++) {
+        if (!prof[i].calls)
+            continue;
+        if (prof[i].priority)
+            fprintf(f, "%4d %-24s", prof[i].priority,
+                    prof[i].name ? prof[i].name : "?");
+        else
+            fprintf(f, "     %-24s", prof[i].name);
+        fprintf(f, " calls=%lu avg=%llu max=%llu last=%llu total=%llu\n",
+                prof[i].calls, prof[i].total_ns / prof[i].calls,
+                prof[i].max_ns, prof[i].last_ns, prof[i].total_ns);
+    }
+
+    if (fclose(f) || rename(tmp, path) < 0) {
+        ALOGE("HAL:%s cannot write %s (%s)", __func__, path, strerror(errno));
+        unlink(tmp);
+        return -errno;
+    }
+    return 0;
+}
+
 /** motion_detect_enable
  *  When enabled with a threshold, the kernel driver will stop
  *  sending accelerometer data until motion is detected past the
@@ -1484,10 +1690,15 @@ int MPLSensor::readAccelEvents(sensors_event_t* data, int count)
     int numEventReceived = 0;
     input_event const* event;
     int nb, done = 0;
-
-    while (done == 0 && count && mAccelInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
+    size_t frame;
+
+    while (done == 0 && count && (frame = mAccelInputReader.readFrame(&event))) {
+        for (; --frame; event++) {
+            if (event->type != EV_ABS) {
+                ALOGE("HAL:AccelSensor: unknown event (type=%d, code=%d)",
+                        event->type, event->code);
+                continue;
+            }
             if (event->code == EVENT_TYPE_ACCEL_X) {
                 mPendingMask |= 1 << Accelerometer;
                 mCachedAccelData[0] = event->value;
@@ -1498,19 +1709,19 @@ int MPLSensor::readAccelEvents(sensors_event_t* data, int count)
                 mPendingMask |= 1 << Accelerometer;
                 mCachedAccelData[2] =event-> value;
             }
-        } else if (type == EV_SYN) {
-            done = 1;
-            if (mLocalSensorMask & INV_THREE_AXIS_ACCEL) {
-                inv_build_accel(mCachedAccelData, 0, getTimestamp());
-                nb = executeOnData(data, count);
-                numEventReceived += nb;
-                count -= nb;
-            }
-        } else {
-            ALOGE("HAL:AccelSensor: unknown event (type=%d, code=%d)",
-                    type, event->code);
         }
-        mAccelInputReader.next();
+
+        done = 1;
+        RawSample sample;
+        sample.source = SAMPLE_ACCEL;
+        sample.mask = 1 << Accelerometer;
+        memcpy(sample.data, mCachedAccelData, sizeof(sample.data));
+        sample.status = 0;
+        sample.timestamp = getTimestamp();
+        nb = feedSample(sample, data, count);
+        numEventReceived += nb;
+        count -= nb;
+        mAccelInputReader.nextFrame();
     }
 
     ALOGV_IF(ENG_VERBOSE, "HAL:readAccelEvents - events read=%d", numEventReceived);
@@ -1518,17 +1729,9 @@ int MPLSensor::readAccelEvents(sensors_event_t* data, int count)
     return numEventReceived;
 }
 
-/**
- *  Should be called after reading at least one of gyro
- *  compass or accel data. You should only read 1 sample of
- *  data and call this.
- *  @returns 0, if successful, error number if not.
- */
-
-int MPLSensor::executeOnData(sensors_event_t* data, int count)
+/* run the MPL algorithms on the data built so far and act on its messages */
+void MPLSensor::runMpl()
 {
-    VFUNC_LOG;
-    int numEventReceived = 0;
     long msg;
 
     inv_execute_on_data();
@@ -1547,11 +1750,32 @@ int MPLSensor::executeOnData(sensors_event_t* data, int count)
             mHaveGoodMpuCal = true;
         }
     }
+}
+
+/**
+ *  Should be called after reading at least one of gyro
+ *  compass or accel data. You should only read 1 sample of
+ *  data and call this.
+ *  Each enabled sensor is decimated to the rate set with setDelay: its
+ *  handler only runs once the sample timestamp reaches the sensor's next
+ *  output time, so a slow listener next to a fast one costs no extra
+ *  handler work or events. Samples from every source are stamped on
+ *  CLOCK_MONOTONIC (see CompassSensor) so one schedule serves them all.
+ *  @returns 0, if successful, error number if not.
+ */
+
+int MPLSensor::executeOnData(sensors_event_t* data, int count,
+                             int64_t timestamp)
+{
+    VFUNC_LOG;
+    int numEventReceived = 0;
+
+    runMpl();
 
     // load up virtual sensors
     for (int i = 0; i < numSensors; i++) {
         int update;
-        if (mEnabled & (1 << i)) {
+        if ((mEnabled & (1 << i)) && timestamp >= mNextOutput[i]) {
             update = CALL_MEMBER_FN(this, mHandlers[i])(mPendingEvents + i);
             mPendingMask |= (1 << i);
 
@@ -1559,6 +1783,11 @@ int MPLSensor::executeOnData(sensors_event_t* data, int count)
                 *data++ = mPendingEvents[i];
                 count--;
                 numEventReceived++;
+
+                /* stay on the requested period unless we fell behind */
+                mNextOutput[i] += mDelays[i];
+                if (mNextOutput[i] <= timestamp)
+                    mNextOutput[i] = timestamp + mDelays[i];
             }
         }
     }
@@ -1576,22 +1805,44 @@ int MPLSensor::readEvents(sensors_event_t *data, int count)
     if (count < 1)
         return -EINVAL;
 
+    /*
+     * frames already buffered go out first, reading now would hold them
+     * behind the next interrupt. The fd is non-blocking (see
+     * SensorPollMux::add), EAGAIN just means nothing new arrived.
+     */
+    ssize_t n = 0;
     pthread_mutex_lock(&mMplMutex);
-    ssize_t n = mGyroInputReader.fill(mpu_int_fd);
+    if (mGyroReset) {
+        mGyroInputReader.reset();
+        mGyroReset = false;
+    }
+    if (!mGyroBacklog)
+        n = mGyroInputReader.fill(mpu_int_fd);
     pthread_mutex_unlock(&mMplMutex);
-    if (n < 0) {
+    if (n < 0 && n != -EAGAIN) {
         return n;
     }
 
     int numEventReceived = 0;
     input_event const* event;
-    int done = 0;
-    int mask = 0;
+    int numFrames = 0;
+    int mask;
     int nb;
+    size_t frame;
 
-    while (done == 0 && count && mGyroInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_REL) {
+    /*
+     * decode the whole backlog, one fusion step per frame, so the MPL keeps
+     * up with the FIFO instead of taking one frame per poll wakeup
+     */
+    while (numFrames < MAX_READ_FRAMES && count &&
+           (frame = mGyroInputReader.readFrame(&event))) {
+        mask = 0;
+        for (; --frame; event++) {
+            if (event->type != EV_REL) {
+                ALOGE("HAL:Sensor: unknown event (type=%d, code=%d)",
+                     event->type, event->code);
+                continue;
+            }
             switch (event->code) {
             case EVENT_TYPE_GYRO_X:
                 mCachedGyroData[0] = event->value;
@@ -1628,70 +1879,29 @@ int MPLSensor::readEvents(sensors_event_t *data, int count)
                 mSensorTimestamp |= (uint64_t)((unsigned int)event->value);
                 break;
             }
+        }
 
-        } else if (type == EV_SYN) {
-            done = 1;
-
-            // send down temperature every 0.5 seconds
-            if (mSensorTimestamp - mTempCurrentTime >= 500000000LL) {
-                mTempCurrentTime = mSensorTimestamp;
-                long long temperature[2];
-                if (inv_read_temperature(temperature) == 0) {
-                    ALOGV_IF(INPUT_DATA,
-                            "HAL:inv_read_temperature = %lld, timestamp= %lld",
-                            temperature[0], temperature[1]);
-                    inv_build_temp(temperature[0], temperature[1]);
-                }
-#ifdef TESTING
-                long bias[3], temp, temp_slope[3];
-                inv_get_gyro_bias(bias, &temp);
-                inv_get_gyro_ts(temp_slope);
-
-                ALOGI("T: %.3f "
-                     "GB: %+13f %+13f %+13f "
-                     "TS: %+13f %+13f %+13f "
-                     "\n",
-                     (float)temperature[0] / 65536.f,
-                     (float)bias[0] / 65536.f / 16.384f,
-                     (float)bias[1] / 65536.f / 16.384f,
-                     (float)bias[2] / 65536.f / 16.384f,
-                     temp_slope[0] / 65536.f,
-                     temp_slope[1] / 65536.f,
-                     temp_slope[2] / 65536.f);
-#endif
-            }
-
-            if (mask & (1 << Gyro)) {
-                mPendingMask |= 1 << Gyro;
-                if (mLocalSensorMask & INV_THREE_AXIS_GYRO) {
-                    inv_build_gyro(mCachedGyroData, mSensorTimestamp);
-                    ALOGV_IF(INPUT_DATA,
-                            "HAL:inv_build_gyro:    %+8d %+8d %+8d - %lld",
-                            mCachedGyroData[0], mCachedGyroData[1],
-                            mCachedGyroData[2], mSensorTimestamp);
-                }
-            }
-            if (mask & (1 << Accelerometer)) {
-                mPendingMask |= 1 << Accelerometer;
-                if (mLocalSensorMask & INV_THREE_AXIS_ACCEL) {
-                    inv_build_accel(mCachedAccelData, 0, mSensorTimestamp);
-                    ALOGV_IF(INPUT_DATA,
-                            "HAL:inv_build_accel:   %+8ld %+8ld %+8ld - %lld",
-                            mCachedAccelData[0], mCachedAccelData[1],
-                            mCachedAccelData[2], mSensorTimestamp);
-                }
-            }
+        // event is the EV_SYN closing the frame
+        numFrames++;
 
-            nb = executeOnData(data, count);
-            numEventReceived += nb;
-            count -= nb;
-        } else {
-            ALOGE("HAL:Sensor: unknown event (type=%d, code=%d)",
-                 type, event->code);
-        }
-        mGyroInputReader.next();
+        RawSample sample;
+        sample.source = SAMPLE_MPU;
+        sample.mask = mask;
+        memcpy(sample.gyro, mCachedGyroData, sizeof(sample.gyro));
+        memcpy(sample.data, mCachedAccelData, sizeof(sample.data));
+        sample.status = 0;
+        sample.timestamp = mSensorTimestamp;
+        nb = feedSample(sample, data, count);
+        numEventReceived += nb;
+        count -= nb;
+        mGyroInputReader.nextFrame();
     }
 
+    /* frames left over for the next dispatch, see hasBufferedFrames() */
+    mGyroBacklog = mGyroInputReader.readFrame(&event) != 0;
+    ALOGV_IF(ENG_VERBOSE && mGyroBacklog,
+             "HAL:readEvents - %d frames decoded, backlog left", numFrames);
+
     return numEventReceived;
 }
 
@@ -1702,7 +1912,6 @@ int MPLSensor::readCompassEvents(sensors_event_t *data, int count)
 
     int numEventReceived = 0;
     int done = 0;
-    int nb;
 
     if (count < 1)
         return -EINVAL;
@@ -1712,27 +1921,557 @@ int MPLSensor::readCompassEvents(sensors_event_t *data, int count)
 
     done = mCompassSensor->readSample(mCachedCompassData, &mCompassTimestamp);
     if (done > 0) {
-        int status;
-        status = 0;
+        RawSample sample;
+        sample.source = SAMPLE_COMPASS;
+        sample.mask = 1 << MagneticField;
+        memcpy(sample.data, mCachedCompassData, sizeof(sample.data));
+        sample.status = 0;
         if (mCompassSensor->providesCalibration()) {
-            status = mCompassSensor->getAccuracy();
-            status |= INV_CALIBRATED;
+            sample.status = mCompassSensor->getAccuracy();
+            sample.status |= INV_CALIBRATED;
         }
-        if (mLocalSensorMask & INV_THREE_AXIS_COMPASS) {
-            inv_build_compass(mCachedCompassData, status,
-                              mCompassTimestamp);
-            ALOGV_IF(INPUT_DATA, "HAL:inv_build_compass: %+8ld %+8ld %+8ld - %lld",
-                    mCachedCompassData[0], mCachedCompassData[1],
-                    mCachedCompassData[2], mCompassTimestamp);
-            nb = executeOnData(data, count);
-            numEventReceived += nb;
-            count -= nb;
+        sample.timestamp = mCompassTimestamp;
+        numEventReceived = feedSample(sample, data, count);
+    }
+
+    return numEventReceived;
+}
+
+/**
+ *  Feed one decoded sample to the MPL and collect the resulting events,
+ *  on the thread that read it or on the fusion thread.
+ */
+int MPLSensor::processSample(RawSample const& sample, sensors_event_t *data,
+                             int count)
+{
+    VHANDLER_LOG;
+
+    if (bypassActive()) {
+        /*
+         * keep the MPL inputs current so the bias, no motion and
+         * temperature compensation go on learning, and timestamps are
+         * fresh when a fusion sensor comes back; the algorithms only run
+         * every BYPASS_MPL_PERIOD_NS though
+         */
+        if (buildSample(sample) && sample.timestamp >= mNextMplRun) {
+            runMpl();
+            mNextMplRun = sample.timestamp + BYPASS_MPL_PERIOD_NS;
         }
+        return bypassSample(sample, data, count);
+    }
+
+    switch (sample.source) {
+    case SAMPLE_MPU:
+    case SAMPLE_ACCEL:
+        if (!buildSample(sample))
+            return 0;
+        return executeOnData(data, count, sample.timestamp);
+    case SAMPLE_COMPASS:
+        if (!(mLocalSensorMask & INV_THREE_AXIS_COMPASS))
+            return 0;
+        inv_build_compass(sample.data, sample.status, sample.timestamp);
+        ALOGV_IF(INPUT_DATA, "HAL:inv_build_compass: %+8ld %+8ld %+8ld - %lld",
+                sample.data[0], sample.data[1], sample.data[2],
+                sample.timestamp);
+        return executeOnData(data, count, sample.timestamp);
+    default:
+        return 0;
+    }
+}
+
+/* push a gyro/accel sample into the MPL data builders, false if none used */
+bool MPLSensor::buildSample(RawSample const& sample)
+{
+    if (sample.source == SAMPLE_ACCEL) {
+        if (!(mLocalSensorMask & INV_THREE_AXIS_ACCEL))
+            return false;
+        inv_build_accel(sample.data, 0, sample.timestamp);
+        return true;
+    }
+    if (sample.source != SAMPLE_MPU)
+        return false;
+
+    // send down each temperature the sampler thread read, every 0.5 seconds
+    long long temperature[2];
+    if (readTempSample(temperature)) {
+        ALOGV_IF(INPUT_DATA,
+                "HAL:inv_read_temperature = %lld, timestamp= %lld",
+                temperature[0], temperature[1]);
+        inv_build_temp(temperature[0], temperature[1]);
+#ifdef TESTING
+        long bias[3], temp, temp_slope[3];
+        inv_get_gyro_bias(bias, &temp);
+        inv_get_gyro_ts(temp_slope);
+
+        ALOGI("T: %.3f "
+             "GB: %+13f %+13f %+13f "
+             "TS: %+13f %+13f %+13f "
+             "\n",
+             (float)temperature[0] / 65536.f,
+             (float)bias[0] / 65536.f / 16.384f,
+             (float)bias[1] / 65536.f / 16.384f,
+             (float)bias[2] / 65536.f / 16.384f,
+             temp_slope[0] / 65536.f,
+             temp_slope[1] / 65536.f,
+             temp_slope[2] / 65536.f);
+#endif
+    }
+
+    if (sample.mask & (1 << Gyro)) {
+        mPendingMask |= 1 << Gyro;
+        if (mLocalSensorMask & INV_THREE_AXIS_GYRO) {
+            inv_build_gyro(sample.gyro, sample.timestamp);
+            ALOGV_IF(INPUT_DATA,
+                    "HAL:inv_build_gyro:    %+8d %+8d %+8d - %lld",
+                    sample.gyro[0], sample.gyro[1],
+                    sample.gyro[2], sample.timestamp);
+        }
+    }
+    if (sample.mask & (1 << Accelerometer)) {
+        mPendingMask |= 1 << Accelerometer;
+        if (mLocalSensorMask & INV_THREE_AXIS_ACCEL) {
+            inv_build_accel(sample.data, 0, sample.timestamp);
+            ALOGV_IF(INPUT_DATA,
+                    "HAL:inv_build_accel:   %+8ld %+8ld %+8ld - %lld",
+                    sample.data[0], sample.data[1],
+                    sample.data[2], sample.timestamp);
+        }
+    }
+
+    return true;
+}
+
+/**
+ *  With only the accelerometer and/or gyro enabled there is nothing for the
+ *  MPL to fuse, so the raw samples are converted here with the orientation,
+ *  scale and bias the MPL would apply. The samples are still built into the
+ *  MPL, which runs every BYPASS_MPL_PERIOD_NS only to keep the bias and
+ *  temperature compensation up to date, see processSample(). The gyro
+ *  bias is only learned by the MPL's no-motion detection, so gyro samples
+ *  keep going through the MPL until it has reported one.
+ */
+bool MPLSensor::bypassActive() const
+{
+    if (!mBypass)
+        return false;
+    if ((mEnabled & (1 << Gyro)) &&
+            mGyroAccuracy < SENSOR_STATUS_ACCURACY_HIGH)
+        return false;
+    return true;
+}
+
+/* raw to body frame as inv_apply_calibration() does it, bias in chip frame */
+static void bypassConvert(signed char const *orient, float lsb,
+                          long const *raw, long const *bias, float *out)
+{
+    float v[3];
+
+    for (int j = 0; j < 3; j++)
+        v[j] = raw[j] - bias[j] / 65536.f;
+    for (int i = 0; i < 3; i++)
+        out[i] = lsb * (orient[i * 3] * v[0] + orient[i * 3 + 1] * v[1] +
+                        orient[i * 3 + 2] * v[2]);
+}
+
+void MPLSensor::bypassGyro(RawSample const& sample, sensors_event_t *s)
+{
+    long raw[3] = { sample.gyro[0], sample.gyro[1], sample.gyro[2] };
+    long bias[3], cal[3];
+
+    inv_get_gyro_bias(bias, NULL);
+    inv_get_gyro_set(cal, &s->gyro.status, NULL);
+    bypassConvert(mGyroOrientation, mGyroLsb, raw, bias, s->gyro.v);
+    s->timestamp = sample.timestamp;
+    ALOGV_IF(HANDLER_DATA, "HAL:gyro bypass : %+f %+f %+f -- %lld",
+            s->gyro.v[0], s->gyro.v[1], s->gyro.v[2], s->timestamp);
+}
+
+void MPLSensor::bypassAccel(RawSample const& sample, sensors_event_t *s)
+{
+    long bias[3];
+
+    inv_get_accel_bias(bias, NULL);
+    inv_get_accel_set(NULL, &s->acceleration.status, NULL);
+    bypassConvert(mAccelOrientation, mAccelLsb, sample.data, bias,
+                  s->acceleration.v);
+    s->timestamp = sample.timestamp;
+    ALOGV_IF(HANDLER_DATA, "HAL:accel bypass : %+f %+f %+f -- %lld",
+            s->acceleration.v[0], s->acceleration.v[1],
+            s->acceleration.v[2], s->timestamp);
+    mAccelAccuracy = s->acceleration.status;
+    if (mAccelVariableRate == true) {
+        updateAccelWindow(s->acceleration.v[0], s->acceleration.v[1],
+            s->acceleration.v[2]);
+    }
+}
+
+/* the executeOnData() output loop for the two raw sensors */
+int MPLSensor::bypassSample(RawSample const& sample, sensors_event_t *data,
+                            int count)
+{
+    static const int raw[] = { Gyro, Accelerometer };
+    int numEventReceived = 0;
+
+    if (sample.source == SAMPLE_COMPASS)
+        return 0;
+
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++) {
+        int what = raw[i];
+
+        if (!(sample.mask & (1 << what)))
+            continue;
+        mPendingMask |= 1 << what;
+        if (!(mEnabled & (1 << what)) || sample.timestamp < mNextOutput[what])
+            continue;
+
+        if (what == Gyro)
+            bypassGyro(sample, mPendingEvents + what);
+        else
+            bypassAccel(sample, mPendingEvents + what);
+
+        if (count > 0) {
+            *data++ = mPendingEvents[what];
+            count--;
+            numEventReceived++;
+
+            mNextOutput[what] += mDelays[what];
+            if (mNextOutput[what] <= sample.timestamp)
+                mNextOutput[what] = sample.timestamp + mDelays[what];
+        }
+    }
+
+    return numEventReceived;
+}
+
+/* process inline, or queue for the fusion thread and report nothing yet */
+int MPLSensor::feedSample(RawSample const& sample, sensors_event_t *data,
+                          int count)
+{
+    uint32_t head, tail;
+
+    if (!mFusionThreaded)
+        return processSample(sample, data, count);
+
+    head = mRawHead;
+    tail = __atomic_load_n(&mRawTail, __ATOMIC_ACQUIRE);
+    if (head - tail >= FUSION_QUEUE_SIZE) {
+        __atomic_add_fetch(&mRawDropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    mRawQueue[head & (FUSION_QUEUE_SIZE - 1)] = sample;
+    __atomic_store_n(&mRawHead, head + 1, __ATOMIC_RELEASE);
+
+    uint64_t one = 1;
+    if (write(mFusionWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        ALOGE("HAL:fusion wakeup failed (%s)", strerror(errno));
+    return 0;
+}
+
+/**
+ *  Move fusion to its own real-time thread. The read paths then only
+ *  decode input frames and queue them; the thread runs the MPL and queues
+ *  the events of each sensor on its own SensorSpscRing, signalling
+ *  getFusionFd(). readFusionEvents() collects them on the poll side without
+ *  taking any lock. All inputs must be read from one thread, the raw queue
+ *  has a single producer.
+ */
+int MPLSensor::startFusionThread()
+{
+    VFUNC_LOG;
+
+    struct sched_param param;
+    int err;
+
+    if (mFusionThreaded)
+        return 0;
+
+    for (int i = 0; i < numSensors; i++)
+        mFusionRings[i] = new SensorSpscRing(FUSION_EVENT_QUEUE_SIZE);
+
+    mFusionWakeFd = eventfd(0, 0);
+    mFusionOutFd = eventfd(0, EFD_NONBLOCK);
+    if (mFusionWakeFd < 0 || mFusionOutFd < 0) {
+        err = -errno;
+        ALOGE("HAL:fusion eventfd failed (%s)", strerror(errno));
+        stopFusionThread();
+        return err;
+    }
+
+    mFusionStop = false;
+    mFusionThreaded = true;
+    err = pthread_create(&mFusionThread, NULL, fusionThreadLoop, this);
+    if (err) {
+        ALOGE("HAL:error creating fusion thread (%s)", strerror(err));
+        mFusionThreaded = false;
+        stopFusionThread();
+        return -err;
+    }
+    pthread_setname_np(mFusionThread, "mpl_fusion");
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = FUSION_THREAD_PRIORITY;
+    err = pthread_setschedparam(mFusionThread, SCHED_FIFO, &param);
+    ALOGW_IF(err, "HAL:fusion thread not real-time (%s)", strerror(err));
+
+    ALOGI("HAL:fusion runs on its own thread");
+    return 0;
+}
+
+void MPLSensor::stopFusionThread()
+{
+    VFUNC_LOG;
+
+    if (mFusionThreaded) {
+        uint64_t one = 1;
+
+        mFusionStop = true;
+        write(mFusionWakeFd, &one, sizeof(one));
+        pthread_join(mFusionThread, NULL);
+        mFusionThreaded = false;
+    }
+    if (mFusionWakeFd >= 0)
+        close(mFusionWakeFd);
+    if (mFusionOutFd >= 0)
+        close(mFusionOutFd);
+    mFusionWakeFd = -1;
+    mFusionOutFd = -1;
+    for (int i = 0; i < numSensors; i++) {
+        delete mFusionRings[i];
+        mFusionRings[i] = NULL;
+    }
+}
+
+void *MPLSensor::fusionThreadLoop(void *arg)
+{
+    ((MPLSensor *)arg)->fusionLoop();
+    return NULL;
+}
+
+void MPLSensor::fusionLoop()
+{
+    sensors_event_t events[numSensors];
+    uint32_t dropped = 0, eventsDropped = 0, total;
+    uint64_t value;
+    int i, n, published;
+
+    while (!mFusionStop) {
+        if (read(mFusionWakeFd, &value, sizeof(value)) < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("HAL:fusion thread giving up (%s)", strerror(errno));
+            break;
+        }
+
+        published = 0;
+        while (!mFusionStop) {
+            uint32_t tail = mRawTail;
+            if (tail == __atomic_load_n(&mRawHead, __ATOMIC_ACQUIRE))
+                break;
+
+            pthread_mutex_lock(&mMplMutex);
+            n = processSample(mRawQueue[tail & (FUSION_QUEUE_SIZE - 1)],
+                              events, numSensors);
+            pthread_mutex_unlock(&mMplMutex);
+            __atomic_store_n(&mRawTail, tail + 1, __ATOMIC_RELEASE);
+
+            for (i = 0; i < n; i++)
+                publish(events[i]);
+            published += n;
+        }
+
+        value = 1;
+        if (published && write(mFusionOutFd, &value, sizeof(value)) < 0)
+            ALOGE("HAL:fusion notify failed (%s)", strerror(errno));
+
+        if (__atomic_load_n(&mRawDropped, __ATOMIC_RELAXED) != dropped) {
+            dropped = __atomic_load_n(&mRawDropped, __ATOMIC_RELAXED);
+            ALOGW("HAL:fusion queue full, %u samples dropped so far", dropped);
+        }
+        for (i = 0, total = 0; i < numSensors; i++)
+            total += mFusionRings[i]->dropped();
+        if (total != eventsDropped) {
+            eventsDropped = total;
+            ALOGW("HAL:fusion events not read in time, %u dropped so far",
+                  eventsDropped);
+        }
+    }
+}
+
+/* fusion thread side, a full ring drops the new event */
+void MPLSensor::publish(sensors_event_t const& event)
+{
+    for (int i = 0; i < numSensors; i++) {
+        if (mPendingEvents[i].sensor == event.sensor) {
+            mFusionRings[i]->push(event);
+            return;
+        }
+    }
+}
+
+/**
+ *  Poll side of the fusion thread: the events queued since the last call,
+ *  oldest first across sensors. Every MPL output is a continuous sensor,
+ *  so each event is delivered rather than only the latest one; what does
+ *  not fit in data stays queued for the next dispatch.
+ */
+int MPLSensor::readFusionEvents(sensors_event_t *data, int count)
+{
+    VHANDLER_LOG;
+
+    int numEventReceived = 0;
+    uint64_t value;
+
+    if (count < 1)
+        return -EINVAL;
+
+    read(mFusionOutFd, &value, sizeof(value));
+
+    while (count) {
+        SensorSpscRing *oldest = NULL;
+        sensors_event_t const *first = NULL;
+
+        for (int i = 0; i < numSensors; i++) {
+            sensors_event_t const *e = mFusionRings[i]->peek();
+
+            if (e && (!first || e->timestamp < first->timestamp)) {
+                first = e;
+                oldest = mFusionRings[i];
+            }
+        }
+        if (!first)
+            break;
+        *data++ = *first;
+        oldest->pop();
+        count--;
+        numEventReceived++;
     }
 
     return numEventReceived;
 }
 
+/**
+ *  Gyro temperature sampler: reads the temperature node every
+ *  TEMP_SAMPLE_PERIOD_MS at a low priority while the gyro is in use, so
+ *  processSample() only picks up the latest reading and never blocks on
+ *  sysfs. It does not wake up at all while the gyro is off.
+ */
+int MPLSensor::startTempSampler()
+{
+    VFUNC_LOG;
+
+    int err;
+
+    if (mTempThreaded)
+        return 0;
+
+    mTempWakeFd = eventfd(0, 0);
+    if (mTempWakeFd < 0) {
+        err = -errno;
+        ALOGE("HAL:temperature eventfd failed (%s)", strerror(errno));
+        return err;
+    }
+
+    mTempStop = false;
+    mTempThreaded = true;
+    err = pthread_create(&mTempThread, NULL, tempThreadLoop, this);
+    if (err) {
+        ALOGE("HAL:error creating temperature thread (%s)", strerror(err));
+        mTempThreaded = false;
+        stopTempSampler();
+        return -err;
+    }
+    pthread_setname_np(mTempThread, "mpl_temp");
+    return 0;
+}
+
+void MPLSensor::stopTempSampler()
+{
+    VFUNC_LOG;
+
+    if (mTempThreaded) {
+        uint64_t one = 1;
+
+        mTempStop = true;
+        write(mTempWakeFd, &one, sizeof(one));
+        pthread_join(mTempThread, NULL);
+        mTempThreaded = false;
+    }
+    if (mTempWakeFd >= 0)
+        close(mTempWakeFd);
+    mTempWakeFd = -1;
+}
+
+void *MPLSensor::tempThreadLoop(void *arg)
+{
+    ((MPLSensor *)arg)->tempLoop();
+    return NULL;
+}
+
+void MPLSensor::tempLoop()
+{
+    struct pollfd pfd;
+    long long temperature[2];
+    uint64_t value;
+    uint32_t seq;
+    bool gyroOn;
+    int n;
+
+    /* per thread on Linux */
+    if (setpriority(PRIO_PROCESS, 0, TEMP_THREAD_NICE) < 0)
+        ALOGW("HAL:temperature thread keeps its priority (%s)",
+              strerror(errno));
+
+    pfd.fd = mTempWakeFd;
+    pfd.events = POLLIN;
+    while (!mTempStop) {
+        /* nothing to compensate while the gyro is off: sleep until
+         * enable() kicks mTempWakeFd */
+        gyroOn = __atomic_load_n(&mLocalSensorMask, __ATOMIC_RELAXED) &
+                 INV_THREE_AXIS_GYRO;
+        n = poll(&pfd, 1, gyroOn ? TEMP_SAMPLE_PERIOD_MS : -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ALOGE("HAL:temperature thread giving up (%s)", strerror(errno));
+            break;
+        }
+        if (n > 0) {
+            read(mTempWakeFd, &value, sizeof(value));
+            continue;
+        }
+        if (!gyroOn || mTempStop)
+            continue;
+        if (inv_read_temperature(temperature))
+            continue;
+
+        seq = mTempSample.seq;
+        __atomic_store_n(&mTempSample.seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        mTempSample.temperature = temperature[0];
+        mTempSample.timestamp = temperature[1];
+        __atomic_store_n(&mTempSample.seq, seq + 2, __ATOMIC_RELEASE);
+    }
+}
+
+/* the reading published since the last call, if any */
+bool MPLSensor::readTempSample(long long *temperature)
+{
+    uint32_t seq, again;
+
+    do {
+        seq = __atomic_load_n(&mTempSample.seq, __ATOMIC_ACQUIRE);
+        if (seq == mTempSeen || (seq & 1))
+            return false;
+        temperature[0] = mTempSample.temperature;
+        temperature[1] = mTempSample.timestamp;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        again = __atomic_load_n(&mTempSample.seq, __ATOMIC_RELAXED);
+    } while (again != seq);
+
+    mTempSeen = seq;
+    return true;
+}
+
 int MPLSensor::getFd() const
 {
     VFUNC_LOG;
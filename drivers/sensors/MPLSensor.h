@@ -29,6 +29,7 @@
 #include "sensors.h"
 #include "SensorBase.h"
 #include "InputEventReader.h"
+#include "SensorSpscRing.h"
 #include "CompassSensor.h"
 
 #define ACCEL_THRESHOLD	                0.2
@@ -55,6 +56,26 @@
  * then set MPL_PM_STDBY to 1.
  */
 #define MPL_PM_STDBY                    (0)
+/* Events in one MPU input frame: gyro and accel xyz, timestamp hi/lo, sync.
+ * readEvents() decodes up to MAX_READ_FRAMES buffered frames per call, which
+ * bounds the time spent in fusion before the poll loop gets control back.
+ */
+#define MPU_FRAME_EVENTS                (9)
+#define MAX_READ_FRAMES                 (16)
+/* Raw samples queued for the fusion thread (a power of two) and its
+ * SCHED_FIFO priority, see startFusionThread().
+ */
+#define FUSION_QUEUE_SIZE               (64)
+#define FUSION_THREAD_PRIORITY          (2)
+/* Events of each sensor queued from the fusion thread to the poll side */
+#define FUSION_EVENT_QUEUE_SIZE         (32)
+/* How often the MPL still runs while accel/gyro bypass it, in ns */
+#define BYPASS_MPL_PERIOD_NS            (20000000LL)
+/* Gyro temperature sampling period and the nice value of the sampler
+ * thread, see startTempSampler().
+ */
+#define TEMP_SAMPLE_PERIOD_MS           (500)
+#define TEMP_THREAD_NICE                (10)
 
 /*****************************************************************************/
 /* Sensors Enable/Disable Mask
@@ -113,6 +134,7 @@ public:
     virtual int getCompassFd() const;
     virtual int getPollTime();
     virtual bool hasPendingEvents() const;
+    bool hasBufferedFrames() const { return mGyroBacklog; }
     virtual void sleepEvent();
     virtual void wakeEvent();
     int populateSensorList(struct sensor_t *list, int len);
@@ -123,12 +145,22 @@ public:
 
     //AKM HAL Integration
     //void set_compass(long ready, long x, long y, long z, long accuracy);
-    int executeOnData(sensors_event_t* data, int count);
+    int executeOnData(sensors_event_t* data, int count, int64_t timestamp);
+    void runMpl();
     int readAccelEvents(sensors_event_t* data, int count);
     int readCompassEvents(sensors_event_t* data, int count);
 
+    int startFusionThread();
+    void stopFusionThread();
+    int getFusionFd() const { return mFusionOutFd; }
+    int readFusionEvents(sensors_event_t *data, int count);
+
     int setLpaDelay(unsigned long us);
 
+    /* MPL per-algorithm timing, -ENOSYS when libmllite is built without */
+    int enableProfile(bool enable);
+    int dumpProfile(const char *path);
+
 protected:
     CompassSensor *mCompassSensor;
 
@@ -149,8 +181,11 @@ protected:
     void updateAccelWindow(float accel0, float accel1, float accel2);
 
     void inv_set_device_properties();
+    int readAccelScale(int *scale);
+    void setAccelScale(int scale);
     int inv_constructor_init();
     int inv_constructor_default_enable();
+    void updateMplModules(uint32_t enabled);
     int setGyroInitialState();
     int setAccelInitialState();
     int masterEnable(int en);
@@ -188,6 +223,7 @@ protected:
     int mSampleCount;
     pthread_mutex_t mMplMutex;
     bool mIntegratedAccel;
+    uint32_t mMplModules;   // running entries of the MPL module table
 
     enum FILEHANDLES
     {
@@ -207,6 +243,7 @@ protected:
     uint32_t mOldEnabledMask;
     sensors_event_t mPendingEvents[numSensors];
     uint64_t mDelays[numSensors];
+    int64_t mNextOutput[numSensors];    /* decimation, CLOCK_MONOTONIC */
     hfunc_t mHandlers[numSensors];
     short mCachedGyroData[3];
     long mCachedAccelData[3];
@@ -216,11 +253,24 @@ protected:
 
     InputEventCircularReader mAccelInputReader;
     InputEventCircularReader mGyroInputReader;
+    bool mGyroBacklog;
+    bool mGyroReset;        // drop mGyroInputReader on the next read
 
     bool mFirstRead;
     short mTempScale;
     short mTempOffset;
-    int64_t mTempCurrentTime;
+    /* latest gyro temperature, seqlock published by the sampler thread */
+    struct TempSample {
+        uint32_t seq;           // odd while being written
+        long long temperature;  // q16 degrees C
+        long long timestamp;
+    };
+    TempSample mTempSample;
+    uint32_t mTempSeen;         // fusion side, last seq built
+    bool mTempThreaded;
+    volatile bool mTempStop;
+    pthread_t mTempThread;
+    int mTempWakeFd;
     int mAccelScale;
 
     uint32_t mPendingMask;
@@ -241,6 +291,58 @@ protected:
     int64_t mSensorTimestamp;
     int64_t mCompassTimestamp;
 
+    /* one decoded input frame, fed to the MPL by processSample() */
+    enum {
+        SAMPLE_MPU,
+        SAMPLE_ACCEL,
+        SAMPLE_COMPASS,
+    };
+    struct RawSample {
+        int source;
+        int mask;               // sensors present in a SAMPLE_MPU frame
+        short gyro[3];
+        long data[3];           // accel or compass
+        int status;             // compass calibration status
+        int64_t timestamp;      // CLOCK_MONOTONIC, whatever the source
+    };
+    int processSample(RawSample const& sample, sensors_event_t *data,
+                      int count);
+    /* accel/gyro straight to events while no fusion sensor is enabled */
+    bool mBypass;
+    int64_t mNextMplRun;        // next MPL run while bypassing, sample time
+    float mGyroLsb;             // rad/s per gyro LSB
+    float mAccelLsb;            // m/s^2 per accel LSB
+    bool bypassActive() const;
+    int bypassSample(RawSample const& sample, sensors_event_t *data,
+                     int count);
+    void bypassGyro(RawSample const& sample, sensors_event_t *s);
+    void bypassAccel(RawSample const& sample, sensors_event_t *s);
+    int feedSample(RawSample const& sample, sensors_event_t *data, int count);
+    bool buildSample(RawSample const& sample);
+
+    /* fusion thread, raw samples in through mRawQueue, events out through
+     * one ring per sensor */
+    bool mFusionThreaded;
+    volatile bool mFusionStop;
+    pthread_t mFusionThread;
+    int mFusionWakeFd;
+    int mFusionOutFd;
+    RawSample mRawQueue[FUSION_QUEUE_SIZE];
+    uint32_t mRawHead;          // producer (read path) owned
+    uint32_t mRawTail;          // fusion thread owned
+    uint32_t mRawDropped;
+    SensorSpscRing *mFusionRings[numSensors];
+
+    static void *fusionThreadLoop(void *arg);
+    void fusionLoop();
+    void publish(sensors_event_t const& event);
+
+    int startTempSampler();
+    void stopTempSampler();
+    static void *tempThreadLoop(void *arg);
+    void tempLoop();
+    bool readTempSample(long long *temperature);
+
     struct sysfs_attrbs {
        char *chip_enable;
        char *dmp_firmware;
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include "log.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 #include <fcntl.h>
 
 #include "ml_sysfs_helper.h"
@@ -143,34 +144,41 @@ int write_attribute_sensor_continuous(int fd, long data)
 
 int read_sysfs_int(char *filename, int *var)
 {
-    int res=0;
-    FILE  *sysfsfp;
+    char buf[20];
+    int res, fd;
 
-    sysfsfp = fopen(filename, "r");
-    if (sysfsfp!=NULL) {
-        fscanf(sysfsfp, "%d\n", var);
-        fclose(sysfsfp);
-    } else {
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         res = errno;
         ALOGE("HAL:ERR open file %s to read with error %d", filename, res);
+        return -res;
     }
-    return -res;
+    res = pread(fd, buf, sizeof(buf), 0);
+    if (res < 0)
+        res = -errno;
+    else if (!parseSysfsInt(buf, res, var))
+        res = -EINVAL;
+    else
+        res = 0;
+    close(fd);
+    return res;
 }
 
 int write_sysfs_int(char *filename, int var)
 {
-    int res=0;
-    FILE  *sysfsfp;
+    char buf[12];
+    int res, fd, len;
 
-    sysfsfp = fopen(filename, "w");
-    if (sysfsfp!=NULL) {
-        fprintf(sysfsfp, "%d\n", var);
-        fclose(sysfsfp);
-    } else {
+    fd = open(filename, O_WRONLY);
+    if (fd < 0) {
         res = errno;
         ALOGE("HAL:ERR open file %s to write with error %d", filename, res);
+        return -res;
     }
-    return -res;
+    len = formatSysfsInt(buf, var);
+    res = pwrite(fd, buf, len, 0) < 0 ? -errno : 0;
+    close(fd);
+    return res;
 }
 
 int write_sysfs_longlong(char *filename, int64_t var)
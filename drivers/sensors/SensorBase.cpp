@@ -25,6 +25,8 @@
 #include <linux/input.h>
 
 #include "SensorBase.h"
+#include "SensorUtil.h"
+#include "input_devices.h"
 
 /*****************************************************************************/
 
@@ -95,45 +97,14 @@ int64_t SensorBase::getTimestamp()
 
 int SensorBase::openInput(const char *inputName)
 {
-    int fd = -1;
-    const char *dirname = "/dev/input";
-    char devname[PATH_MAX];
-    char *filename;
-    DIR *dir;
-    struct dirent *de;
-    dir = opendir(dirname);
-    if(dir == NULL)
-        return -1;
-    strcpy(devname, dirname);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
-    while((de = readdir(dir))) {
-        if(de->d_name[0] == '.' &&
-                (de->d_name[1] == '\0' ||
-                        (de->d_name[1] == '.' && de->d_name[2] == '\0')))
-            continue;
-        strcpy(filename, de->d_name);
-        fd = open(devname, O_RDONLY);
-        ALOGV_IF(EXTRA_VERBOSE, "path open %s", devname);
-        ALOGI("path open %s", devname);
-        if (fd >= 0) {
-            char name[80];
-            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-                name[0] = '\0';
-            }
-            ALOGV_IF(EXTRA_VERBOSE, "name read %s", name);
-            if (!strcmp(name, inputName)) {
-                strcpy(input_name, filename);
-                break;
-            } else {
-                close(fd);
-                fd = -1;
-            }
-        }
+    struct input_device dev;
+    int fd;
+
+    fd = input_device_open(inputName, O_RDONLY);
+    if (fd >= 0 && !input_device_find(inputName, &dev)) {
+        snprintf(input_name, sizeof(input_name), "event%d", dev.event);
     }
-    closedir(dir);
-    ALOGE_IF(fd < 0, "couldn't find '%s' input device", inputName);
-    return fd;
+    return fd < 0 ? -1 : fd;
 }
 
 int SensorBase::enable(int32_t handle, int enabled)
@@ -78,6 +78,8 @@ public:
     virtual int setDelay(int32_t handle, int64_t ns);
     virtual int enable(int32_t handle, int enabled);
     virtual int64_t now_ns() { return 0;};
+    /* period in ns a driver without fd wants to be read at, -1 if none */
+    virtual int64_t getPollDelay() const { return -1; }
 };
 
 /*****************************************************************************/
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <hardware/sensors.h>
+
+#include "SensorEventRing.h"
+
+/*****************************************************************************/
+
+SensorEventRing::SensorEventRing(size_t size)
+    : mBuffer(new sensors_event_t[size]),
+      mSize(size),
+      mHead(0),
+      mCount(0)
+{
+}
+
+SensorEventRing::~SensorEventRing()
+{
+    delete [] mBuffer;
+}
+
+int SensorEventRing::push(sensors_event_t const& event)
+{
+    size_t tail = mHead + mCount;
+    size_t i, prev;
+
+    if (mCount < mSize) {
+        if (tail >= mSize)
+            tail -= mSize;
+        mBuffer[tail] = event;
+        mCount++;
+        return 0;
+    }
+
+    /* full, find the oldest data event */
+    for (i = mHead; mBuffer[i].type == SENSOR_TYPE_META_DATA; ) {
+        if (++i >= mSize)
+            i = 0;
+        if (i == mHead)
+            return -ENOSPC;
+    }
+
+    /* move the meta events queued before it up by one slot over it */
+    while (i != mHead) {
+        prev = i ? i - 1 : mSize - 1;
+        mBuffer[i] = mBuffer[prev];
+        i = prev;
+    }
+
+    /* the old head slot is now free and is the tail */
+    mBuffer[mHead] = event;
+    if (++mHead >= mSize)
+        mHead = 0;
+    return -ENOBUFS;
+}
+
+int SensorEventRing::pop(sensors_event_t* data, int count)
+{
+    size_t n = mCount < (size_t)count ? mCount : (size_t)count;
+    size_t first = mSize - mHead;
+
+    if (!n)
+        return 0;
+
+    /* at most two contiguous chunks */
+    if (first > n)
+        first = n;
+    memcpy(data, mBuffer + mHead, first * sizeof(sensors_event_t));
+    if (n > first)
+        memcpy(data + first, mBuffer, (n - first) * sizeof(sensors_event_t));
+
+    mHead += n;
+    if (mHead >= mSize)
+        mHead -= mSize;
+    mCount -= n;
+    return n;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_EVENT_RING_H
+#define ANDROID_SENSOR_EVENT_RING_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+struct sensors_event_t;
+
+/*
+ * Fixed size FIFO of sensors_event_t used to hold batched events in the
+ * HAL until their report latency expires.  When full, the oldest data
+ * event is dropped; meta events (flush complete) are never evicted so that
+ * each flush() is answered.  Not thread safe, callers serialize access.
+ */
+class SensorEventRing
+{
+    sensors_event_t* const mBuffer;
+    const size_t mSize;
+    size_t mHead;
+    size_t mCount;
+
+public:
+    SensorEventRing(size_t size);
+    ~SensorEventRing();
+
+    /*
+     * returns 0, -ENOBUFS if the oldest data event was dropped to make room
+     * or -ENOSPC if the ring only holds meta events and event was not queued
+     */
+    int push(sensors_event_t const& event);
+    int pop(sensors_event_t* data, int count);
+    void clear() { mHead = 0; mCount = 0; }
+
+    size_t count() const { return mCount; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mCount == 0; }
+    bool full() const { return mCount == mSize; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_EVENT_RING_H
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <cutils/log.h>
+#include <hardware/sensors.h>
+
+#include "SensorPollLoop.h"
+
+/*****************************************************************************/
+
+SensorPollLoop::SensorPollLoop()
+    : mThreaded(false),
+      mNotifyFd(-1),
+      mRingSize(0),
+      mNumReaders(0),
+      mDeliver(NULL),
+      mQueue(NULL),
+      mTimeout(NULL),
+      mBatchCookie(NULL)
+{
+}
+
+SensorPollLoop::~SensorPollLoop()
+{
+    int i;
+
+    stopReaders();
+    for (i = 0; i < mNumReaders; i++)
+        delete mReaders[i];
+    if (mNotifyFd >= 0)
+        close(mNotifyFd);
+}
+
+int SensorPollLoop::setThreaded(size_t ringSize)
+{
+    int id;
+
+    if (mThreaded)
+        return 0;
+
+    mNotifyFd = eventfd(0, EFD_NONBLOCK);
+    if (mNotifyFd < 0) {
+        ALOGE("%s eventfd failed (%s)", __func__, strerror(errno));
+        return -errno;
+    }
+    id = mMux.add(mNotifyFd, drainReaders, this);
+    if (id < 0) {
+        close(mNotifyFd);
+        mNotifyFd = -1;
+        return id;
+    }
+
+    mRingSize = ringSize;
+    mThreaded = true;
+    return 0;
+}
+
+SensorPollMux *SensorPollLoop::readerMux(SensorPollMux *shareWith)
+{
+    char name[16];
+
+    if (!mThreaded)
+        return &mMux;
+    if (shareWith)
+        return shareWith;
+    if (mNumReaders >= MAX_READERS) {
+        ALOGE("%s too many reader threads, reading inline", __func__);
+        return &mMux;
+    }
+
+    snprintf(name, sizeof(name), "sensors-rd%d", mNumReaders);
+    mReaders[mNumReaders] = new SensorReaderThread(name, mRingSize,
+                                                   mNotifyFd);
+    return mReaders[mNumReaders++]->mux();
+}
+
+int SensorPollLoop::startReaders()
+{
+    int err = 0;
+    int i;
+
+    for (i = 0; i < mNumReaders; i++) {
+        if (mReaders[i]->start())
+            err = -EAGAIN;
+    }
+    return err;
+}
+
+void SensorPollLoop::stopReaders()
+{
+    int i;
+
+    for (i = 0; i < mNumReaders; i++)
+        mReaders[i]->stop();
+}
+
+void SensorPollLoop::setBatching(batch_cb_t deliver, batch_cb_t queue,
+                                 timeout_cb_t timeout, void *cookie)
+{
+    mDeliver = deliver;
+    mQueue = queue;
+    mTimeout = timeout;
+    mBatchCookie = cookie;
+}
+
+int SensorPollLoop::drainReaders(void *cookie, sensors_event_t *data,
+                                 int count)
+{
+    return ((SensorPollLoop *)cookie)->drainReaders(data, count);
+}
+
+/*
+ * Merge the reader rings into data, oldest timestamp first. Each ring is
+ * already in order, so this only has to compare the heads.
+ */
+int SensorPollLoop::drainReaders(sensors_event_t *data, int count)
+{
+    uint64_t value;
+    int nb = 0;
+    int i;
+
+    /* reset before draining, a later push will signal again */
+    read(mNotifyFd, &value, sizeof(value));
+
+    while (nb < count) {
+        SensorSpscRing *oldest = NULL;
+        sensors_event_t const *first = NULL;
+
+        for (i = 0; i < mNumReaders; i++) {
+            sensors_event_t const *event = mReaders[i]->ring()->peek();
+
+            if (event && (!first || event->timestamp < first->timestamp)) {
+                first = event;
+                oldest = mReaders[i]->ring();
+            }
+        }
+        if (!first)
+            break;
+
+        data[nb++] = *first;
+        oldest->pop();
+    }
+
+    return nb;
+}
+
+int SensorPollLoop::poll(sensors_event_t *data, int count)
+{
+    int nb;
+    int nbEvents = 0;
+    int n = 0;
+
+    do {
+        // batches that are due go first so that each sensor's events
+        // stay in order
+        if (mDeliver) {
+            nb = mDeliver(mBatchCookie, data, count);
+            count -= nb;
+            nbEvents += nb;
+            data += nb;
+        }
+
+        nb = mMux.dispatch(data, count);
+        if (nb > 0) {
+            if (mQueue)
+                nb = mQueue(mBatchCookie, data, nb);
+            count -= nb;
+            nbEvents += nb;
+            data += nb;
+        }
+
+        if (count) {
+            // we still have some room, so try to see if we can get
+            // some events immediately or block until an fd is readable,
+            // a polled driver or a batch is due if we don't have
+            // anything to return
+            n = mMux.wait(nbEvents ? 0 :
+                          mTimeout ? mTimeout(mBatchCookie) : -1);
+            if (n < 0) {
+                if (n == -EINTR)
+                    break;
+                else
+                    return n;
+            }
+        }
+        // if we have events and space, go read them
+    } while ((n || !nbEvents) && count);
+
+    return nbEvents;
+}
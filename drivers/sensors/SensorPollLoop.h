@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_POLL_LOOP_H
+#define ANDROID_SENSOR_POLL_LOOP_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorPollMux.h"
+#include "SensorReaderThread.h"
+
+/*****************************************************************************/
+
+struct sensors_event_t;
+
+/*
+ * The poll() loop of the sensors HAL, shared with sensors_bench so the
+ * benchmark runs the code that ships.
+ *
+ * Inline, drivers register with mux() and are read on the poll thread.
+ * Threaded (setThreaded()), readerMux() hands each driver the mux of a
+ * SensorReaderThread; the poll thread then only watches the eventfd the
+ * readers signal and merges their rings oldest first.
+ *
+ * The optional batching callbacks let the HAL divert events into its batch
+ * rings: deliver() returns batches that are due, queue() keeps back what
+ * should be batched and returns how many of the events remain in data,
+ * timeout() is the poll timeout in ms until the next batch deadline.
+ */
+class SensorPollLoop
+{
+public:
+    typedef int (*batch_cb_t)(void *cookie, sensors_event_t *data, int count);
+    typedef int (*timeout_cb_t)(void *cookie);
+
+    enum {
+        MAX_READERS = 8,
+    };
+
+    SensorPollLoop();
+    ~SensorPollLoop();
+
+    /* read drivers on their own threads, rings of ringSize events */
+    int setThreaded(size_t ringSize);
+    bool threaded() const { return mThreaded; }
+
+    SensorPollMux *mux() { return &mMux; }
+    /* mux a new driver registers with: mux(), or a new reader's when
+     * threaded; drivers sharing state pass the mux they must share */
+    SensorPollMux *readerMux(SensorPollMux *shareWith = NULL);
+    int startReaders();
+    /* readers must be stopped before their drivers go away */
+    void stopReaders();
+
+    void setBatching(batch_cb_t deliver, batch_cb_t queue,
+                     timeout_cb_t timeout, void *cookie);
+
+    /* the body of sensors_poll_device_t::poll() */
+    int poll(sensors_event_t *data, int count);
+    int wake() { return mMux.wake(); }
+
+private:
+    SensorPollMux mMux;
+
+    bool mThreaded;
+    int mNotifyFd;
+    size_t mRingSize;
+    SensorReaderThread *mReaders[MAX_READERS];
+    int mNumReaders;
+
+    batch_cb_t mDeliver;
+    batch_cb_t mQueue;
+    timeout_cb_t mTimeout;
+    void *mBatchCookie;
+
+    static int drainReaders(void *cookie, sensors_event_t *data, int count);
+    int drainReaders(sensors_event_t *data, int count);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_POLL_LOOP_H
@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <cutils/log.h>
+#include <hardware/sensors.h>
+
+#include "SensorBase.h"
+#include "SensorPollMux.h"
+
+/*****************************************************************************/
+
+static int64_t monotonicNs()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+SensorPollMux::SensorPollMux()
+    : mReading(NULL),
+      mEpollFd(-1),
+      mTimerFd(-1),
+      mTimerDue(0),
+      mNumReady(0),
+      mHeapSize(0)
+{
+    struct epoll_event ev;
+    int result;
+
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_cond_init(&mReadDone, NULL);
+    memset(mEntries, 0, sizeof(mEntries));
+    mWakeFds[0] = -1;
+    mWakeFds[1] = -1;
+
+    mEpollFd = epoll_create(MAX_ENTRIES + 2);
+    if (mEpollFd < 0) {
+        ALOGE("error creating epoll fd (%s)", strerror(errno));
+        return;
+    }
+
+    result = pipe(mWakeFds);
+    if (result < 0) {
+        ALOGE("error creating wake pipe (%s)", strerror(errno));
+    } else {
+        fcntl(mWakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(mWakeFds[1], F_SETFL, O_NONBLOCK);
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = WAKE_TAG;
+        result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFds[0], &ev);
+        ALOGE_IF(result < 0, "error adding wake pipe to epoll (%s)",
+                 strerror(errno));
+    }
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (mTimerFd < 0) {
+        ALOGE("error creating poll timer (%s)", strerror(errno));
+    } else {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = TIMER_TAG;
+        result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, &ev);
+        ALOGE_IF(result < 0, "error adding poll timer to epoll (%s)",
+                 strerror(errno));
+    }
+}
+
+SensorPollMux::~SensorPollMux()
+{
+    if (mEpollFd >= 0)
+        close(mEpollFd);
+    if (mWakeFds[0] >= 0)
+        close(mWakeFds[0]);
+    if (mWakeFds[1] >= 0)
+        close(mWakeFds[1]);
+    if (mTimerFd >= 0)
+        close(mTimerFd);
+    pthread_cond_destroy(&mReadDone);
+    pthread_mutex_destroy(&mMutex);
+}
+
+int SensorPollMux::allocEntry()
+{
+    for (int i = 0; i < MAX_ENTRIES; i++) {
+        if (!mEntries[i].used) {
+            memset(&mEntries[i], 0, sizeof(mEntries[i]));
+            mEntries[i].fd = -1;
+            mEntries[i].period = -1;
+            mEntries[i].heapIndex = -1;
+            mEntries[i].used = true;
+            return i;
+        }
+    }
+    return -ENOSPC;
+}
+
+void SensorPollMux::queue(entry *e)
+{
+    if (!e->ready) {
+        e->ready = true;
+        mReady[mNumReady++] = e;
+    }
+}
+
+/*
+ * Deadline heap of the polled entries, mHeap[0] is due first.
+ */
+void SensorPollMux::heapSwap(int a, int b)
+{
+    entry *tmp = mHeap[a];
+
+    mHeap[a] = mHeap[b];
+    mHeap[b] = tmp;
+    mHeap[a]->heapIndex = a;
+    mHeap[b]->heapIndex = b;
+}
+
+void SensorPollMux::heapUp(int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (mHeap[parent]->due <= mHeap[i]->due)
+            break;
+        heapSwap(i, parent);
+        i = parent;
+    }
+}
+
+void SensorPollMux::heapDown(int i)
+{
+    while (1) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int min = i;
+
+        if (left < mHeapSize && mHeap[left]->due < mHeap[min]->due)
+            min = left;
+        if (right < mHeapSize && mHeap[right]->due < mHeap[min]->due)
+            min = right;
+        if (min == i)
+            break;
+        heapSwap(i, min);
+        i = min;
+    }
+}
+
+void SensorPollMux::heapInsert(entry *e)
+{
+    if (e->heapIndex >= 0)
+        return;
+
+    e->heapIndex = mHeapSize;
+    mHeap[mHeapSize++] = e;
+    heapUp(e->heapIndex);
+}
+
+void SensorPollMux::heapRemove(entry *e)
+{
+    int i = e->heapIndex;
+
+    if (i < 0)
+        return;
+
+    e->heapIndex = -1;
+    mHeapSize--;
+    if (i == mHeapSize)
+        return;
+
+    mHeap[i] = mHeap[mHeapSize];
+    mHeap[i]->heapIndex = i;
+    heapUp(i);
+    heapDown(mHeap[i]->heapIndex);
+}
+
+/* arm the timer for the earliest deadline, or disarm it */
+void SensorPollMux::armTimer()
+{
+    struct itimerspec its;
+    int64_t due = mHeapSize ? mHeap[0]->due : 0;
+
+    if (mTimerFd < 0 || due == mTimerDue)
+        return;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = due / 1000000000LL;
+    its.it_value.tv_nsec = due % 1000000000LL;
+    /* a zero it_value disarms, make sure an overdue entry still fires */
+    if (mHeapSize && !its.it_value.tv_sec && !its.it_value.tv_nsec)
+        its.it_value.tv_nsec = 1;
+
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        ALOGE("error arming poll timer (%s)", strerror(errno));
+        return;
+    }
+    mTimerDue = due;
+}
+
+/* queue every polled entry whose deadline has passed */
+void SensorPollMux::expireTimer()
+{
+    uint64_t expirations;
+    int64_t now = monotonicNs();
+
+    read(mTimerFd, &expirations, sizeof(expirations));
+    mTimerDue = 0;
+
+    while (mHeapSize && mHeap[0]->due <= now) {
+        entry *e = mHeap[0];
+
+        heapRemove(e);
+        queue(e);
+    }
+    armTimer();
+}
+
+int SensorPollMux::add(int fd, read_cb_t read, void *cookie)
+{
+    struct epoll_event ev;
+    int flags;
+    int id;
+
+    if (fd < 0 || read == NULL)
+        return -EINVAL;
+
+    flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    pthread_mutex_lock(&mMutex);
+    id = allocEntry();
+    if (id >= 0) {
+        mEntries[id].fd = fd;
+        mEntries[id].read = read;
+        mEntries[id].cookie = cookie;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = id;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ALOGE("error adding fd %d to epoll (%s)", fd, strerror(errno));
+            mEntries[id].used = false;
+            id = -errno;
+        }
+    }
+    pthread_mutex_unlock(&mMutex);
+    return id;
+}
+
+int SensorPollMux::addPolled(read_cb_t read, void *cookie)
+{
+    int id;
+
+    if (read == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMutex);
+    id = allocEntry();
+    if (id >= 0) {
+        mEntries[id].read = read;
+        mEntries[id].cookie = cookie;
+        mEntries[id].polled = true;
+    }
+    pthread_mutex_unlock(&mMutex);
+    return id;
+}
+
+int SensorPollMux::remove(int id)
+{
+    entry *e;
+    int i, j;
+
+    pthread_mutex_lock(&mMutex);
+    if (id < 0 || id >= MAX_ENTRIES || !mEntries[id].used) {
+        pthread_mutex_unlock(&mMutex);
+        return -EINVAL;
+    }
+
+    e = &mEntries[id];
+    /* the caller may free the cookie once we return, unless it is the read */
+    while (mReading == e && !pthread_equal(mReader, pthread_self()))
+        pthread_cond_wait(&mReadDone, &mMutex);
+    if (!e->used) {
+        pthread_mutex_unlock(&mMutex);
+        return -EINVAL;
+    }
+    if (e->fd >= 0)
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, e->fd, NULL);
+
+    for (i = 0, j = 0; i < mNumReady; i++) {
+        if (mReady[i] != e)
+            mReady[j++] = mReady[i];
+    }
+    mNumReady = j;
+    heapRemove(e);
+    armTimer();
+
+    e->used = false;
+    pthread_mutex_unlock(&mMutex);
+    return 0;
+}
+
+int SensorPollMux::kick(int id)
+{
+    if (id < 0 || id >= MAX_ENTRIES)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMutex);
+    if (mEntries[id].used) {
+        heapRemove(&mEntries[id]);
+        queue(&mEntries[id]);
+    }
+    pthread_mutex_unlock(&mMutex);
+    return 0;
+}
+
+int SensorPollMux::setPeriod(int id, int64_t ns)
+{
+    entry *e;
+    int64_t due;
+
+    if (id < 0 || id >= MAX_ENTRIES)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMutex);
+    e = &mEntries[id];
+    if (!e->used || !e->polled) {
+        pthread_mutex_unlock(&mMutex);
+        return -EINVAL;
+    }
+
+    /* a driver without a delay yet would keep the timer firing */
+    if (ns >= 0 && ns < MIN_POLL_PERIOD_NS)
+        ns = MIN_POLL_PERIOD_NS;
+    e->period = ns;
+    if (ns < 0) {
+        heapRemove(e);
+    } else if (!e->ready) {
+        /* a shorter period pulls the pending deadline in */
+        due = monotonicNs() + ns;
+        if (e->heapIndex < 0 || due < e->due) {
+            heapRemove(e);
+            e->due = due;
+            heapInsert(e);
+        }
+    }
+    armTimer();
+    pthread_mutex_unlock(&mMutex);
+    return 0;
+}
+
+int SensorPollMux::setPending(int id, pending_cb_t pending, void *cookie)
+{
+    if (id < 0 || id >= MAX_ENTRIES)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mMutex);
+    if (!mEntries[id].used) {
+        pthread_mutex_unlock(&mMutex);
+        return -EINVAL;
+    }
+    mEntries[id].pending = pending;
+    mEntries[id].pendingCookie = cookie;
+    pthread_mutex_unlock(&mMutex);
+    return 0;
+}
+
+/*
+ * Wait up to timeout ms (-1 forever) for registered fds to become readable
+ * or polled entries to become due and queue them for dispatch.  Returns the
+ * number of ready entries, not counting the wake pipe, or a negative errno.
+ */
+int SensorPollMux::wait(int timeout)
+{
+    struct epoll_event events[MAX_ENTRIES + 2];
+    int i, n;
+
+    /* entries left over from the last dispatch are ready right away */
+    pthread_mutex_lock(&mMutex);
+    if (mNumReady)
+        timeout = 0;
+    pthread_mutex_unlock(&mMutex);
+
+    n = epoll_wait(mEpollFd, events, MAX_ENTRIES + 2, timeout);
+    if (n < 0) {
+        ALOGE("epoll_wait() failed (%s)", strerror(errno));
+        return -errno;
+    }
+
+    pthread_mutex_lock(&mMutex);
+    for (i = 0; i < n; i++) {
+        uint32_t tag = events[i].data.u32;
+
+        if (tag == WAKE_TAG) {
+            char msg[16];
+            int result;
+
+            do {
+                result = read(mWakeFds[0], msg, sizeof(msg));
+            } while (result == sizeof(msg));
+            ALOGE_IF(result < 0 && errno != EAGAIN,
+                     "error reading from wake pipe (%s)", strerror(errno));
+        } else if (tag == TIMER_TAG) {
+            expireTimer();
+        } else if (tag < MAX_ENTRIES && mEntries[tag].used) {
+            queue(&mEntries[tag]);
+        }
+    }
+    n = mNumReady;
+    pthread_mutex_unlock(&mMutex);
+
+    return n;
+}
+
+/*
+ * Read the queued entries into data.  An entry that fills the remaining
+ * space stays queued since it may still hold buffered events, as does one
+ * whose pending callback reports events it left behind; a polled entry is
+ * rescheduled one period after its read completed.
+ *
+ * The ready set is taken under mMutex but the callbacks run without it, so
+ * activate/setDelay do not wait behind slow reads and a callback may call
+ * back into the mux.  Entries kicked meanwhile are queued for the next
+ * dispatch.
+ */
+int SensorPollMux::dispatch(sensors_event_t *data, int count)
+{
+    entry *ready[MAX_ENTRIES];
+    int nbEvents = 0;
+    int numReady;
+    int i, nb;
+    bool again;
+
+    pthread_mutex_lock(&mMutex);
+    numReady = mNumReady;
+    for (i = 0; i < numReady; i++) {
+        ready[i] = mReady[i];
+        ready[i]->ready = false;
+    }
+    mNumReady = 0;
+    mReader = pthread_self();
+
+    for (i = 0; i < numReady; i++) {
+        entry *e = ready[i];
+        read_cb_t read = e->read;
+        void *cookie = e->cookie;
+        pending_cb_t pending = e->pending;
+        void *pendingCookie = e->pendingCookie;
+
+        if (!e->used)
+            continue;
+        if (!count) {
+            queue(e);
+            continue;
+        }
+
+        mReading = e;
+        pthread_mutex_unlock(&mMutex);
+        nb = read(cookie, data, count);
+        if (nb > 0) {
+            count -= nb;
+            nbEvents += nb;
+            data += nb;
+        }
+        again = (nb > 0 && !count) || (pending && pending(pendingCookie));
+        pthread_mutex_lock(&mMutex);
+        mReading = NULL;
+        pthread_cond_broadcast(&mReadDone);
+
+        if (!e->used)
+            continue;
+        if (again) {
+            queue(e);
+            continue;
+        }
+        if (e->polled && e->period >= 0 && !e->ready) {
+            e->due = monotonicNs() + e->period;
+            heapInsert(e);
+        }
+    }
+    armTimer();
+    pthread_mutex_unlock(&mMutex);
+
+    return nbEvents;
+}
+
+int SensorPollMux::wake()
+{
+    const char wakeMessage(WAKE_MESSAGE);
+    int result = write(mWakeFds[1], &wakeMessage, 1);
+
+    /* a full pipe already guarantees a wakeup */
+    if (result < 0 && errno != EAGAIN) {
+        ALOGE("error sending wake message (%s)", strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+int SensorPollMux::readSensor(void *cookie, sensors_event_t *data, int count)
+{
+    return ((SensorBase *)cookie)->readEvents(data, count);
+}
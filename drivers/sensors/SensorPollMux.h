@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_POLL_MUX_H
+#define ANDROID_SENSOR_POLL_MUX_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+struct sensors_event_t;
+
+/*
+ * epoll backed event multiplexer for the sensors HAL poll loop.
+ *
+ * Drivers register the fd they want to be woken up on together with a read
+ * callback and an opaque cookie.  wait() only queues the entries epoll
+ * reported as readable and dispatch() only calls back the queued ones, so a
+ * wakeup costs O(ready) instead of O(drivers).
+ *
+ * Drivers without an fd (sysfs polled) are registered as polled entries
+ * with a period.  They are kept in a min-heap keyed on their next due time
+ * and a single timerfd is armed for the earliest one, so each polled driver
+ * is only read when its own deadline expires.
+ *
+ * wait() and dispatch() run on the poll thread, the other calls may come
+ * from activate/setDelay on any thread and are serialized with mMutex.
+ * remove() does not return while the poll thread is still reading the
+ * entry, so its cookie can be freed right after.
+ */
+class SensorPollMux
+{
+public:
+    typedef int (*read_cb_t)(void *cookie, sensors_event_t *data, int count);
+    typedef bool (*pending_cb_t)(void *cookie);
+
+    enum {
+        MAX_ENTRIES = 16,
+    };
+
+    /* shortest polling period, in ns */
+    static const int64_t MIN_POLL_PERIOD_NS = 1000000LL;
+
+    SensorPollMux();
+    ~SensorPollMux();
+
+    /* return an entry id >= 0 or a negative errno */
+    int add(int fd, read_cb_t read, void *cookie);
+    int addPolled(read_cb_t read, void *cookie);
+    int remove(int id);
+    /* queue an entry for the next dispatch, e.g. after enable */
+    int kick(int id);
+    /* polling period of a polled entry in ns, < 0 stops polling it;
+     * periods under MIN_POLL_PERIOD_NS are raised to it */
+    int setPeriod(int id, int64_t ns);
+    /* keep an entry queued after dispatch while pending(cookie) is true */
+    int setPending(int id, pending_cb_t pending, void *cookie);
+
+    int wait(int timeout);
+    int dispatch(sensors_event_t *data, int count);
+    int wake();
+
+    /* read callback for plain SensorBase drivers, cookie is the SensorBase */
+    static int readSensor(void *cookie, sensors_event_t *data, int count);
+
+private:
+    struct entry {
+        int fd;
+        read_cb_t read;
+        void *cookie;
+        pending_cb_t pending;
+        void *pendingCookie;
+        bool used;
+        bool ready;
+        bool polled;
+        int64_t period;
+        int64_t due;
+        int heapIndex;          // -1 when not scheduled
+    };
+
+    /* epoll data for the internal fds, entries use their id */
+    enum {
+        WAKE_TAG = MAX_ENTRIES,
+        TIMER_TAG,
+    };
+
+    static const char WAKE_MESSAGE = 'W';
+
+    pthread_mutex_t mMutex;
+    pthread_cond_t mReadDone;   // signalled when mReading is cleared
+    entry *mReading;            // entry whose read() is running, or NULL
+    pthread_t mReader;          // thread running dispatch()
+    int mEpollFd;
+    int mWakeFds[2];
+    int mTimerFd;
+    int64_t mTimerDue;
+    entry mEntries[MAX_ENTRIES];
+    entry *mReady[MAX_ENTRIES];
+    int mNumReady;
+    entry *mHeap[MAX_ENTRIES];
+    int mHeapSize;
+
+    int allocEntry();
+    void queue(entry *e);
+    void heapSwap(int a, int b);
+    void heapUp(int i);
+    void heapDown(int i);
+    void heapInsert(entry *e);
+    void heapRemove(entry *e);
+    void armTimer();
+    void expireTimer();
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_POLL_MUX_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <hardware/sensors.h>
+
+#include "SensorReaderThread.h"
+
+/*****************************************************************************/
+
+SensorReaderThread::SensorReaderThread(const char *name, size_t ringSize,
+                                       int notifyFd)
+    : mRing(ringSize),
+      mNotifyFd(notifyFd),
+      mStarted(false),
+      mStop(false)
+{
+    strncpy(mName, name, sizeof(mName) - 1);
+    mName[sizeof(mName) - 1] = '\0';
+}
+
+SensorReaderThread::~SensorReaderThread()
+{
+    stop();
+}
+
+int SensorReaderThread::start()
+{
+    int err;
+
+    if (mStarted)
+        return 0;
+
+    mStop = false;
+    err = pthread_create(&mThread, NULL, threadLoop, this);
+    if (err) {
+        ALOGE("%s: error creating reader thread %s (%s)",
+              __func__, mName, strerror(err));
+        return -err;
+    }
+    pthread_setname_np(mThread, mName);
+    mStarted = true;
+    return 0;
+}
+
+void SensorReaderThread::stop()
+{
+    if (!mStarted)
+        return;
+
+    mStop = true;
+    mMux.wake();
+    pthread_join(mThread, NULL);
+    mStarted = false;
+}
+
+void *SensorReaderThread::threadLoop(void *arg)
+{
+    ((SensorReaderThread *)arg)->loop();
+    return NULL;
+}
+
+void SensorReaderThread::loop()
+{
+    sensors_event_t buffer[readBufferSize];
+    uint64_t one = 1;
+    uint32_t dropped = 0;
+    int i, n;
+
+    while (!mStop) {
+        n = mMux.wait(-1);
+        if (n < 0 && n != -EINTR) {
+            ALOGE("%s: %s giving up (%s)", __func__, mName, strerror(-n));
+            break;
+        }
+
+        n = mMux.dispatch(buffer, readBufferSize);
+        if (n <= 0)
+            continue;
+
+        for (i = 0; i < n; i++)
+            mRing.push(buffer[i]);
+        if (write(mNotifyFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            ALOGE("%s: %s notify failed (%s)", __func__, mName,
+                  strerror(errno));
+
+        if (mRing.dropped() != dropped) {
+            dropped = mRing.dropped();
+            ALOGW("%s: %s ring full, %u events dropped so far",
+                  __func__, mName, dropped);
+        }
+    }
+}
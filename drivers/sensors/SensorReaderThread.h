@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_READER_THREAD_H
+#define ANDROID_SENSOR_READER_THREAD_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "SensorPollMux.h"
+#include "SensorSpscRing.h"
+
+/*****************************************************************************/
+
+/*
+ * Reader thread for the threaded mode of the sensors HAL.
+ *
+ * Drivers are registered with the thread's own SensorPollMux, exactly as
+ * they would be with the HAL's, so fd and sysfs polled drivers both work.
+ * The thread dispatches them and pushes the events into a SensorSpscRing,
+ * then bumps the eventfd shared by all readers so the poll thread knows
+ * there is something to drain.  Drivers that share state (e.g. the MPL and
+ * its compass) must be registered with the same thread.
+ */
+class SensorReaderThread
+{
+public:
+    SensorReaderThread(const char *name, size_t ringSize, int notifyFd);
+    ~SensorReaderThread();
+
+    SensorPollMux *mux() { return &mMux; }
+    SensorSpscRing *ring() { return &mRing; }
+
+    int start();
+    void stop();
+
+private:
+    enum {
+        readBufferSize = 16,
+    };
+
+    char mName[16];
+    SensorPollMux mMux;
+    SensorSpscRing mRing;
+    int mNotifyFd;
+    pthread_t mThread;
+    bool mStarted;
+    volatile bool mStop;
+
+    static void *threadLoop(void *arg);
+    void loop();
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_READER_THREAD_H
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hardware/sensors.h>
+
+#include "SensorSpscRing.h"
+
+/*****************************************************************************/
+
+SensorSpscRing::SensorSpscRing(size_t size)
+    : mHead(0),
+      mTail(0),
+      mDropped(0)
+{
+    uint32_t n = 1;
+
+    while (n < size)
+        n <<= 1;
+    mBuffer = new sensors_event_t[n];
+    mMask = n - 1;
+}
+
+SensorSpscRing::~SensorSpscRing()
+{
+    delete [] mBuffer;
+}
+
+bool SensorSpscRing::push(sensors_event_t const& event)
+{
+    uint32_t head = mHead;
+    uint32_t tail = __atomic_load_n(&mTail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > mMask) {
+        __atomic_add_fetch(&mDropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    mBuffer[head & mMask] = event;
+    __atomic_store_n(&mHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t SensorSpscRing::dropped() const
+{
+    return __atomic_load_n(&mDropped, __ATOMIC_RELAXED);
+}
+
+sensors_event_t const* SensorSpscRing::peek() const
+{
+    uint32_t tail = mTail;
+    uint32_t head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+        return NULL;
+    return &mBuffer[tail & mMask];
+}
+
+void SensorSpscRing::pop()
+{
+    __atomic_store_n(&mTail, mTail + 1, __ATOMIC_RELEASE);
+}
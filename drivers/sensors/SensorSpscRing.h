@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SPSC_RING_H
+#define ANDROID_SENSOR_SPSC_RING_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+struct sensors_event_t;
+
+/*
+ * Lock-free single producer / single consumer FIFO of sensors_event_t.
+ *
+ * One thread may push() while another one peek()s and pop()s without any
+ * lock: the producer only writes mHead, the consumer only writes mTail and
+ * each publishes its index with release semantics after touching the slot.
+ * The size is rounded up to a power of two.  When full, push() drops the
+ * new event rather than the oldest one since only the consumer may move
+ * mTail.
+ */
+class SensorSpscRing
+{
+    sensors_event_t* mBuffer;
+    uint32_t mMask;
+    uint32_t mHead;             // next slot to write, producer owned
+    uint32_t mTail;             // next slot to read, consumer owned
+    uint32_t mDropped;
+
+public:
+    SensorSpscRing(size_t size);
+    ~SensorSpscRing();
+
+    /* producer side */
+    bool push(sensors_event_t const& event);
+    uint32_t dropped() const;
+
+    /* consumer side, peek() returns NULL when empty */
+    sensors_event_t const* peek() const;
+    void pop();
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_SPSC_RING_H
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <hardware/sensors.h>
+
+#include "SensorStats.h"
+
+/*****************************************************************************/
+
+static int64_t monotonicNs()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+SensorStats::SensorStats()
+{
+    memset(mRead, 0, sizeof(mRead));
+    memset(mReturn, 0, sizeof(mReturn));
+    memset(mCost, 0, sizeof(mCost));
+    mStart = monotonicNs();
+}
+
+void SensorStats::updateMax(uint64_t *max, uint64_t value)
+{
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void SensorStats::add(histogram *h, int64_t ageNs)
+{
+    uint64_t us;
+    int i = 0;
+
+    if (ageNs < 0) {
+        __atomic_add_fetch(&h->early, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    us = ageNs / 1000;
+    while (i < numBuckets - 1 && (us >> (i + 1)))
+        i++;
+
+    __atomic_add_fetch(&h->bucket[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sumUs, us, __ATOMIC_RELAXED);
+    updateMax(&h->maxUs, us);
+}
+
+void SensorStats::recordRead(int driver, int64_t start, int64_t end,
+                             sensors_event_t const* data, int count)
+{
+    readCost *c;
+    uint64_t ns = end - start;
+    int i;
+
+    if (driver >= 0 && driver < maxDrivers) {
+        c = &mCost[driver];
+        __atomic_add_fetch(&c->calls, 1, __ATOMIC_RELAXED);
+        if (count <= 0)
+            __atomic_add_fetch(&c->empty, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&c->events, count, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&c->sumNs, ns, __ATOMIC_RELAXED);
+        updateMax(&c->maxNs, ns);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (data[i].sensor >= 0 && data[i].sensor < maxHandles &&
+            data[i].type != SENSOR_TYPE_META_DATA)
+            add(&mRead[data[i].sensor], end - data[i].timestamp);
+    }
+}
+
+void SensorStats::recordReturn(int64_t now, sensors_event_t const* data,
+                               int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (data[i].type == SENSOR_TYPE_META_DATA)
+            continue;
+        if (data[i].sensor >= 0 && data[i].sensor < maxHandles)
+            add(&mReturn[data[i].sensor], now - data[i].timestamp);
+    }
+}
+
+/* upper bound in us of the bucket holding the pct-th percentile */
+uint64_t SensorStats::percentile(histogram const* h, uint64_t count,
+                                 unsigned pct)
+{
+    uint64_t target = (count * pct + 99) / 100;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < numBuckets; i++) {
+        seen += h->bucket[i];
+        if (seen >= target)
+            break;
+    }
+    return 2ULL << i;
+}
+
+void SensorStats::dumpHistogram(FILE *f, const char *what, int handle,
+                                histogram const* h)
+{
+    uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    int i;
+
+    if (!count && !h->early)
+        return;
+
+    fprintf(f, "handle %2d %-6s n=%llu avg=%lluus max=%lluus "
+            "p50<%lluus p90<%lluus p99<%lluus early=%u\n",
+            handle, what, (unsigned long long)count,
+            (unsigned long long)(count ? h->sumUs / count : 0),
+            (unsigned long long)h->maxUs,
+            (unsigned long long)percentile(h, count, 50),
+            (unsigned long long)percentile(h, count, 90),
+            (unsigned long long)percentile(h, count, 99), h->early);
+    fprintf(f, "         ");
+    for (i = 0; i < numBuckets; i++)
+        fprintf(f, " %u", h->bucket[i]);
+    fprintf(f, "\n");
+}
+
+int SensorStats::dump(const char *path) const
+{
+    char tmp[PATH_MAX];
+    FILE *f;
+    int i;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        ALOGE("%s: cannot open %s (%s)", __func__, tmp, strerror(errno));
+        return -errno;
+    }
+
+    fprintf(f, "sensors HAL stats over %llds, buckets are [2^i, 2^(i+1)) us\n",
+            (long long)((monotonicNs() - mStart) / 1000000000LL));
+
+    fprintf(f, "\nevent age when read by the driver / returned by poll\n");
+    for (i = 0; i < maxHandles; i++) {
+        dumpHistogram(f, "read", i, &mRead[i]);
+        dumpHistogram(f, "return", i, &mReturn[i]);
+    }
+
+    fprintf(f, "\ndriver read calls\n");
+    for (i = 0; i < maxDrivers; i++) {
+        readCost const* c = &mCost[i];
+
+        if (!c->calls)
+            continue;
+        fprintf(f, "driver %2d calls=%llu empty=%llu events=%llu "
+                "avg=%lluns max=%lluns\n", i,
+                (unsigned long long)c->calls, (unsigned long long)c->empty,
+                (unsigned long long)c->events,
+                (unsigned long long)(c->sumNs / c->calls),
+                (unsigned long long)c->maxNs);
+    }
+
+    if (fclose(f) || rename(tmp, path) < 0) {
+        ALOGE("%s: cannot write %s (%s)", __func__, path, strerror(errno));
+        unlink(tmp);
+        return -errno;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_STATS_H
+#define ANDROID_SENSOR_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+struct sensors_event_t;
+
+/*
+ * Latency and read cost statistics of the sensors HAL.
+ *
+ * For every handle, two histograms of the event age: when the driver read
+ * returned it and when pollEvents handed it to the framework.  The age is
+ * measured against the event timestamp, i.e. the kernel timestamp for
+ * input and MPL events, so it only makes sense for drivers that stamp in
+ * CLOCK_MONOTONIC.  For every driver, the number and duration of its read
+ * calls.
+ *
+ * Buckets are powers of two in us.  All counters are updated with relaxed
+ * atomics so reader threads and the poll thread never take a lock; a dump
+ * may see a sample counted in one field and not yet in another.
+ */
+class SensorStats
+{
+public:
+    enum {
+        numBuckets = 24,        // last one is >= 2^23 us (~8 s)
+        maxHandles = 32,
+        maxDrivers = 16,
+    };
+
+    SensorStats();
+
+    void recordRead(int driver, int64_t start, int64_t end,
+                    sensors_event_t const* data, int count);
+    void recordReturn(int64_t now, sensors_event_t const* data, int count);
+
+    /* write a text report to path, returns 0 or a negative errno */
+    int dump(const char *path) const;
+
+private:
+    struct histogram {
+        uint32_t bucket[numBuckets];
+        uint32_t early;         // timestamp in the future, other clock
+        uint64_t count;
+        uint64_t sumUs;
+        uint64_t maxUs;
+    };
+
+    struct readCost {
+        uint64_t calls;
+        uint64_t empty;         // calls that returned no event
+        uint64_t events;
+        uint64_t sumNs;
+        uint64_t maxNs;
+    };
+
+    histogram mRead[maxHandles];
+    histogram mReturn[maxHandles];
+    readCost mCost[maxDrivers];
+    int64_t mStart;
+
+    static void add(histogram *h, int64_t ageNs);
+    static void updateMax(uint64_t *max, uint64_t value);
+    static uint64_t percentile(histogram const* h, uint64_t count,
+                               unsigned pct);
+    static void dumpHistogram(FILE *f, const char *what, int handle,
+                              histogram const* h);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_STATS_H
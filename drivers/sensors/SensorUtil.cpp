@@ -17,15 +17,117 @@
  */
 
 #include "SensorUtil.h"
+#include "input_devices.h"
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static char sensorsRoot[PATH_MAX];
+
+void setSensorsRoot(const char *root)
+{
+    if (root == NULL)
+        root = "";
+    strncpy(sensorsRoot, root, sizeof(sensorsRoot) - 1);
+    sensorsRoot[sizeof(sensorsRoot) - 1] = '\0';
+    input_devices_set_root(sensorsRoot);
+}
+
+const char *sensorsPath(const char *path, char *buf, size_t size)
+{
+    if (!sensorsRoot[0])
+        return path;
+
+    snprintf(buf, size, "%s%s", sensorsRoot, path);
+    return buf;
+}
+
+int parseSysfsInt(const char *buf, size_t len, int *val)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    unsigned int v = 0;
+    bool neg = false;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n'))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    if (p == end || *p < '0' || *p > '9')
+        return 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+
+    *val = neg ? -v : v;
+    return 1;
+}
+
+int parseSysfsFloat(const char *buf, size_t len, float *val)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    double v = 0;
+    double scale = 1;
+    bool neg = false;
+    bool digits = false;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n'))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits = true)
+        v = v * 10 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits = true) {
+            scale /= 10;
+            v += (*p - '0') * scale;
+        }
+    }
+    if (!digits)
+        return 0;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exp;
+
+        if (parseSysfsInt(p + 1, end - p - 1, &exp)) {
+            for (; exp > 0; exp--)
+                v *= 10;
+            for (; exp < 0; exp++)
+                v /= 10;
+        }
+    }
+
+    *val = neg ? -v : v;
+    return 1;
+}
+
+int formatSysfsInt(char *buf, int val)
+{
+    char tmp[12];
+    unsigned int v = val < 0 ? -(unsigned int)val : val;
+    int n = 0;
+    int len = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (val < 0)
+        buf[len++] = '-';
+    while (n)
+        buf[len++] = tmp[--n];
+    return len;
+}
 
 int readIntFromFile(const char *path, unsigned int *val)
 {
-    char buffer[20] = {0};
+    char buffer[20];
     int data_fd;
     int err;
+    int v;
 
     /* The opening of the file handle is placed here
      * as work around that if it is opened in the constructor
@@ -40,22 +142,25 @@ int readIntFromFile(const char *path, unsigned int *val)
 
     if (err <= 0) return err;
 
-    *val = atoi(buffer);
+    if (!parseSysfsInt(buffer, err, &v))
+        return 0;
+    *val = v;
     return 1;
 }
 
 int writeIntToFile(const char *path, unsigned int val)
 {
     int en_fd;
-    char buffer[16] = {0};
+    char buffer[12];
+    int len;
 
     en_fd = open(path, O_RDWR);
     if (en_fd < 0) {
         return en_fd;
     }
 
-    sprintf(buffer, "%d", val);
-    int err = write(en_fd, buffer, sizeof(buffer));
+    len = formatSysfsInt(buffer, val);
+    int err = write(en_fd, buffer, len);
     close(en_fd);
     if (err <= 0) {
         return err;
@@ -63,6 +168,22 @@ int writeIntToFile(const char *path, unsigned int val)
     return 1;
 }
 
+int writeStringToFile(const char *path, const char *str)
+{
+    int fd;
+    int err;
+
+    fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return fd;
+
+    err = write(fd, str, strlen(str));
+    close(fd);
+    if (err <= 0)
+        return err;
+    return 1;
+}
+
 int readStringFromFile(const char *path, char *str)
 {
     char buffer[128] = {0};
@@ -84,7 +205,7 @@ int readStringFromFile(const char *path, char *str)
 
 int readFloatFromFile(const char *path, float *fval)
 {
-    char buffer[32] = {0};
+    char buffer[32];
     int data_fd;
     int err;
 
@@ -97,6 +218,104 @@ int readFloatFromFile(const char *path, float *fval)
 
     if (err <= 0) return err;
 
-    *fval = atof(buffer);
+    return parseSysfsFloat(buffer, err, fval);
+}
+
+SysfsAttr::SysfsAttr(const char *path)
+    : mPath(path),
+      mFd(-1)
+{
+}
+
+SysfsAttr::~SysfsAttr()
+{
+    close();
+}
+
+void SysfsAttr::setPath(const char *path)
+{
+    close();
+    mPath = path;
+}
+
+void SysfsAttr::close()
+{
+    if (mFd >= 0)
+        ::close(mFd);
+    mFd = -1;
+}
+
+/* open on first use, read only and write only nodes refuse O_RDWR */
+int SysfsAttr::fd()
+{
+    if (mFd >= 0 || mPath == NULL)
+        return mFd;
+
+    mFd = open(mPath, O_RDWR);
+    if (mFd < 0)
+        mFd = open(mPath, O_RDONLY);
+    if (mFd < 0)
+        mFd = open(mPath, O_WRONLY);
+    return mFd;
+}
+
+int SysfsAttr::read(char *buf, size_t size)
+{
+    int n;
+
+    if (fd() < 0)
+        return 0;
+
+    n = pread(mFd, buf, size, 0);
+    if (n < 0)
+        close();
+    return n;
+}
+
+int SysfsAttr::readInt(int *val)
+{
+    char buffer[20];
+    int n = read(buffer, sizeof(buffer));
+
+    if (n <= 0)
+        return n;
+    return parseSysfsInt(buffer, n, val);
+}
+
+int SysfsAttr::readInt(unsigned int *val)
+{
+    int v;
+    int ret = readInt(&v);
+
+    if (ret == 1)
+        *val = v;
+    return ret;
+}
+
+int SysfsAttr::readFloat(float *val)
+{
+    char buffer[32];
+    int n = read(buffer, sizeof(buffer));
+
+    if (n <= 0)
+        return n;
+    return parseSysfsFloat(buffer, n, val);
+}
+
+int SysfsAttr::writeInt(int val)
+{
+    char buffer[12];
+    int len;
+    int n;
+
+    if (fd() < 0)
+        return mFd;
+
+    len = formatSysfsInt(buffer, val);
+    n = pwrite(mFd, buffer, len, 0);
+    if (n <= 0) {
+        close();
+        return n;
+    }
     return 1;
 }
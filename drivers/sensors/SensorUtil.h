@@ -19,6 +19,8 @@
 #ifndef ANDROID_SENSOR_UTIL__H
 #define ANDROID_SENSOR_UTIL__H
 
+#include <stddef.h>
+
 /**
  * Open a file, read a single unsigned integer value from it,
  * and close it.
@@ -35,6 +37,14 @@ int readIntFromFile(const char *path, unsigned int *val);
  */
 int writeIntToFile(const char *path, unsigned int val);
 
+/**
+ * Open a file, write a string to it,
+ * and close it.
+ *
+ * @return 1 in case of success, 0 or < 0 in case of error.
+ */
+int writeStringToFile(const char *path, const char *str);
+
 
 /**
  * Open a file, read a word from it,
@@ -53,4 +63,70 @@ int readStringFromFile(const char *path, char *str);
  */
 int readFloatFromFile(const char *path, float *fVal);
 
+/**
+ * Set a directory that all /sys and /dev paths opened by the sensor
+ * drivers are looked up under, e.g. a fake device tree for host
+ * benchmarks. NULL or "" restores the real root.
+ */
+void setSensorsRoot(const char *root);
+
+/**
+ * Return path as seen under the sensors root: path itself when no root
+ * is set, else the prefixed path written to buf.
+ */
+const char *sensorsPath(const char *path, char *buf, size_t size);
+
+/**
+ * A sysfs attribute that stays open for the life of the driver.
+ *
+ * The node is opened on first access and then read with pread() and
+ * written with pwrite() at offset 0, so a polled read is one syscall
+ * instead of open/read/close. A failed access closes the node and the
+ * next one opens it again. The path is not copied and must outlive the
+ * attribute.
+ *
+ * The accessors return 1 in case of success, 0 or < 0 in case of error,
+ * like readIntFromFile() and writeIntToFile() above.
+ */
+class SysfsAttr {
+public:
+    SysfsAttr(const char *path = NULL);
+    ~SysfsAttr();
+
+    void setPath(const char *path);
+    const char *path() const { return mPath; }
+    void close();
+
+    int readInt(int *val);
+    int readInt(unsigned int *val);
+    int readFloat(float *val);
+    int writeInt(int val);
+
+private:
+    const char *mPath;
+    int mFd;
+
+    int fd();
+    int read(char *buf, size_t size);
+
+    SysfsAttr(const SysfsAttr&);
+    SysfsAttr& operator=(const SysfsAttr&);
+};
+
+/**
+ * Parse the decimal number at the start of a sysfs value of len bytes,
+ * the buffer does not need to be NUL terminated.
+ *
+ * @return 1 in case of success, 0 if it does not start with a number.
+ */
+int parseSysfsInt(const char *buf, size_t len, int *val);
+int parseSysfsFloat(const char *buf, size_t len, float *val);
+
+/**
+ * Format val as decimal into buf, which must hold 12 characters.
+ *
+ * @return the number of characters written, not NUL terminated.
+ */
+int formatSysfsInt(char *buf, int val);
+
 #endif
@@ -35,7 +35,9 @@ Adxl34xAccel::Adxl34xAccel(int sensor_id)
     : SensorBase(NULL, "ADXL34x accelerometer"),
       mEnabled(0),
       mHasPendingEvent(false),
-      mInputReader(32)
+      mInputReader(32),
+      mRate(RATE_SYSFS_PATH),
+      mAutosleep(AUTOSLEEP_SYSFS_PATH)
 {
     mPendingEvent.version = sizeof(sensors_event_t);
     mPendingEvent.sensor = sensor_id;
@@ -74,11 +76,11 @@ int Adxl34xAccel::setDelay(int32_t handle, int64_t ns) {
     }
 
     /* Change data rate through sysfs entry */
-    if (writeIntToFile(RATE_SYSFS_PATH, code) <=0)
+    if (mRate.writeInt(code) <=0)
         return 0;
 
     /* Change autosleep option through sysfs entry */
-    if (writeIntToFile(AUTOSLEEP_SYSFS_PATH, autosleep) <= 0)
+    if (mAutosleep.writeInt(autosleep) <= 0)
         return 0;
 
     return 0;
@@ -107,24 +109,25 @@ int Adxl34xAccel::readEvents(sensors_event_t* data, int count) {
 
     int numEventReceived = 0;
     input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            processEvent(event->code, event->value);
-        } else if (type == EV_SYN) {
-            int64_t time = timevalToNano(event->time);
-            mPendingEvent.timestamp = time;
-            if (mEnabled) {
-                *data++ = mPendingEvent;
-                count--;
-                numEventReceived++;
+    size_t frame;
+
+    while (count && (frame = mInputReader.readFrame(&event))) {
+        for (; --frame; event++) {
+            int type = event->type;
+            if (type == EV_ABS) {
+                processEvent(event->code, event->value);
+            } else {
+                ALOGE("Accelerometer: unknown event (type=%d, code=%d)",
+                        type, event->code);
             }
-        } else {
-            ALOGE("Accelerometer: unknown event (type=%d, code=%d)",
-                    type, event->code);
         }
-        mInputReader.next();
+        mPendingEvent.timestamp = timevalToNano(event->time);
+        if (mEnabled) {
+            *data++ = mPendingEvent;
+            count--;
+            numEventReceived++;
+        }
+        mInputReader.nextFrame();
     }
     return numEventReceived;
 }
@@ -20,6 +20,7 @@
 #include "SensorBase.h"
 #include "sensors.h"
 #include "InputEventReader.h"
+#include "SensorUtil.h"
 #include <linux/input.h>
 #include <hardware/sensors.h>
 
@@ -44,6 +45,8 @@ class Adxl34xAccel : public SensorBase {
     sensors_event_t mPendingEvent;
     bool mHasPendingEvent;
     InputEventCircularReader mInputReader;
+    SysfsAttr mRate;
+    SysfsAttr mAutosleep;
 
 public:
             Adxl34xAccel(int sensor_id);
@@ -0,0 +1,69 @@
+# Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Host benchmark of the sensors HAL poll path against a fake device tree,
+# run as out/host/<os>/bin/sensors_bench -h for options.
+
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := sensors_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\" -DLINUX=1
+LOCAL_SRC_FILES := sensors_bench.cpp \
+                   ../SensorBase.cpp ../SensorUtil.cpp \
+                   ../InputEventReader.cpp ../SensorPollMux.cpp \
+                   ../SensorSpscRing.cpp ../SensorReaderThread.cpp \
+                   ../SensorPollLoop.cpp \
+                   ../nvs_input.cpp ../lightsensor.cpp \
+                   ../../input/input_devices.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/..
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../input/include
+LOCAL_C_INCLUDES += hardware/libhardware/include
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# SIMD against scalar quaternion kernels of mllite, checks they agree and
+# times both.
+include $(CLEAR_VARS)
+LOCAL_MODULE := ml_math_bench
+LOCAL_MODULE_TAGS := optional
+# MPL_LOG* go to liblog instead of the MPL platform library
+LOCAL_CFLAGS := -DLINUX -DANDROID
+LOCAL_SRC_FILES := ml_math_bench.c \
+                   ../mlsdk/mllite/ml_math_func.c \
+                   ../mlsdk/mllite/ml_math_simd.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mlsdk/mllite
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mlsdk/driver/include
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lm -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# Replays an MPL data builder trace recorded with persist.sensors.mpl_trace=1.
+include $(CLEAR_VARS)
+LOCAL_MODULE := mpl_replay
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -DLINUX -DANDROID
+LOCAL_SRC_FILES := mpl_replay.c \
+                   $(addprefix ../mlsdk/mllite/, \
+                       data_builder.c data_trace.c hal_outputs.c \
+                       message_layer.c ml_math_func.c ml_math_simd.c \
+                       mpl.c mpl_context.c results_holder.c \
+                       start_manager.c storage_manager.c)
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mlsdk/mllite
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mlsdk/driver/include
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lm -lrt -lpthread
+include $(BUILD_HOST_EXECUTABLE)
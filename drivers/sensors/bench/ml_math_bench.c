@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Host benchmark of the mllite quaternion kernels.
+ *
+ * Random unit quaternions and vectors in q30 (and float) are run through
+ * the scalar reference and the SIMD table picked for this CPU.  The largest
+ * difference between the two is reported for every kernel and a non zero
+ * exit status means it exceeded the tolerance of ml_math_simd.h.  Each
+ * kernel is then timed over batches of -n samples for -i iterations.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ml_math_func.h"
+#include "ml_math_simd.h"
+
+/*****************************************************************************/
+
+#define FLOAT_TOLERANCE (1e-6f)
+
+static int samples = 1024;
+static int iterations = 2000;
+
+static long *q1, *q2, *qOut;
+static long *vIn, *vOut, *rot;
+static float *f1, *f2, *fOut;
+static long matrix[9];
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double frand(void)
+{
+    return 2.0 * rand() / RAND_MAX - 1.0;
+}
+
+static void random_quat(long *q, float *f)
+{
+    double d[4], norm = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d[i] = frand();
+        norm += d[i] * d[i];
+    }
+    norm = sqrt(norm);
+    for (i = 0; i < 4; i++) {
+        q[i] = (long)(d[i] / norm * 1073741823.0);
+        f[i] = (float)(d[i] / norm);
+    }
+}
+
+static void *alloc(size_t size)
+{
+    void *p = calloc(samples, size);
+
+    if (p == NULL) {
+        perror("calloc");
+        exit(2);
+    }
+    return p;
+}
+
+static void setup(void)
+{
+    float f[4];
+    long q[4];
+    int i;
+
+    q1 = alloc(4 * sizeof(long));
+    q2 = alloc(4 * sizeof(long));
+    qOut = alloc(4 * sizeof(long));
+    vIn = alloc(3 * sizeof(long));
+    vOut = alloc(3 * sizeof(long));
+    rot = alloc(9 * sizeof(long));
+    f1 = alloc(4 * sizeof(float));
+    f2 = alloc(4 * sizeof(float));
+    fOut = alloc(4 * sizeof(float));
+
+    srand(1);
+    for (i = 0; i < samples; i++) {
+        random_quat(&q1[4 * i], &f1[4 * i]);
+        random_quat(&q2[4 * i], &f2[4 * i]);
+        vIn[3 * i] = (long)(frand() * 1073741823.0);
+        vIn[3 * i + 1] = (long)(frand() * 1073741823.0);
+        vIn[3 * i + 2] = (long)(frand() * 1073741823.0);
+    }
+    random_quat(q, f);
+    inv_quaternion_to_rotation_c(q, matrix);
+}
+
+/*****************************************************************************/
+
+static long max_diff(const long *a, const long *b, int n)
+{
+    long d, m = 0;
+
+    for (; n > 0; n--, a++, b++) {
+        d = labs(*a - *b);
+        if (d > m)
+            m = d;
+    }
+    return m;
+}
+
+static float max_difff(const float *a, const float *b, int n)
+{
+    float d, m = 0;
+
+    for (; n > 0; n--, a++, b++) {
+        d = fabsf(*a - *b);
+        if (d > m)
+            m = d;
+    }
+    return m;
+}
+
+/* runs every kernel of both tables once, returns the number of mismatches */
+static int check(const struct inv_math_kernels *simd)
+{
+    const struct inv_math_kernels *ref = inv_math_scalar_kernels();
+    long *a = alloc(9 * sizeof(long));
+    long *b = alloc(9 * sizeof(long));
+    float *fa = alloc(4 * sizeof(float));
+    float *fb = alloc(4 * sizeof(float));
+    float fd;
+    long d;
+    int bad = 0;
+
+    ref->q_mult(q1, q2, a, samples);
+    simd->q_mult(q1, q2, b, samples);
+    d = max_diff(a, b, 4 * samples);
+    printf("q_mult                  max diff %ld\n", d);
+    bad += d != 0;
+
+    memcpy(a, q1, 4 * samples * sizeof(long));
+    memcpy(b, q1, 4 * samples * sizeof(long));
+    ref->q_normalize(a, samples);
+    simd->q_normalize(b, samples);
+    d = max_diff(a, b, 4 * samples);
+    printf("q_normalize             max diff %ld\n", d);
+    bad += d != 0;
+
+    ref->q_rotate(q1, vIn, a, samples);
+    simd->q_rotate(q1, vIn, b, samples);
+    d = max_diff(a, b, 3 * samples);
+    printf("q_rotate                max diff %ld\n", d);
+    bad += d != 0;
+
+    ref->quaternion_to_rotation(q1, a, samples);
+    simd->quaternion_to_rotation(q1, b, samples);
+    d = max_diff(a, b, 9 * samples);
+    printf("quaternion_to_rotation  max diff %ld\n", d);
+    bad += d != 0;
+
+    ref->matrix_vector_mult(matrix, vIn, a, samples);
+    simd->matrix_vector_mult(matrix, vIn, b, samples);
+    d = max_diff(a, b, 3 * samples);
+    printf("matrix_vector_mult      max diff %ld\n", d);
+    bad += d != 0;
+
+    ref->q_multf(f1, f2, fa, samples);
+    simd->q_multf(f1, f2, fb, samples);
+    fd = max_difff(fa, fb, 4 * samples);
+    printf("q_multf                 max diff %g\n", fd);
+    bad += fd > FLOAT_TOLERANCE;
+
+    memcpy(fa, f1, 4 * samples * sizeof(float));
+    memcpy(fb, f1, 4 * samples * sizeof(float));
+    ref->q_normalizef(fa, samples);
+    simd->q_normalizef(fb, samples);
+    fd = max_difff(fa, fb, 4 * samples);
+    printf("q_normalizef            max diff %g\n", fd);
+    bad += fd > FLOAT_TOLERANCE;
+
+    free(a);
+    free(b);
+    free(fa);
+    free(fb);
+    return bad;
+}
+
+/*****************************************************************************/
+
+#define TIME(label, call) do { \
+        int64_t t = now_ns(); \
+        int it; \
+        for (it = 0; it < iterations; it++) \
+            call; \
+        t = now_ns() - t; \
+        printf("%-8s %-24s %8.2f ns/sample\n", k->name, label, \
+               (double)t / iterations / samples); \
+    } while (0)
+
+static void bench(const struct inv_math_kernels *k)
+{
+    TIME("q_mult", k->q_mult(q1, q2, qOut, samples));
+    TIME("q_rotate", k->q_rotate(q1, vIn, vOut, samples));
+    TIME("quaternion_to_rotation", k->quaternion_to_rotation(q1, rot, samples));
+    TIME("matrix_vector_mult",
+         k->matrix_vector_mult(matrix, vIn, vOut, samples));
+    TIME("q_multf", k->q_multf(f1, f2, fOut, samples));
+    TIME("q_normalizef", k->q_normalizef(f1, samples));
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-n samples] [-i iterations]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const struct inv_math_kernels *simd;
+    int bad = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:i:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (samples <= 0 || iterations <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    setup();
+    simd = inv_math_simd_kernels();
+    if (simd == NULL) {
+        printf("no SIMD kernels on this CPU, timing scalar only\n");
+    } else {
+        printf("checking %s against scalar on %d samples\n",
+               simd->name, samples);
+        bad = check(simd);
+    }
+
+    bench(inv_math_scalar_kernels());
+    if (simd != NULL)
+        bench(simd);
+
+    if (bad)
+        printf("%d kernels out of tolerance\n", bad);
+    return bad ? 1 : 0;
+}
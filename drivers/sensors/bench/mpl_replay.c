@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Replays a data builder trace (see data_trace.h) on the host, as fast as
+ * possible, for fusion throughput numbers and regression checks.
+ *
+ * Recorded on the target with persist.sensors.mpl_trace=1, the trace holds
+ * every sample, configuration change and inv_execute_on_data() call the
+ * HAL made.  Each loop starts from a freshly initialized MPL with the HAL
+ * outputs enabled and applies the records in order.  The FNV-1a checksum
+ * of the quaternion and calibrated accel after every execute is printed;
+ * the same trace and build give the same checksum, so a change shows up as
+ * a different value.
+ *
+ * Several traces are replayed in parallel with -j, each worker thread runs
+ * its own MPL context (see mpl_context.h).
+ *
+ * Only the mllite features are linked here, the algorithms of the
+ * prebuilt libmplmpu (gyro/accel/compass bias learning, 6 and 9 axis
+ * fusion, motion detection) are not.  The replay measures the data builder
+ * and HAL output paths, and its checksum tracks changes to them; it says
+ * nothing about the fusion the device runs, and cannot be compared to
+ * output recorded on the target.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mpl.h"
+#include "data_builder.h"
+#include "data_trace.h"
+#include "hal_outputs.h"
+#include "results_holder.h"
+
+/*****************************************************************************/
+
+struct trace {
+    const char *path;
+    void *map;
+    size_t size;
+    const struct inv_trace_record_t *records;
+    size_t count;
+    /* results of the first loop and time of all of them */
+    int64_t hash;
+    unsigned long executes;
+    int64_t ns;
+};
+
+static int loops = 1;
+static int verbose;
+static struct trace *traces;
+static int num_traces;
+static int next_trace;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint32_t fnv1a(uint32_t hash, const long *data, int count)
+{
+    int32_t v;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        v = (int32_t)data[i];
+        for (j = 0; j < 4; j++) {
+            hash ^= (v >> (8 * j)) & 0xff;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+static int start_mpl(void)
+{
+    if (inv_init_mpl() || inv_enable_hal_outputs() || inv_start_mpl()) {
+        fprintf(stderr, "cannot start the MPL\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* applies every record once, returns the checksum or -1 */
+static int64_t replay(const struct inv_trace_record_t *records, size_t count,
+                      unsigned long *executes, int64_t *ns)
+{
+    uint32_t hash = 2166136261u;
+    long quat[4], accel[3];
+    unsigned long unknown = 0;
+    int64_t start;
+    size_t i;
+
+    if (start_mpl())
+        return -1;
+
+    *executes = 0;
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        if (inv_trace_apply(&records[i]) == INV_ERROR_INVALID_PARAMETER)
+            unknown++;
+        if (records[i].type != PLAYBACK_DBG_TYPE_EXECUTE)
+            continue;
+
+        (*executes)++;
+        inv_get_quaternion(quat);
+        inv_get_accel(accel);
+        hash = fnv1a(hash, quat, 4);
+        hash = fnv1a(hash, accel, 3);
+        if (verbose)
+            printf("%lld q=%ld,%ld,%ld,%ld a=%ld,%ld,%ld\n",
+                   (long long)records[i].timestamp, quat[0], quat[1],
+                   quat[2], quat[3], accel[0], accel[1], accel[2]);
+    }
+    *ns = now_ns() - start;
+
+    if (unknown)
+        fprintf(stderr, "%lu records of unknown type\n", unknown);
+    return hash;
+}
+
+/* replays every loop of one trace, returns -1 on failure */
+static int replay_trace(struct trace *t)
+{
+    unsigned long executes;
+    int64_t hash, ns;
+    int i;
+
+    t->ns = 0;
+    for (i = 0; i < loops; i++) {
+        hash = replay(t->records, t->count, &executes, &ns);
+        if (hash < 0)
+            return -1;
+        t->ns += ns;
+        if (i == 0) {
+            t->hash = hash;
+            t->executes = executes;
+        }
+    }
+    return 0;
+}
+
+/* worker of -j, takes the next trace until none are left */
+static void *replay_thread(void *arg)
+{
+    struct inv_mpl_context *ctx;
+    intptr_t failed = 0;
+    int i;
+
+    (void)arg;
+    ctx = inv_mpl_context_create();
+    if (!ctx) {
+        fprintf(stderr, "cannot create an MPL context\n");
+        return (void *)1;
+    }
+    inv_mpl_set_context(ctx);
+    while ((i = __atomic_fetch_add(&next_trace, 1, __ATOMIC_RELAXED)) <
+           num_traces) {
+        if (replay_trace(&traces[i]))
+            failed = 1;
+    }
+    inv_mpl_context_destroy(ctx);
+    return (void *)failed;
+}
+
+static int load_trace(struct trace *t)
+{
+    const struct inv_trace_header_t *header;
+    struct stat st;
+    int fd;
+
+    fd = open(t->path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", t->path, strerror(errno));
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(*header)) {
+        fprintf(stderr, "%s: not a trace\n", t->path);
+        close(fd);
+        return -1;
+    }
+    t->size = st.st_size;
+    t->map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (t->map == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", t->path, strerror(errno));
+        return -1;
+    }
+
+    header = t->map;
+    if (inv_trace_check_header(header)) {
+        fprintf(stderr, "%s: unsupported trace, version %u record size %u\n",
+                t->path, header->version, header->record_size);
+        return -1;
+    }
+    /* the header counts are only written when the trace was closed */
+    t->records = (const struct inv_trace_record_t *)(header + 1);
+    t->count = (t->size - sizeof(*header)) / sizeof(*t->records);
+    printf("%s: %zu records, %u lost while recording%s\n", t->path,
+           t->count, header->dropped,
+           header->records ? "" : " (trace not closed)");
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-n loops] [-j jobs] [-v] trace...\n"
+           "  -n  replay each trace this many times (default 1)\n"
+           "  -j  replay traces on this many threads (default 1)\n"
+           "  -v  print the quaternion and accel after every execute\n"
+           "Runs the mllite data builder and HAL outputs only, the libmplmpu\n"
+           "algorithms (bias learning, 6/9 axis fusion, motion detection) are\n"
+           "not linked in: numbers and checksums do not reflect the fusion\n"
+           "running on the device.\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[64];
+    unsigned long executes = 0;
+    int64_t start, wall, total = 0;
+    size_t count = 0;
+    int jobs = 1;
+    int opt, i, failed = 0;
+    void *ret;
+
+    while ((opt = getopt(argc, argv, "n:j:vh")) != -1) {
+        switch (opt) {
+        case 'n':
+            loops = atoi(optarg);
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    num_traces = argc - optind;
+    if (num_traces <= 0 || loops <= 0 || jobs <= 0 ||
+        jobs > (int)(sizeof(threads) / sizeof(threads[0]))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (jobs > num_traces)
+        jobs = num_traces;
+
+    traces = calloc(num_traces, sizeof(*traces));
+    if (!traces)
+        return 1;
+    for (i = 0; i < num_traces; i++) {
+        traces[i].path = argv[optind + i];
+        if (load_trace(&traces[i]))
+            return 1;
+    }
+
+    start = now_ns();
+    if (jobs == 1) {
+        /* the default context, like the HAL */
+        for (i = 0; i < num_traces && !failed; i++)
+            failed = replay_trace(&traces[i]);
+    } else {
+        for (i = 0; i < jobs; i++) {
+            if (pthread_create(&threads[i], NULL, replay_thread, NULL)) {
+                fprintf(stderr, "cannot start worker %d\n", i);
+                return 1;
+            }
+        }
+        for (i = 0; i < jobs; i++) {
+            pthread_join(threads[i], &ret);
+            if (ret)
+                failed = 1;
+        }
+    }
+    wall = now_ns() - start;
+    if (failed)
+        return 1;
+
+    for (i = 0; i < num_traces; i++) {
+        struct trace *t = &traces[i];
+
+        printf("%s: checksum %08llx over %lu executes, %.0f ns/execute\n",
+               t->path, (unsigned long long)t->hash, t->executes,
+               t->executes ? (double)t->ns / loops / t->executes : 0.0);
+        count += t->count;
+        executes += t->executes;
+        total += t->ns;
+        munmap(t->map, t->size);
+    }
+
+    printf("%.0f records/s, %.0f executes/s, %.0f ns/execute",
+           (double)count * loops * 1e9 / total,
+           (double)executes * loops * 1e9 / total,
+           executes ? (double)total / loops / executes : 0.0);
+    if (jobs > 1)
+        printf(", %.0f executes/s over %d jobs",
+               (double)executes * loops * 1e9 / wall, jobs);
+    printf("\n");
+
+    free(traces);
+    return 0;
+}
@@ -0,0 +1,667 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the sensors HAL poll path.
+ *
+ * A fake device tree is built in a temporary directory and the drivers are
+ * pointed at it with setSensorsRoot():
+ * - every evdev device is a FIFO in dev/input with its sysfs name and NVS
+ *   attributes under sys/class/input, read by an NvsInput driver.
+ * - the ALS is an iio device under sys/bus/iio/devices whose
+ *   in_illuminance_raw is a plain file, read by AmbientLightSensor.
+ *
+ * Writer threads replay an evdev script into the FIFOs at the requested
+ * rate, stamping each frame with CLOCK_MONOTONIC, and update the ALS raw
+ * value.  The poll loop is the HAL's own SensorPollLoop, reading the
+ * drivers inline or, with -t, one SensorReaderThread per driver merged in
+ * timestamp order.
+ *
+ * Reported: events/s, CPU time per poll call, read/write syscalls per event
+ * for each thread (from /proc/self/task/<tid>/io) and the event age
+ * percentiles when returned.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+#include <hardware/sensors.h>
+
+#include "sensors.h"
+#include "SensorUtil.h"
+#include "SensorPollLoop.h"
+#include "nvs_input.h"
+#include "lightsensor.h"
+
+/*****************************************************************************/
+
+enum {
+    maxInputs = 4,
+    maxFrameEvents = 16,
+    maxScriptFrames = 256,
+    maxSamples = 1 << 20,
+    maxTasks = 16,
+    pollBufferSize = 16,
+};
+
+struct frame_t {
+    int count;
+    struct input_event events[maxFrameEvents];
+};
+
+static struct {
+    char root[PATH_MAX];
+    int inputs;
+    int rate;
+    int lightDelayMs;
+    int seconds;
+    bool threaded;
+    bool capture;
+    const char *script;
+} opts;
+
+static frame_t sFrames[maxScriptFrames];
+static int sNumFrames;
+static volatile bool sStop;
+static int sLightFd = -1;
+
+static int64_t sSamples[maxSamples];
+static int sNumSamples;
+
+static int64_t monotonicNs()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+static int64_t threadCpuNs()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+struct task_t {
+    pid_t tid;
+    char name[16];
+    long long syscalls;
+};
+
+/* read + write syscalls of a thread so far */
+static long long syscallCount(pid_t tid)
+{
+    char path[64];
+    char line[64];
+    long long total = 0;
+    long long value;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/io", tid);
+    f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscr: %lld", &value) == 1 ||
+            sscanf(line, "syscw: %lld", &value) == 1)
+            total += value;
+    }
+    fclose(f);
+    return total;
+}
+
+/* syscall counts of every thread of the process, returns how many */
+static int taskCounts(task_t *tasks, int max)
+{
+    char path[64];
+    struct dirent *d;
+    DIR *dir = opendir("/proc/self/task");
+    FILE *f;
+    int n = 0;
+
+    if (dir == NULL)
+        return 0;
+    while (n < max && (d = readdir(dir)) != NULL) {
+        if (d->d_name[0] == '.')
+            continue;
+        tasks[n].tid = atoi(d->d_name);
+        tasks[n].name[0] = '\0';
+        snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tasks[n].tid);
+        f = fopen(path, "r");
+        if (f) {
+            if (fgets(tasks[n].name, sizeof(tasks[n].name), f))
+                tasks[n].name[strcspn(tasks[n].name, "\n")] = '\0';
+            fclose(f);
+        }
+        tasks[n].syscalls = syscallCount(tasks[n].tid);
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/*****************************************************************************/
+
+static int writeFile(const char *dir, const char *name, const char *value)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    write(fd, value, strlen(value));
+    close(fd);
+    return 0;
+}
+
+static int makeDirs(const char *path)
+{
+    char tmp[PATH_MAX];
+    char *p;
+
+    strncpy(tmp, path, sizeof(tmp) - 1);
+    tmp[sizeof(tmp) - 1] = '\0';
+    for (p = tmp + 1; *p; p++) {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        mkdir(tmp, 0777);
+        *p = '/';
+    }
+    if (mkdir(tmp, 0777) < 0 && errno != EEXIST)
+        return -errno;
+    return 0;
+}
+
+/* evdev device i: FIFO, sysfs name and NVS attributes */
+static int makeInput(int i, int *writeFd)
+{
+    char dir[PATH_MAX];
+    char name[16];
+    char path[PATH_MAX];
+    const char *attrs[] = { "enable", "delay", "divisor", "resolution",
+                            "max_range", "microamp" };
+    unsigned j;
+
+    snprintf(name, sizeof(name), "bench%d", i);
+
+    snprintf(dir, sizeof(dir), "%s/dev/input", opts.root);
+    makeDirs(dir);
+    snprintf(path, sizeof(path), "%s/event%d", dir, i);
+    if (mkfifo(path, 0666) < 0) {
+        fprintf(stderr, "mkfifo %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    /* O_RDWR does not block and lets the driver open it read only */
+    *writeFd = open(path, O_RDWR);
+    if (*writeFd < 0)
+        return -errno;
+
+    snprintf(dir, sizeof(dir), "%s/sys/class/input/input%d", opts.root, i);
+    makeDirs(dir);
+    writeFile(dir, "name", name);
+
+    /* eventN/device links to its inputN, as in the kernel */
+    snprintf(dir, sizeof(dir), "%s/sys/class/input/event%d", opts.root, i);
+    makeDirs(dir);
+    snprintf(path, sizeof(path), "%s/device", dir);
+    snprintf(dir, sizeof(dir), "../input%d", i);
+    if (symlink(dir, path) < 0) {
+        fprintf(stderr, "symlink %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    snprintf(dir, sizeof(dir), "%s/sys/class/input/input%d/%s",
+             opts.root, i, name);
+    makeDirs(dir);
+    for (j = 0; j < sizeof(attrs) / sizeof(attrs[0]); j++)
+        writeFile(dir, attrs[j], j == 2 ? "1" : "0");
+    return 0;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag,
+                       struct FTW *ftw)
+{
+    return remove(path);
+}
+
+static void removeTree(const char *root)
+{
+    nftw(root, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* iio ALS, returns the directory holding in_illuminance_raw */
+static int makeLight(char *dir, size_t size)
+{
+    char link[PATH_MAX];
+    char parent[PATH_MAX];
+
+    snprintf(dir, size, "%s/sys/devices/bench_als", opts.root);
+    makeDirs(dir);
+    writeFile(dir, "name", "bench_als");
+    writeFile(dir, "vendor", "nvidia");
+    writeFile(dir, "in_illuminance_enable", "0");
+    writeFile(dir, "in_illuminance_regulator_enable", "0");
+    writeFile(dir, "in_illuminance_integration_time", "1000");
+    writeFile(dir, "in_illuminance_max_range", "10000");
+    writeFile(dir, "in_illuminance_resolution", "1000");
+    writeFile(dir, "in_illuminance_power_consumed", "1");
+    writeFile(dir, "in_illuminance_raw", "0");
+
+    if (opts.capture) {
+        char path[PATH_MAX];
+
+        /* u16 lux then the s64 stamp: 16 byte records */
+        snprintf(path, sizeof(path), "%s/scan_elements", dir);
+        makeDirs(path);
+        writeFile(path, "in_illuminance_en", "0");
+        writeFile(path, "in_illuminance_index", "0");
+        writeFile(path, "in_illuminance_type", "le:u16/16>>0");
+        writeFile(path, "in_timestamp_en", "0");
+        writeFile(path, "in_timestamp_index", "1");
+        writeFile(path, "in_timestamp_type", "le:s64/64>>0");
+        snprintf(path, sizeof(path), "%s/buffer", dir);
+        makeDirs(path);
+        writeFile(path, "enable", "0");
+        writeFile(path, "length", "0");
+        snprintf(path, sizeof(path), "%s/trigger", dir);
+        makeDirs(path);
+        writeFile(path, "current_trigger", "bench_als-dev0");
+        writeFile(dir, "current_timestamp_clock", "realtime");
+        writeFile(dir, "sampling_frequency", "1");
+
+        snprintf(path, sizeof(path), "%s/dev", opts.root);
+        makeDirs(path);
+        snprintf(path, sizeof(path), "%s/dev/iio:device0", opts.root);
+        if (mkfifo(path, 0666) < 0) {
+            fprintf(stderr, "mkfifo %s: %s\n", path, strerror(errno));
+            return -errno;
+        }
+        sLightFd = open(path, O_RDWR);
+        if (sLightFd < 0)
+            return -errno;
+    }
+
+    snprintf(parent, sizeof(parent), "%s/sys/bus/iio/devices", opts.root);
+    makeDirs(parent);
+    snprintf(link, sizeof(link), "%s/iio:device0", parent);
+    if (symlink(dir, link) < 0) {
+        fprintf(stderr, "symlink %s: %s\n", link, strerror(errno));
+        return -errno;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+
+/*
+ * Script: one event per line as "<type> <code> <value>" with type one of
+ * REL, ABS or SYN (code and value optional for SYN), '#' starts a comment.
+ * SYN ends a frame.  Frames are replayed in a loop.
+ */
+static int loadScript(const char *path)
+{
+    char line[128];
+    char type[8];
+    int code, value, n;
+    frame_t *f;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+
+    sNumFrames = 0;
+    f = &sFrames[0];
+    f->count = 0;
+    while (fgets(line, sizeof(line), file) && sNumFrames < maxScriptFrames) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        code = value = 0;
+        n = sscanf(line, "%7s %d %d", type, &code, &value);
+        if (n < 1 || f->count >= maxFrameEvents)
+            continue;
+
+        struct input_event *e = &f->events[f->count++];
+        memset(e, 0, sizeof(*e));
+        e->code = code;
+        e->value = value;
+        if (!strcmp(type, "REL")) {
+            e->type = EV_REL;
+        } else if (!strcmp(type, "ABS")) {
+            e->type = EV_ABS;
+        } else if (!strcmp(type, "SYN")) {
+            e->type = EV_SYN;
+            f = &sFrames[++sNumFrames];
+            f->count = 0;
+        } else {
+            f->count--;
+        }
+    }
+    fclose(file);
+    return sNumFrames ? 0 : -EINVAL;
+}
+
+static void defaultScript()
+{
+    int i, j;
+
+    /* a 3 axis sample per frame with changing values */
+    for (i = 0; i < 64; i++) {
+        frame_t *f = &sFrames[i];
+
+        memset(f, 0, sizeof(*f));
+        for (j = 0; j < 3; j++) {
+            f->events[j].type = EV_REL;
+            f->events[j].code = REL_X + j;
+            f->events[j].value = i * (j + 1);
+        }
+        f->events[3].type = EV_SYN;
+        f->count = 4;
+    }
+    sNumFrames = 64;
+}
+
+static void sleepUntil(int64_t due)
+{
+    struct timespec ts;
+
+    ts.tv_sec = due / 1000000000LL;
+    ts.tv_nsec = due % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void *inputWriter(void *arg)
+{
+    int fd = (long)arg;
+    int64_t period = 1000000000LL / opts.rate;
+    int64_t due = monotonicNs();
+    struct input_event events[maxFrameEvents];
+    int i, n = 0;
+
+    while (!sStop) {
+        frame_t *f = &sFrames[n++ % sNumFrames];
+        int64_t now = monotonicNs();
+
+        for (i = 0; i < f->count; i++) {
+            events[i] = f->events[i];
+            events[i].time.tv_sec = now / 1000000000LL;
+            events[i].time.tv_usec = (now % 1000000000LL) / 1000;
+        }
+        if (write(fd, events, f->count * sizeof(events[0])) < 0 &&
+            errno != EAGAIN)
+            break;
+
+        due += period;
+        sleepUntil(due);
+    }
+    return NULL;
+}
+
+static void *lightWriter(void *arg)
+{
+    const char *dir = (const char *)arg;
+    int64_t due = monotonicNs();
+    char value[16];
+    int n = 0;
+
+    while (!sStop) {
+        if (sLightFd >= 0) {
+            uint8_t record[16] = { 0 };
+            uint16_t lux = n++ % 1000;
+            int64_t ts = monotonicNs();
+
+            memcpy(record, &lux, sizeof(lux));
+            memcpy(record + 8, &ts, sizeof(ts));
+            write(sLightFd, record, sizeof(record));
+        } else {
+            snprintf(value, sizeof(value), "%d", n++ % 1000);
+            writeFile(dir, "in_illuminance_raw", value);
+        }
+        due += opts.lightDelayMs * 1000000LL;
+        sleepUntil(due);
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+
+static int compareSamples(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentileUs(int pct)
+{
+    int i;
+
+    if (!sNumSamples)
+        return 0;
+    i = (int)((long long)(sNumSamples - 1) * pct / 100);
+    return sSamples[i] / 1000.0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n inputs] [-r rate_hz] [-l light_delay_ms] "
+            "[-d seconds] [-s script] [-t] [-c]\n"
+            "  -n  number of evdev devices (1-%d, default 1)\n"
+            "  -r  frames per second written to each device (default 200)\n"
+            "  -l  ALS poll delay in ms, 0 disables the ALS (default 100)\n"
+            "  -d  duration in seconds (default 5)\n"
+            "  -s  evdev script, see loadScript()\n"
+            "  -t  read each driver on its own thread\n"
+            "  -c  capture the ALS from a fake iio buffer\n",
+            name, maxInputs);
+}
+
+int main(int argc, char **argv)
+{
+    SensorPollLoop loop;
+    SensorBase *drivers[maxInputs + 1];
+    pthread_t writers[maxInputs + 1];
+    int writeFds[maxInputs];
+    char lightDir[PATH_MAX];
+    sensors_event_t buffer[pollBufferSize];
+    int numDrivers = 0, numWriters = 0;
+    task_t before[maxTasks], after[maxTasks];
+    int numBefore, numAfter;
+    long long calls = 0, events = 0, total = 0;
+    int64_t cpu = 0, start, end;
+    int i, j, c;
+
+    opts.inputs = 1;
+    opts.rate = 200;
+    opts.lightDelayMs = 100;
+    opts.seconds = 5;
+    opts.threaded = false;
+    opts.capture = false;
+    opts.script = NULL;
+    while ((c = getopt(argc, argv, "n:r:l:d:s:tch")) != -1) {
+        switch (c) {
+        case 'n': opts.inputs = atoi(optarg); break;
+        case 'r': opts.rate = atoi(optarg); break;
+        case 'l': opts.lightDelayMs = atoi(optarg); break;
+        case 'd': opts.seconds = atoi(optarg); break;
+        case 's': opts.script = optarg; break;
+        case 't': opts.threaded = true; break;
+        case 'c': opts.capture = true; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.inputs < 1 || opts.inputs > maxInputs || opts.rate <= 0 ||
+        opts.seconds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.script) {
+        if (loadScript(opts.script) < 0)
+            return 1;
+    } else {
+        defaultScript();
+    }
+
+    strcpy(opts.root, "/tmp/sensors_bench.XXXXXX");
+    if (mkdtemp(opts.root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (i = 0; i < opts.inputs; i++) {
+        if (makeInput(i, &writeFds[i]) < 0)
+            return 1;
+    }
+    if (opts.lightDelayMs > 0 && makeLight(lightDir, sizeof(lightDir)) < 0)
+        return 1;
+    setSensorsRoot(opts.root);
+
+    /* drivers, as the HAL would create them */
+    for (i = 0; i < opts.inputs; i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "bench%d", i);
+        drivers[numDrivers++] = new NvsInput(name, i, i,
+                                             SENSOR_TYPE_ACCELEROMETER, 0);
+    }
+    if (opts.lightDelayMs > 0) {
+        SensorBase *light = LightSensorBase::getInstance(ID_L);
+
+        if (light == NULL) {
+            fprintf(stderr, "ALS not found in %s\n", opts.root);
+            return 1;
+        }
+        drivers[numDrivers++] = light;
+    }
+
+    if (opts.threaded && loop.setThreaded(256)) {
+        fprintf(stderr, "cannot read the drivers on their own threads\n");
+        return 1;
+    }
+    for (i = 0; i < numDrivers; i++) {
+        SensorPollMux *m = loop.readerMux();
+        int fd = drivers[i]->getFd();
+        int id;
+
+        if (fd >= 0)
+            id = m->add(fd, SensorPollMux::readSensor, drivers[i]);
+        else
+            id = m->addPolled(SensorPollMux::readSensor, drivers[i]);
+
+        if (i < opts.inputs) {
+            drivers[i]->enable(i, 1);
+        } else {
+            drivers[i]->enable(ID_L, 1);
+            drivers[i]->setDelay(ID_L, opts.lightDelayMs * 1000000LL);
+            if (fd < 0)
+                m->setPeriod(id, drivers[i]->getPollDelay());
+        }
+    }
+    loop.startReaders();
+
+    for (i = 0; i < opts.inputs; i++) {
+        pthread_create(&writers[numWriters], NULL, inputWriter,
+                       (void *)(long)writeFds[i]);
+        pthread_setname_np(writers[numWriters++], "bench-wr");
+    }
+    if (opts.lightDelayMs > 0) {
+        pthread_create(&writers[numWriters], NULL, lightWriter, lightDir);
+        pthread_setname_np(writers[numWriters++], "bench-wr-als");
+    }
+
+    numBefore = taskCounts(before, maxTasks);
+    start = monotonicNs();
+    end = start + opts.seconds * 1000000000LL;
+    while (monotonicNs() < end) {
+        int64_t cpuStart = threadCpuNs();
+        int64_t now;
+        int n;
+
+        n = loop.poll(buffer, pollBufferSize);
+        now = monotonicNs();
+        cpu += threadCpuNs() - cpuStart;
+        calls++;
+
+        for (i = 0; i < n; i++) {
+            if (sNumSamples < maxSamples)
+                sSamples[sNumSamples++] = now - buffer[i].timestamp;
+        }
+        if (n > 0)
+            events += n;
+    }
+    end = monotonicNs();
+    numAfter = taskCounts(after, maxTasks);
+
+    sStop = true;
+    for (i = 0; i < numWriters; i++)
+        pthread_join(writers[i], NULL);
+    loop.stopReaders();
+
+    qsort(sSamples, sNumSamples, sizeof(sSamples[0]), compareSamples);
+    printf("mode            %s\n", opts.threaded ? "threaded" : "inline");
+    printf("inputs          %d at %d Hz, ALS %s\n", opts.inputs, opts.rate,
+           opts.lightDelayMs <= 0 ? "off" :
+           opts.capture ? "captured" : "polled");
+    printf("events/s        %.1f\n", events * 1e9 / (end - start));
+    printf("poll calls      %lld, %.2f events per call\n", calls,
+           calls ? (double)events / calls : 0.0);
+    printf("cpu per call    %.2f us (poll thread)\n",
+           calls ? cpu / 1000.0 / calls : 0.0);
+    printf("syscalls/event  read+write per thread\n");
+    for (i = 0; i < numAfter; i++) {
+        long long n = after[i].syscalls;
+
+        for (j = 0; j < numBefore; j++) {
+            if (before[j].tid == after[i].tid) {
+                n -= before[j].syscalls;
+                break;
+            }
+        }
+        total += n;
+        printf("  %-16s%.2f%s\n", after[i].name,
+               events ? (double)n / events : 0.0,
+               after[i].tid == getpid() ? " (poll thread)" : "");
+    }
+    printf("  %-16s%.2f\n", "total", events ? (double)total / events : 0.0);
+    printf("age at return   p50 %.0f us, p90 %.0f us, p99 %.0f us, "
+           "max %.0f us\n", percentileUs(50), percentileUs(90),
+           percentileUs(99), percentileUs(100));
+
+    removeTree(opts.root);
+    return 0;
+}
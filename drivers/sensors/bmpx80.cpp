@@ -25,6 +25,7 @@
 #include "bmpx80.h"
 #include "SensorUtil.h"
 #include "nvs_input.h"
+#include "input_devices.h"
 
 /*****************************************************************************/
 
@@ -48,36 +49,13 @@ void Bmpx80Pressure::fillSensorDef(sensor_t *ssensor_list, int &curIndex)
 
 int Bmpx80Pressure::inputDevPathNum(const char *dev_name)
 {
-    char name[32] = {0};
-    char path[80];
-    int i;
-    int fd;
-    int err;
+    struct input_device dev;
 
-    i = 0;
-    while(1)
-    {
-        sprintf(path, "/sys/class/input/input%d/name", i);
-        err = access(path, F_OK);
-        if (err < 0) {
-            break;
-        } else {
-            fd = open(path, O_RDONLY);
-            if (fd >= 0) {
-                memset(name, 0, sizeof(name));
-                read(fd, name, sizeof(name));
-                close(fd);
-                if (!strncmp(name, dev_name, strlen(dev_name))) {
-                    ALOGI("%s %s %s found", __func__, path, dev_name);
-                    err = i;
-                    break;
-                }
-            }
-        }
-        i++;
-    }
+    if (input_device_find_prefix(dev_name, &dev) < 0)
+        return -1;
 
-    return err;
+    ALOGI("%s input%d %s found", __func__, dev.input, dev_name);
+    return dev.input;
 }
 
 /*****************************************************************************/
@@ -116,28 +116,30 @@ int Cm3217Light::readEvents(sensors_event_t* data, int count)
 
     int numEventReceived = 0;
     input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            if (event->code == EVENT_TYPE_LIGHT) {
-                if (event->value != -1) {
-                    // FIXME: not sure why we're getting -1 sometimes
-                    mPendingEvent.light = indexToValue(event->value);
+    size_t frame;
+
+    while (count && (frame = mInputReader.readFrame(&event))) {
+        for (; --frame; event++) {
+            int type = event->type;
+            if (type == EV_ABS) {
+                if (event->code == EVENT_TYPE_LIGHT) {
+                    if (event->value != -1) {
+                        // FIXME: not sure why we're getting -1 sometimes
+                        mPendingEvent.light = indexToValue(event->value);
+                    }
                 }
+            } else {
+                ALOGE("Cm3217Light: unknown event (type=%d, code=%d)",
+                        type, event->code);
             }
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-            if (mEnabled) {
-                *data++ = mPendingEvent;
-                count--;
-                numEventReceived++;
-            }
-        } else {
-            ALOGE("Cm3217Light: unknown event (type=%d, code=%d)",
-                    type, event->code);
         }
-        mInputReader.next();
+        mPendingEvent.timestamp = timevalToNano(event->time);
+        if (mEnabled) {
+            *data++ = mPendingEvent;
+            count--;
+            numEventReceived++;
+        }
+        mInputReader.nextFrame();
     }
 
     return numEventReceived;
@@ -55,6 +55,7 @@ Cm3218Base::Cm3218Base(const char *sysPath,int sid)
         sysValuePath = strcpy(sysValuePath, in_name);
         sysValuePath = strcat(sysValuePath, "_raw");
         mSysValuePath = sysValuePath;
+        mValue.setPath(mSysValuePath);
         sysEnablePath = strcpy(sysEnablePath, in_name);
         sysEnablePath = strcat(sysEnablePath, "_enable");
         mSysEnablePath = sysEnablePath;
@@ -137,7 +138,7 @@ int Cm3218Base::readEvents(sensors_event_t* data, int count) {
     if (!hasPendingEvents())
         return 0;
 
-    ret = readIntFromFile(mSysValuePath, &value);
+    ret = mValue.readInt(&value);
     if (ret <= 0) {
         ALOGV("read from %s failed", mSysValuePath);
         return 0;
@@ -26,6 +26,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 #include "InputEventReader.h"
 
 
@@ -52,6 +53,7 @@ class Cm3218Base : public SensorBase {
     const char *mSysValuePath;
     const char *mSysEnablePath;
     const char *mSysRegulatorEnablePath;
+    SysfsAttr mValue;
 public:
             Cm3218Base(const char *sysPath, int sid);
     virtual ~Cm3218Base();
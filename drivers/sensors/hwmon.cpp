@@ -32,6 +32,7 @@ HwmonTemp::HwmonTemp(const char *sysPath, int sensor_id)
       mLast_value(-1),
       mAlready_warned(false),
       mSysPath(sysPath),
+      mValue(sysPath),
       sid(sensor_id)
 {
 }
@@ -67,7 +68,7 @@ int HwmonTemp::readEvents(sensors_event_t* data, int count) {
     int numEventReceived = 0;
     input_event const* event;
 
-    int amt = readIntFromFile(mSysPath, &iValue);
+    int amt = mValue.readInt(&iValue);
     if (amt <= 0 && mAlready_warned == false) {
         ALOGE("TemperatureMonitor: read from %s failed", mSysPath);
         mAlready_warned = false;
@@ -18,6 +18,7 @@
 #define ANDROID_TEMPERATURE_MONITOR_H
 
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 #define ADT7461TEMP_DEF(handle) {         \
     "ADT7461 Temperature Monitor",        \
@@ -32,6 +33,7 @@ class HwmonTemp : public SensorBase {
     float mLast_value;
     bool mAlready_warned;
     const char *mSysPath;
+    SysfsAttr mValue;
     int sid;
 
 public:
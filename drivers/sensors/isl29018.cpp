@@ -32,6 +32,7 @@ Isl29018Light::Isl29018Light(const char *sysPath, int sensor_id)
       mLast_value(-1),
       mAlready_warned(false),
       mSysPath(sysPath),
+      mValue(sysPath),
       sid(sensor_id)
 {
 }
@@ -83,7 +84,7 @@ int Isl29018Light::readEvents(sensors_event_t* data, int count) {
 
     input_event const* event;
 
-    int amt = readIntFromFile(mSysPath, &value);
+    int amt = mValue.readInt(&value);
     if (amt <= 0 && mAlready_warned == false) {
         ALOGE("LightSensor: read from %s failed", mSysPath);
         mAlready_warned = false;
@@ -111,6 +112,7 @@ Isl29018Prox::Isl29018Prox(const char *sysPath, int sensor_id, unsigned int Prox
       mAlready_warned(false),
       mLast_value(-1),
       mSysPath(sysPath),
+      mValue(sysPath),
       sid(sensor_id),
       mProximityThreshold(ProxThreshold)
 {
@@ -159,7 +161,7 @@ int Isl29018Prox::readEvents(sensors_event_t* data, int count) {
     else
         mLastns.timestamp = Currentns.timestamp;
 
-    int amt = readIntFromFile(mSysPath, &value);
+    int amt = mValue.readInt(&value);
     if (amt <= 0 && mAlready_warned == false) {
         ALOGE("ProximitySensor: read from %s failed", mSysPath);
         mAlready_warned = true;
@@ -21,6 +21,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 #define ISL29018LIGHT_DEF(handle) {           \
     "Intersil isl29018 Ambient Light Sensor", \
@@ -44,6 +45,7 @@ class Isl29018Light : public SensorBase {
     unsigned int mLast_value;
     bool mAlready_warned;
     const char *mSysPath;
+    SysfsAttr mValue;
     int sid;
     int64_t mPollingDelay;
     sensors_event_t mLastns;
@@ -63,6 +65,7 @@ class Isl29018Prox : public SensorBase {
     bool mAlready_warned;
     float mLast_value;
     const char *mSysPath;
+    SysfsAttr mValue;
     int sid;
     unsigned int mProximityThreshold;
     int64_t mPollingDelay;
@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <string.h>
+#include <time.h>
 
 #include "SensorUtil.h"
 #include "lightsensor.h"
@@ -38,7 +39,17 @@ using namespace std;
 LightSensorBase::LightSensorBase(const char *sysPath, int sid)
     : SensorBase(NULL, NULL),
       mEnabled(false),
-      mLastValue(-1)
+      mLastValue(-1),
+      mLastns(0),
+      mPollingDelay(0),
+      mCapture(false),
+      mSysBufferEnablePath(NULL),
+      mSamplePeriod(0),
+      mSysCapturePath(NULL),
+      mSysFrequencyPath(NULL),
+      mSysRawPath(NULL),
+      mSysEnablePath(NULL),
+      mSysRegulatorEnablePath(NULL)
 {
     name = NULL;
     vendor = NULL;
@@ -51,12 +62,14 @@ LightSensorBase::LightSensorBase(const char *sysPath, int sid)
     int size = getPath(pathBuffer, sysPath, sid, RAW);
     mSysRawPath = new char[size];
     strcpy(mSysRawPath, pathBuffer);
+    mRaw.setPath(mSysRawPath);
     memset(pathBuffer, 0, size);
 
     size = getPath(pathBuffer, sysPath, sid, ENABLE);
     if (access(pathBuffer, F_OK) != -1) {
         mSysEnablePath = new char[size];
         strcpy(mSysEnablePath, pathBuffer);
+        mEnable.setPath(mSysEnablePath);
     }
     memset(pathBuffer, 0, size);
 
@@ -64,6 +77,7 @@ LightSensorBase::LightSensorBase(const char *sysPath, int sid)
     if (access(pathBuffer, F_OK) != -1) {
         mSysRegulatorEnablePath = new char[size];
         strcpy(mSysRegulatorEnablePath, pathBuffer);
+        mRegulatorEnable.setPath(mSysRegulatorEnablePath);
     }
     memset(pathBuffer, 0, size);
 
@@ -75,14 +89,30 @@ LightSensorBase::LightSensorBase(const char *sysPath, int sid)
         mIntegrationTime = int_time; /* micro secs */
         mIntegrationTime = mIntegrationTime * 1000; /* nano sec */
     }
+
+    /*
+     * Capture the ALS from the iio buffer. A proximity channel on the same
+     * device stays polled through sysfs, which drivers may refuse while
+     * their buffer is enabled, so such devices are polled altogether.
+     */
+    getPath(pathBuffer, sysPath, ID_P, RAW);
+    if (sid == ID_L && access(pathBuffer, F_OK) == -1 &&
+        !initCapture(sysPath, "in_illuminance")) {
+        ALOGI("AmbientLightSensor: iio buffer capture on %s", sysPath);
+        mCapture = true;
+    }
 }
 
 LightSensorBase::~LightSensorBase() {
+    restoreCapture();
     delete[] name;
     delete[] vendor;
     delete[] mSysRawPath;
     delete[] mSysEnablePath;
     delete[] mSysRegulatorEnablePath;
+    delete[] mSysBufferEnablePath;
+    delete[] mSysCapturePath;
+    delete[] mSysFrequencyPath;
 }
 
 void LightSensorBase::fillSensorDef(sensor_t &sensor_def, int sid, int type) {
@@ -194,25 +224,32 @@ int LightSensorBase::enable(int32_t handle, int en) {
     int ret = 1;
     if (en) {
         if (mSysRegulatorEnablePath)
-            ret &= writeIntToFile(mSysRegulatorEnablePath, en);
+            ret &= mRegulatorEnable.writeInt(en);
 
         if (mSysEnablePath)
-            ret &= writeIntToFile(mSysEnablePath, en);
+            ret &= mEnable.writeInt(en);
+
+        if (mCapture)
+            ret &= mBufferEnable.writeInt(en);
 
         mLastValue = -1;
-        mLastns = getTimestamp();
+        /* captured samples carry their own time, the first one goes out */
+        mLastns = mCapture ? 0 : getTimestamp();
     } else {
+        if (mCapture)
+            ret &= mBufferEnable.writeInt(en);
+
         if (mSysEnablePath)
-            ret &= writeIntToFile(mSysEnablePath, en);
+            ret &= mEnable.writeInt(en);
 
         if (mSysRegulatorEnablePath)
-            ret &= writeIntToFile(mSysRegulatorEnablePath, en);
+            ret &= mRegulatorEnable.writeInt(en);
     }
 
     /* F_OK | R_OK access is already checked in getInstance */
     if (!mSysRegulatorEnablePath && !mSysEnablePath &&
         access(mSysRawPath, W_OK) != -1)
-        ret &= writeIntToFile(mSysRawPath, en);
+        ret &= mRaw.writeInt(en);
 
     if (ret == 1)
         mEnabled = en;
@@ -235,7 +272,7 @@ bool LightSensorBase::equals(int64_t val1, int64_t val2) {
 }
 
 bool LightSensorBase::hasPendingEvents() const {
-    if (!mEnabled)
+    if (!mEnabled || mCapture)
         return false;
 
     if ((getTimestamp() - mLastns) < mPollingDelay)
@@ -248,6 +285,9 @@ int LightSensorBase::readEvents(sensors_event_t* data, int count) {
     unsigned int value = 0;
     int ret = 0;
 
+    if (mCapture && count > 0 && data != NULL)
+        return readCapture(data, count);
+
     if (count < 1 || data == NULL || !mEnabled) {
         ALOGV("Will not work on zero count(%i) or null pointer\n", count);
         return 0;
@@ -256,7 +296,7 @@ int LightSensorBase::readEvents(sensors_event_t* data, int count) {
     if (!hasPendingEvents())
         return 0;
 
-    ret = readIntFromFile(mSysRawPath, &value);
+    ret = mRaw.readInt(&value);
     if (ret <= 0) {
         ALOGV("read from %s failed", mSysRawPath);
         return 0;
@@ -273,9 +313,419 @@ int LightSensorBase::readEvents(sensors_event_t* data, int count) {
 
 int LightSensorBase::setDelay(int32_t handle, int64_t ns) {
     mPollingDelay = ns < mIntegrationTime ? mIntegrationTime : ns;
+    if (mCapture)
+        setSamplePeriod(mPollingDelay);
+    return 0;
+}
+
+int64_t LightSensorBase::getPollDelay() const {
+    return mEnabled && !mCapture ? mPollingDelay : -1;
+}
+
+/* iio buffer capture */
+
+/*
+ * Parse the index and the <channel>_type of a scan element, the type reads
+ * [be|le]:[s|u]bits/storagebits[Xrepeat]>>shift.
+ */
+int LightSensorBase::readScanElement(const char *sysPath, const char *channel,
+                                     int *index, ScanType *type)
+{
+    char path[MAX_SENSOR_PATH];
+    char buf[128];
+    const char *shift;
+    unsigned int idx;
+    char endian, sign;
+    int real, storage;
+
+    snprintf(path, sizeof(path), "%sscan_elements/%s_index", sysPath, channel);
+    if (readIntFromFile(path, &idx) != 1)
+        return -ENODEV;
+    snprintf(path, sizeof(path), "%sscan_elements/%s_type", sysPath, channel);
+    if (readStringFromFile(path, buf) != 1)
+        return -ENODEV;
+
+    if (sscanf(buf, "%ce:%c%d/%d", &endian, &sign, &real, &storage) != 4)
+        return -EINVAL;
+    if ((storage != 8 && storage != 16 && storage != 32 && storage != 64) ||
+        real < 1 || real > storage)
+        return -EINVAL;
+
+    type->bigEndian = endian == 'b';
+    type->isSigned = sign == 's';
+    type->realBits = real;
+    type->storageBytes = storage / 8;
+    type->shift = 0;
+    shift = strstr(buf, ">>");
+    if (shift)
+        parseSysfsInt(shift + 2, strlen(shift + 2), &type->shift);
+    *index = idx;
     return 0;
 }
 
+int64_t LightSensorBase::readScanValue(const uint8_t *p, const ScanType &type)
+{
+    uint64_t v = 0;
+
+    for (int i = 0; i < type.storageBytes; i++)
+        v = (v << 8) | p[type.bigEndian ? i : type.storageBytes - 1 - i];
+    v >>= type.shift;
+    if (type.realBits < 64) {
+        v &= (1ULL << type.realBits) - 1;
+        if (type.isSigned && (v >> (type.realBits - 1)) & 1)
+            v |= ~0ULL << type.realBits;
+    }
+    return (int64_t)v;
+}
+
+/*
+ * Devices filling their buffer from their own interrupt have no
+ * current_trigger. Otherwise keep the trigger already set, or pick the
+ * one the driver registered for itself, named after the device.
+ */
+int LightSensorBase::setCaptureTrigger(const char *sysPath)
+{
+    char path[MAX_SENSOR_PATH];
+    char parentBuffer[MAX_SENSOR_PATH];
+    char name[128];
+    char trigger[128];
+    const char *parentDir;
+    struct dirent *ent;
+    DIR *dir;
+    int ret = -ENODEV;
+
+    snprintf(path, sizeof(path), "%strigger/current_trigger", sysPath);
+    if (access(path, F_OK) == -1)
+        return 0;
+    if (readStringFromFile(path, trigger) == 1 &&
+        trigger[0] && trigger[0] != '\n')
+        return 0;
+
+    snprintf(path, sizeof(path), "%sname", sysPath);
+    if (readStringFromFile(path, name) != 1)
+        return -ENODEV;
+    name[strcspn(name, "\n")] = '\0';
+
+    parentDir = sensorsPath(PARENT_DIR, parentBuffer, sizeof(parentBuffer));
+    dir = opendir(parentDir);
+    if (dir == NULL)
+        return -ENODEV;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "trigger", 7))
+            continue;
+        snprintf(path, sizeof(path), "%s%s/name", parentDir, ent->d_name);
+        if (readStringFromFile(path, trigger) != 1 ||
+            strncmp(trigger, name, strlen(name)))
+            continue;
+        trigger[strcspn(trigger, "\n")] = '\0';
+        snprintf(path, sizeof(path), "%strigger/current_trigger", sysPath);
+        ret = writeStringToFile(path, trigger) == 1 ? 0 : -EIO;
+        mSaved.triggerSet = !ret;
+        break;
+    }
+    closedir(dir);
+    return ret;
+}
+
+/*
+ * Offsets of the channel and the timestamp in a record. Every enabled scan
+ * element is part of the record, packed by index and aligned to its own
+ * size, and the record is padded to its largest element.
+ */
+int LightSensorBase::captureLayout(const char *sysPath, int valueIndex,
+                                   int timeIndex)
+{
+    char path[MAX_SENSOR_PATH];
+    char channel[MAX_PROP_SIZE];
+    int index[IIO_MAX_SCAN_ELEMENTS];
+    int bytes[IIO_MAX_SCAN_ELEMENTS];
+    unsigned int en;
+    struct dirent *ent;
+    ScanType type;
+    DIR *dir;
+    int num = 0;
+    int offset = 0;
+    int align = 1;
+    int i, j;
+
+    snprintf(path, sizeof(path), "%sscan_elements", sysPath);
+    dir = opendir(path);
+    if (dir == NULL)
+        return -ENODEV;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+
+        if (len < 3 || len - 3 >= sizeof(channel) ||
+            strcmp(ent->d_name + len - 3, "_en"))
+            continue;
+        snprintf(path, sizeof(path), "%sscan_elements/%s", sysPath,
+                 ent->d_name);
+        if (readIntFromFile(path, &en) != 1 || !en)
+            continue;
+        snprintf(channel, sizeof(channel), "%.*s", (int)len - 3, ent->d_name);
+        if (num >= IIO_MAX_SCAN_ELEMENTS ||
+            readScanElement(sysPath, channel, &index[num], &type)) {
+            closedir(dir);
+            return -E2BIG;
+        }
+        /* sorted by index */
+        for (i = num; i > 0 && index[i - 1] > index[num]; i--)
+            ;
+        for (j = num; j > i; j--) {
+            index[j] = index[j - 1];
+            bytes[j] = bytes[j - 1];
+        }
+        index[i] = index[num];
+        bytes[i] = type.storageBytes;
+        num++;
+    }
+    closedir(dir);
+
+    mValueOffset = mTimeOffset = -1;
+    for (i = 0; i < num; i++) {
+        offset = (offset + bytes[i] - 1) / bytes[i] * bytes[i];
+        if (index[i] == valueIndex)
+            mValueOffset = offset;
+        else if (index[i] == timeIndex)
+            mTimeOffset = offset;
+        offset += bytes[i];
+        if (bytes[i] > align)
+            align = bytes[i];
+    }
+    mRecordSize = (offset + align - 1) / align * align;
+
+    if (mValueOffset < 0 || mTimeOffset < 0)
+        return -ENODEV;
+    return mRecordSize <= IIO_MAX_RECORD_SIZE ? 0 : -E2BIG;
+}
+
+/*
+ * Run the device at the requested period so that readCapture() only has to
+ * drop the samples the device cannot skip itself. The device picks the
+ * closest rate it supports, which is read back.
+ */
+void LightSensorBase::setSamplePeriod(int64_t ns)
+{
+    char value[32];
+    float hz;
+    long long uhz;
+
+    if (!mSysFrequencyPath || ns <= 0)
+        return;
+
+    uhz = 1000000000000000LL / ns;
+    snprintf(value, sizeof(value), "%lld.%06lld", uhz / 1000000,
+             uhz % 1000000);
+    if (writeStringToFile(mSysFrequencyPath, value) != 1)
+        ALOGV("AmbientLightSensor: cannot set %s to %s", mSysFrequencyPath,
+              value);
+
+    if (readFloatFromFile(mSysFrequencyPath, &hz) == 1 && hz > 0)
+        mSamplePeriod = (int64_t)(1000000000.0 / hz);
+    else
+        mSamplePeriod = 0;
+}
+
+/* put back what initCapture() changed on the device */
+void LightSensorBase::restoreCapture()
+{
+    char path[MAX_SENSOR_PATH];
+    const char *sysPath = mSysCapturePath;
+
+    if (!sysPath)
+        return;
+
+    if (mSysBufferEnablePath)
+        mBufferEnable.writeInt(0);
+    if (mSysFrequencyPath && mSaved.frequency[0])
+        writeStringToFile(mSysFrequencyPath, mSaved.frequency);
+    if (mSaved.clock[0]) {
+        snprintf(path, sizeof(path), "%scurrent_timestamp_clock", sysPath);
+        writeStringToFile(path, mSaved.clock);
+    }
+    if (mSaved.bufferLength >= 0) {
+        snprintf(path, sizeof(path), "%sbuffer/length", sysPath);
+        writeIntToFile(path, mSaved.bufferLength);
+    }
+    if (mSaved.triggerSet) {
+        /* no trigger by that name detaches the device's */
+        snprintf(path, sizeof(path), "%strigger/current_trigger", sysPath);
+        writeStringToFile(path, "\n");
+    }
+    if (mSaved.valueEn >= 0) {
+        snprintf(path, sizeof(path), "%sscan_elements/%s", sysPath,
+                 mValueEnName);
+        writeIntToFile(path, mSaved.valueEn);
+    }
+    if (mSaved.timeEn >= 0) {
+        snprintf(path, sizeof(path), "%sscan_elements/in_timestamp_en",
+                 sysPath);
+        writeIntToFile(path, mSaved.timeEn);
+    }
+
+    delete[] mSysCapturePath;
+    mSysCapturePath = NULL;
+}
+
+/* read a sysfs string into value without its newline, empty if none */
+static void saveSysfsString(const char *path, char *value)
+{
+    value[0] = '\0';
+    if (readStringFromFile(path, value) == 1)
+        value[strcspn(value, "\n")] = '\0';
+    else
+        value[0] = '\0';
+}
+
+/*
+ * Set up the buffer to capture the channel and the timestamp and open its
+ * character device. Other scan elements keep their state and are skipped
+ * when reading. A buffer already enabled belongs to someone else and is not
+ * touched. On failure the device is put back as it was and the sensor is
+ * polled through sysfs instead.
+ */
+int LightSensorBase::initCapture(const char *sysPath, const char *channel)
+{
+    char path[MAX_SENSOR_PATH];
+    char devBuffer[MAX_SENSOR_PATH];
+    const char *start, *end;
+    unsigned int value;
+    int valueIndex, timeIndex;
+    int ret;
+
+    if (readScanElement(sysPath, channel, &valueIndex, &mValueType) ||
+        readScanElement(sysPath, "in_timestamp", &timeIndex, &mTimeType) ||
+        mTimeType.storageBytes != 8)
+        return -ENODEV;
+
+    snprintf(path, sizeof(path), "%sbuffer/enable", sysPath);
+    if (access(path, W_OK) == -1)
+        return -ENODEV;
+    if (readIntFromFile(path, &value) == 1 && value)
+        return -EBUSY;
+    mSysBufferEnablePath = new char[strlen(path) + 1];
+    strcpy(mSysBufferEnablePath, path);
+    mBufferEnable.setPath(mSysBufferEnablePath);
+
+    /* from here on restoreCapture() undoes the changes */
+    mSysCapturePath = new char[strlen(sysPath) + 1];
+    strcpy(mSysCapturePath, sysPath);
+    snprintf(mValueEnName, sizeof(mValueEnName), "%s_en", channel);
+    mSaved.bufferLength = -1;
+    mSaved.valueEn = -1;
+    mSaved.timeEn = -1;
+    mSaved.triggerSet = false;
+    mSaved.clock[0] = '\0';
+    mSaved.frequency[0] = '\0';
+
+    snprintf(path, sizeof(path), "%sscan_elements/%s", sysPath, mValueEnName);
+    if (readIntFromFile(path, &value) != 1)
+        goto fail;
+    mSaved.valueEn = value;
+    if (writeIntToFile(path, 1) != 1)
+        goto fail;
+    snprintf(path, sizeof(path), "%sscan_elements/in_timestamp_en", sysPath);
+    if (readIntFromFile(path, &value) != 1)
+        goto fail;
+    mSaved.timeEn = value;
+    if (writeIntToFile(path, 1) != 1)
+        goto fail;
+    if (captureLayout(sysPath, valueIndex, timeIndex))
+        goto fail;
+
+    if (setCaptureTrigger(sysPath))
+        goto fail;
+    snprintf(path, sizeof(path), "%sbuffer/length", sysPath);
+    if (readIntFromFile(path, &value) == 1)
+        mSaved.bufferLength = value;
+    writeIntToFile(path, IIO_READ_RECORDS * 4);
+
+    /* stamps are CLOCK_REALTIME unless the clock can be chosen */
+    snprintf(path, sizeof(path), "%scurrent_timestamp_clock", sysPath);
+    saveSysfsString(path, mSaved.clock);
+    mRealtimeStamps = writeStringToFile(path, "monotonic") != 1;
+
+    /* the channel's own rate if it has one, else the device's */
+    snprintf(path, sizeof(path), "%s%s_sampling_frequency", sysPath, channel);
+    if (access(path, W_OK) == -1)
+        snprintf(path, sizeof(path), "%ssampling_frequency", sysPath);
+    if (access(path, W_OK) != -1) {
+        mSysFrequencyPath = new char[strlen(path) + 1];
+        strcpy(mSysFrequencyPath, path);
+        saveSysfsString(path, mSaved.frequency);
+    }
+
+    /* sysPath is .../iio:deviceN/, the character device is /dev/iio:deviceN */
+    end = sysPath + strlen(sysPath) - 1;
+    for (start = end; start > sysPath && start[-1] != '/'; start--)
+        ;
+    snprintf(devBuffer, sizeof(devBuffer), IIO_DEV_DIR "%.*s",
+             (int)(end - start), start);
+    dev_fd = open(sensorsPath(devBuffer, path, sizeof(path)),
+                  O_RDONLY | O_NONBLOCK);
+    if (dev_fd < 0) {
+        ALOGE("AmbientLightSensor: cannot open %s (%s)", devBuffer,
+              strerror(errno));
+        ret = -errno;
+        restoreCapture();
+        return ret;
+    }
+    return 0;
+
+fail:
+    restoreCapture();
+    return -ENODEV;
+}
+
+int LightSensorBase::readCapture(sensors_event_t *data, int count)
+{
+    uint8_t buf[IIO_READ_RECORDS * IIO_MAX_RECORD_SIZE];
+    int64_t slack;
+    int records = count < IIO_READ_RECORDS ? count : IIO_READ_RECORDS;
+    int64_t offset = 0;
+    int nb = 0;
+    ssize_t n;
+
+    n = read(dev_fd, buf, records * mRecordSize);
+    if (n < 0)
+        return errno == EAGAIN ? 0 : -errno;
+
+    if (mRealtimeStamps) {
+        struct timespec t;
+
+        clock_gettime(CLOCK_REALTIME, &t);
+        offset = int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec -
+                 getTimestamp();
+    }
+
+    /* drop what is left over from before a disable */
+    if (!mEnabled)
+        return 0;
+
+    /*
+     * The device already runs at the requested rate when it could be set,
+     * drop only the samples in between, with half a sample of slack for
+     * sampling jitter.
+     */
+    slack = mSamplePeriod ? mSamplePeriod / 2 : mIntegrationTime / 2;
+    for (uint8_t *p = buf; p + mRecordSize <= buf + n; p += mRecordSize) {
+        int value = readScanValue(p + mValueOffset, mValueType);
+        int64_t ns = readScanValue(p + mTimeOffset, mTimeType) - offset;
+
+        if (mLastns && ns - mLastns < mPollingDelay - slack)
+            continue;
+        mLastns = ns;
+        if (equals(value, mLastValue))
+            continue;
+
+        mLastValue = value;
+        toEvent(data[nb], value);
+        data[nb].timestamp = ns;
+        nb++;
+    }
+    return nb;
+}
+
 /* static variables  */
 
 AmbientLightSensor *LightSensorBase::als = NULL;
@@ -369,9 +819,12 @@ int LightSensorBase::getSensorPath(char* snsrPath, int sensorId)
     DIR *dir;
     struct dirent *ent, *entFile;
     char pathBuffer[MAX_SENSOR_PATH];
+    char parentBuffer[MAX_SENSOR_PATH];
+    const char *parentDir;
     int curIndex = 0;
 
-    dir = opendir(PARENT_DIR);
+    parentDir = sensorsPath(PARENT_DIR, parentBuffer, sizeof(parentBuffer));
+    dir = opendir(parentDir);
     if (dir == NULL)
         return 0;
 
@@ -382,7 +835,7 @@ int LightSensorBase::getSensorPath(char* snsrPath, int sensorId)
         if (ent->d_type != DT_LNK)
             continue;
 
-        strcpy(pathBuffer, PARENT_DIR);
+        strcpy(pathBuffer, parentDir);
         strcat(pathBuffer, ent->d_name);
         strcat(pathBuffer, "/");
 
@@ -21,6 +21,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 /* maximum num of char in sysfs node name*/
 #define MAX_PROP_SIZE 64
@@ -32,6 +33,14 @@
 
 /* Parent directory for all light devices */
 #define PARENT_DIR "/sys/bus/iio/devices/"
+/* directory of the iio character devices */
+#define IIO_DEV_DIR "/dev/"
+/* records read from the iio buffer per readEvents() call */
+#define IIO_READ_RECORDS 16
+/* largest iio buffer record captured, larger layouts are polled instead */
+#define IIO_MAX_RECORD_SIZE 64
+/* scan elements of a record, at most */
+#define IIO_MAX_SCAN_ELEMENTS 16
 
 #define NUM_OF_CHANNELS 2 /* ALS and Proximity */
 
@@ -130,8 +139,35 @@ class ProximitySensor;
 /*****************************LIGHT SENSOR BASE********************************/
 
 /* mIntegrationTime is minimum polling delay that device can allow
- * => two successive poll to device can not be less than mIntegrationTime */
+ * => two successive poll to device can not be less than mIntegrationTime
+ *
+ * ALS devices with an iio buffer are not polled: the illuminance and
+ * timestamp scan elements are captured through /dev/iio:deviceN, which
+ * getFd() returns for the poll loop, and events carry the kernel
+ * timestamp of the sample. See initCapture(). Only the ALS channel and the
+ * timestamp are switched on, the rest of the device is left as found, and
+ * everything initCapture() changed is put back when the sensor goes away.
+ */
 class LightSensorBase: public SensorBase {
+    /* iio scan element format, from its _type attribute */
+    struct ScanType {
+        bool bigEndian;
+        bool isSigned;
+        int realBits;
+        int storageBytes;
+        int shift;
+    };
+
+    /* device state changed by initCapture(), see restoreCapture() */
+    struct CaptureState {
+        int bufferLength;
+        int valueEn;
+        int timeEn;
+        bool triggerSet;        // current_trigger was empty, we set it
+        char clock[128];        // current_timestamp_clock, empty if none
+        char frequency[128];    // sampling frequency, empty if none
+    };
+
     bool mEnabled;
     int mLastValue;
 
@@ -139,9 +175,27 @@ class LightSensorBase: public SensorBase {
     int64_t mPollingDelay;
     int64_t mIntegrationTime;
 
+    bool mCapture;
+    char *mSysBufferEnablePath;
+    SysfsAttr mBufferEnable;
+    ScanType mValueType;
+    ScanType mTimeType;
+    int mValueOffset;
+    int mTimeOffset;
+    int mRecordSize;
+    bool mRealtimeStamps;   // kernel timestamps are CLOCK_REALTIME
+    int64_t mSamplePeriod;  // device sampling period, 0 if not settable
+    char *mSysCapturePath;  // iio device directory while it is changed
+    char *mSysFrequencyPath;
+    char mValueEnName[MAX_PROP_SIZE];
+    CaptureState mSaved;
+
     char *mSysRawPath;
     char *mSysEnablePath;
     char *mSysRegulatorEnablePath;
+    SysfsAttr mRaw;
+    SysfsAttr mEnable;
+    SysfsAttr mRegulatorEnable;
 
 protected:
     char *name, *vendor;
@@ -160,6 +214,7 @@ public:
     virtual bool hasPendingEvents() const;
     virtual int readEvents(sensors_event_t *data, int count);
     virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getPollDelay() const;
     virtual void toEvent(sensors_event_t &evt, int value) = 0;
 
     static AmbientLightSensor* als;
@@ -170,6 +225,18 @@ public:
     static SensorBase* getInstance(int sensor_id, int proxThreshold = -1);
     static int getPath(char * filePath, const char *sysPath, int sid, int pIndex);
     static int getSensorPath(char* snsrPath, int sensorId);
+
+private:
+    int initCapture(const char *sysPath, const char *channel);
+    int setCaptureTrigger(const char *sysPath);
+    int captureLayout(const char *sysPath, int valueIndex, int timeIndex);
+    void setSamplePeriod(int64_t ns);
+    void restoreCapture();
+    int readCapture(sensors_event_t *data, int count);
+
+    static int readScanElement(const char *sysPath, const char *channel,
+                               int *index, ScanType *type);
+    static int64_t readScanValue(const uint8_t *p, const ScanType &type);
 };
 
 /**************************AMBIENT LIGHT SENSOR********************************/
@@ -35,6 +35,8 @@ ltr558Light::ltr558Light(const char *sysPath, const char *sysEnablePath, int sen
       mAlready_warned(false),
       mSysPath(sysPath),
       mSysEnablePath(sysEnablePath),
+      mValue(sysPath),
+      mEnable(sysEnablePath),
       sid(sensor_id)
 {
 }
@@ -43,7 +45,7 @@ ltr558Light::~ltr558Light() {
 }
 
 int ltr558Light::enable(int32_t handle, int en) {
-    int err = writeIntToFile(mSysEnablePath, en);
+    int err = mEnable.writeInt(en);
     if (err <= 0)
         return err;
 
@@ -63,6 +65,10 @@ int ltr558Light::setDelay(int32_t handle, int64_t ns) {
     return 0;
 }
 
+int64_t ltr558Light::getPollDelay() const {
+    return mEnabled ? mPollingDelay : -1;
+}
+
 bool ltr558Light::hasPendingEvents() const {
     if(mEnabled)
         return true;
@@ -90,7 +96,7 @@ int ltr558Light::readEvents(sensors_event_t* data, int count) {
 
     input_event const* event;
 
-    int amt = readIntFromFile(mSysPath, &value);
+    int amt = mValue.readInt(&value);
     if (amt <= 0 && mAlready_warned == false) {
         ALOGE("LightSensor: read from %s failed", mSysPath);
         mAlready_warned = false;
@@ -125,11 +131,13 @@ ltr558Prox::ltr558Prox(const char *sysPath, const char *sysEnablePath,
     if (sysPath) {
         mSysPath = new char[strlen(sysPath) + 1];
         strcpy(mSysPath, sysPath);
+        mValue.setPath(mSysPath);
     }
 
     if (sysEnablePath) {
         mSysEnablePath = new char[strlen(sysEnablePath) + 1];
         strcpy(mSysEnablePath, sysEnablePath);
+        mEnable.setPath(mSysEnablePath);
     }
 
     mProximityThreshold = 1;
@@ -183,7 +191,7 @@ int ltr558Prox::fillPaths(char *path, char *enable_path, char  *thres_path)
 }
 
 int ltr558Prox::enable(int32_t handle, int en) {
-    int err = writeIntToFile(mSysEnablePath, en);
+    int err = mEnable.writeInt(en);
     if (err <= 0)
         return err;
 
@@ -203,6 +211,10 @@ int ltr558Prox::setDelay(int32_t handle, int64_t ns) {
     return 0;
 }
 
+int64_t ltr558Prox::getPollDelay() const {
+    return mEnabled ? mPollingDelay : -1;
+}
+
 bool ltr558Prox::hasPendingEvents() const {
     if(mEnabled)
         return true;
@@ -226,7 +238,7 @@ int ltr558Prox::readEvents(sensors_event_t* data, int count) {
     else
         mLastns.timestamp = Currentns.timestamp;
 
-    int amt = readIntFromFile(mSysPath, &value);
+    int amt = mValue.readInt(&value);
     if (amt <= 0 && mAlready_warned == false) {
         ALOGE("ProximitySensor: read from %s failed", mSysPath);
         mAlready_warned = true;
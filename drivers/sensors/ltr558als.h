@@ -21,6 +21,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 #define LTR_SENSOR_SYSFS_PATH_NAME "/sys/bus/iio/devices/iio:device0/name"
 #define LTR_DEVICE_NAME "ltr558"
@@ -51,6 +52,8 @@ class ltr558Light : public SensorBase {
     bool mAlready_warned;
     const char *mSysPath;
     const char *mSysEnablePath;
+    SysfsAttr mValue;
+    SysfsAttr mEnable;
     int sid;
     int64_t mPollingDelay;
     sensors_event_t mLastns;
@@ -62,6 +65,7 @@ public:
     virtual bool hasPendingEvents() const;
     virtual int enable(int32_t handle, int enabled);
     virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getPollDelay() const;
 };
 
 class ltr558Prox : public SensorBase {
@@ -72,6 +76,8 @@ class ltr558Prox : public SensorBase {
     char *mSysPath;
     char *mSysEnablePath;
     char *mSysThresPath;
+    SysfsAttr mValue;
+    SysfsAttr mEnable;
     int sid;
     unsigned int mProximityThreshold;
     unsigned int minValue;
@@ -86,6 +92,7 @@ public:
     virtual bool hasPendingEvents() const;
     virtual int enable(int32_t handle, int enabled);
     virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getPollDelay() const;
     static int fillPaths(char *path, char *enable_path, char *thres_path);
     static void fillSensorDef(sensor_t *ssensor_list, int &curIndex);
 };
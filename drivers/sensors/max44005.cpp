@@ -32,6 +32,7 @@ Max44005SensorBase::Max44005SensorBase(const char *sysPath, int sensor_id)
       mEnabled(false),
       mLast_value(-1),
       mSysPath(sysPath),
+      mValue(sysPath),
       mPollingDelay(MIN_POLL_DELAY),
       sid(sensor_id)
 {
@@ -47,7 +48,7 @@ int Max44005SensorBase::enable(int32_t handle, int en) {
     if (en == mEnabled)
         return 0;
 
-    int ret = writeIntToFile(mSysPath, en);
+    int ret = mValue.writeInt(en);
 
     if (ret <= 0)
         return ret;
@@ -67,6 +68,10 @@ int Max44005SensorBase::setDelay(int32_t handle, int64_t ns) {
     return 0;
 }
 
+int64_t Max44005SensorBase::getPollDelay() const {
+    return mEnabled ? mPollingDelay : -1;
+}
+
 bool Max44005SensorBase::hasPendingEvents() const {
     if (!mEnabled)
         return false;
@@ -92,7 +97,7 @@ int Max44005SensorBase::readEvents(sensors_event_t* data, int count) {
     if (!hasPendingEvents())
         return 0;
 
-    int amt = readIntFromFile(mSysPath, &value);
+    int amt = mValue.readInt(&value);
     if (amt <= 0) {
         ALOGV("SensorId=%d : read from %s failed", sid, mSysPath);
         return 0;
@@ -22,6 +22,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 #define MAX44005LIGHT_DEF(handle) {           \
     "MAX44005 Light sensor", \
@@ -47,6 +48,7 @@ class Max44005SensorBase : public SensorBase {
     bool mEnabled;
     int mLast_value;
     const char *mSysPath;
+    SysfsAttr mValue;
     int32_t mType;
     int64_t mLastns;
     int64_t mPollingDelay;
@@ -61,6 +63,7 @@ public:
     virtual bool hasPendingEvents() const;
     virtual int enable(int32_t handle, int enabled);
     virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int64_t getPollDelay() const;
 };
 
 class Max44005Light : public Max44005SensorBase {
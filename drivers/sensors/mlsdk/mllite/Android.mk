@@ -21,12 +21,22 @@ LOCAL_MODULE := libmllite
 
 LOCAL_CFLAGS := -DLOG_TAG=\"Sensors\"
 LOCAL_CFLAGS += -DLINUX
+# per-algorithm timing, see inv_enable_profile()
+ifneq ($(TARGET_BUILD_VARIANT),user)
+LOCAL_CFLAGS += -DINV_PROFILE
+endif
 
 LOCAL_SRC_FILES := $(call all-c-files-under)
+ifeq ($(TARGET_ARCH),arm)
+# the NEON kernels are only used when the cpu reports NEON at runtime
+LOCAL_SRC_FILES := $(filter-out ml_math_simd.c,$(LOCAL_SRC_FILES))
+LOCAL_SRC_FILES += ml_math_simd.c.neon
+endif
 
 LOCAL_C_INCLUDES := device/nvidia/drivers/sensors/mlsdk/driver/include
+LOCAL_C_INCLUDES += device/nvidia/drivers/input/include
 
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SHARED_LIBRARIES := liblog libinputdevices
 
 #TODO: Remove following lines before include statement and fix the source giving warnings/errors
 LOCAL_NVIDIA_NO_WARNINGS_AS_ERRORS := 1
@@ -26,6 +26,8 @@
 #include "storage_manager.h"
 #include "message_layer.h"
 #include "results_holder.h"
+#include "data_trace.h"
+#include "mpl_context.h"
 
 #include "log.h"
 #undef MPL_LOG_TAG
@@ -33,52 +35,217 @@
 
 typedef inv_error_t (*inv_process_cb_func)(struct inv_sensor_cal_t *data);
 
+#ifdef INV_PROFILE
+/** Entry points timed besides the data callbacks */
+enum inv_prof_build_e {
+    INV_PROF_BUILD_GYRO,
+    INV_PROF_BUILD_ACCEL,
+    INV_PROF_BUILD_COMPASS,
+    INV_PROF_BUILD_TEMP,
+    INV_PROF_BUILD_QUAT,
+    INV_PROF_EXECUTE,
+    INV_PROF_NUM_BUILD
+};
+
+struct inv_prof_stat_t {
+    unsigned long calls;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long last_ns;
+};
+#endif
+
 struct process_t {
     inv_process_cb_func func;
     int priority;
     int data_required;
+#ifdef INV_PROFILE
+    struct inv_prof_stat_t prof;
+#endif
 };
 
+/** One list per combination of INV_*_NEW bits */
+#define INV_DATA_MODES (INV_QUAT_NEW << 1)
+
 struct inv_data_builder_t {
     int num_cb;
     struct process_t process[INV_MAX_DATA_CB];
+    /* process[] indices in priority order, rebuilt on (un)register */
+    unsigned char dispatch[INV_DATA_MODES][INV_MAX_DATA_CB];
+    unsigned char num_dispatch[INV_DATA_MODES];
     struct inv_db_save_t save;
     int compass_disturbance;
-#ifdef INV_PLAYBACK_DBG
-    int debug_mode;
-    int last_mode;
-    FILE *file;
+#ifdef INV_PROFILE
+    int profile;
+    struct inv_prof_stat_t build_prof[INV_PROF_NUM_BUILD];
 #endif
 };
 
 void inv_apply_calibration(struct inv_single_sensor_t *sensor, const long *bias);
 static void inv_set_contiguous(void);
 
-static struct inv_data_builder_t inv_data_builder;
-static struct inv_sensor_cal_t sensors;
+struct inv_data_builder_state_t {
+    struct inv_data_builder_t builder;
+    struct inv_sensor_cal_t sensors;
+    /* not reset by inv_init_data_builder() so caches never see an old value */
+    unsigned int generation;
+};
+
+struct inv_data_builder_state_t inv_default_data_builder;
+const size_t inv_data_builder_state_size = sizeof(struct inv_data_builder_state_t);
+
+/* state of the calling thread's context, see mpl_context.h */
+#define inv_data_builder (inv_mpl_ctx()->data_builder->builder)
+#define sensors (inv_mpl_ctx()->data_builder->sensors)
+#define inv_data_generation (inv_mpl_ctx()->data_builder->generation)
+
+/* the trace file is process wide, only the context that opened it records */
+static struct inv_mpl_context *inv_trace_ctx;
+
+static inline int inv_db_tracing(void)
+{
+    return inv_trace_enabled() && inv_trace_ctx == inv_mpl_ctx();
+}
 
-#ifdef INV_PLAYBACK_DBG
+#ifdef INV_PROFILE
+#include <time.h>
+
+static const char *const inv_prof_build_names[INV_PROF_NUM_BUILD] = {
+    "inv_build_gyro",
+    "inv_build_accel",
+    "inv_build_compass",
+    "inv_build_temp",
+    "inv_build_quat",
+    "inv_execute_on_data",
+};
+
+/** Data callbacks are only known by their priority */
+static const struct {
+    int priority;
+    const char *name;
+} inv_prof_cb_names[] = {
+    { INV_PRIORITY_MOTION_NO_MOTION, "motion_no_motion" },
+    { INV_PRIORITY_GYRO_TC, "gyro_tc" },
+    { INV_PRIORITY_QUATERNION_GYRO_ACCEL, "quaternion_gyro_accel" },
+    { INV_PRIORITY_QUATERNION_NO_GYRO, "quaternion_no_gyro" },
+    { INV_PRIORITY_MAGNETIC_DISTURBANCE, "magnetic_disturbance" },
+    { INV_PRIORITY_HEADING_FROM_GYRO, "heading_from_gyro" },
+    { INV_PRIORITY_COMPASS_BIAS_W_GYRO, "compass_bias_w_gyro" },
+    { INV_PRIORITY_COMPASS_VECTOR_CAL, "compass_vector_cal" },
+    { INV_PRIORITY_COMPASS_ADV_BIAS, "compass_adv_bias" },
+    { INV_PRIORITY_9_AXIS_FUSION, "9_axis_fusion" },
+    { INV_PRIORITY_QUATERNION_ADJUST_9_AXIS, "quaternion_adjust_9_axis" },
+    { INV_PRIORITY_QUATERNION_ACCURACY, "quaternion_accuracy" },
+    { INV_PRIORITY_RESULTS_HOLDER, "results_holder" },
+    { INV_PRIORITY_INUSE_AUTO_CALIBRATION, "inuse_auto_calibration" },
+    { INV_PRIORITY_HAL_OUTPUTS, "hal_outputs" },
+    { INV_PRIORITY_GLYPH, "glyph" },
+    { INV_PRIORITY_SHAKE, "shake" },
+    { INV_PRIORITY_SM, "sm" },
+};
+
+static inline unsigned long long inv_prof_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void inv_prof_record(struct inv_prof_stat_t *stat,
+                            unsigned long long start)
+{
+    unsigned long long ns = inv_prof_now() - start;
+
+    stat->calls++;
+    stat->total_ns += ns;
+    stat->last_ns = ns;
+    if (ns > stat->max_ns)
+        stat->max_ns = ns;
+}
+
+/* start is 0 while profiling is off, so nothing gets recorded */
+#define INV_PROF_START(start) \
+    unsigned long long start = inv_data_builder.profile ? inv_prof_now() : 0
+#define INV_PROF_END(which, start) \
+    do { \
+        if (start) \
+            inv_prof_record(&inv_data_builder.build_prof[which], start); \
+    } while (0)
+#else
+#define INV_PROF_START(start)
+#define INV_PROF_END(which, start)
+#endif
+
+/** Records the current configuration, so a trace replays from a builder
+* in the same state.
+*/
+static void inv_trace_snapshot(void)
+{
+    struct inv_single_sensor_t *sensor[3] = {
+        &sensors.gyro, &sensors.accel, &sensors.compass
+    };
+    static const int orient[3] = {
+        PLAYBACK_DBG_TYPE_G_ORIENT, PLAYBACK_DBG_TYPE_A_ORIENT,
+        PLAYBACK_DBG_TYPE_C_ORIENT
+    };
+    static const int rate[3] = {
+        PLAYBACK_DBG_TYPE_G_SAMPLE_RATE, PLAYBACK_DBG_TYPE_A_SAMPLE_RATE,
+        PLAYBACK_DBG_TYPE_C_SAMPLE_RATE
+    };
+    long data[2];
+    int kk;
+
+    for (kk = 0; kk < 3; ++kk) {
+        if (sensor[kk]->sensitivity) {
+            data[0] = sensor[kk]->orientation;
+            data[1] = sensor[kk]->sensitivity;
+            inv_trace_write(orient[kk], 0, data, 2, 0);
+        }
+        if (sensor[kk]->sample_rate_us)
+            inv_trace_write(rate[kk], 0, &sensor[kk]->sample_rate_us, 1, 0);
+    }
+    if (sensors.quat.sample_rate_us)
+        inv_trace_write(PLAYBACK_DBG_TYPE_Q_SAMPLE_RATE, 0,
+                        &sensors.quat.sample_rate_us, 1, 0);
+
+    inv_trace_write(PLAYBACK_DBG_TYPE_G_BIAS,
+                    inv_data_builder.save.gyro_accuracy,
+                    inv_data_builder.save.gyro_bias, 3, 0);
+    inv_trace_write(PLAYBACK_DBG_TYPE_A_BIAS,
+                    inv_data_builder.save.accel_accuracy,
+                    inv_data_builder.save.accel_bias, 3, 0);
+    inv_trace_write(PLAYBACK_DBG_TYPE_C_BIAS,
+                    inv_data_builder.save.compass_accuracy,
+                    inv_data_builder.save.compass_bias, 3, 0);
+}
 
 /** Turn on data logging to allow playback of same scenario at a later time.
-* @param[in] file File to write to, must be open.
+* The inputs are traced in the format of data_trace.h, replay with
+* inv_trace_apply().
+* @param[in] path File to write to, created or truncated.
 */
-void inv_turn_on_data_logging(FILE *file)
+inv_error_t inv_turn_on_data_logging(const char *path)
 {
+    inv_error_t result;
+
     MPL_LOGV("input data logging started\n");
-    inv_data_builder.file = file;
-    inv_data_builder.debug_mode = RD_RECORD;
+    result = inv_trace_open(path);
+    if (result == INV_SUCCESS) {
+        inv_trace_ctx = inv_mpl_ctx();
+        inv_trace_snapshot();
+    }
+    return result;
 }
 
-/** Turn off data logging to allow playback of same scenario at a later time.
-* File passed to inv_turn_on_data_logging() must be closed after calling this.
-*/
+/** Turn off data logging and complete the trace file. */
 void inv_turn_off_data_logging()
 {
+    if (inv_trace_ctx != inv_mpl_ctx())
+        return;
     MPL_LOGV("input data logging stopped\n");
-    inv_data_builder.debug_mode = RD_NO_DEBUG;
-    inv_data_builder.file = NULL;
+    inv_trace_close();
+    inv_trace_ctx = NULL;
 }
-#endif
 
 /** This function receives the data that was stored in non-volatile memory between power off */
 static inv_error_t inv_db_load_func(const unsigned char *data)
@@ -172,14 +339,10 @@ void set_sensor_orientation_and_scale(struct inv_single_sensor_t *sensor,
 */
 void inv_set_gyro_orientation_and_scale(int orientation, long sensitivity)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_G_ORIENT;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&orientation, sizeof(orientation), 1, inv_data_builder.file);
-        fwrite(&sensitivity, sizeof(sensitivity), 1, inv_data_builder.file);
+    if (inv_db_tracing()) {
+        long data[2] = { orientation, sensitivity };
+        inv_trace_write(PLAYBACK_DBG_TYPE_G_ORIENT, 0, data, 2, 0);
     }
-#endif
     set_sensor_orientation_and_scale(&sensors.gyro, orientation,
                                      sensitivity);
 }
@@ -189,13 +352,8 @@ void inv_set_gyro_orientation_and_scale(int orientation, long sensitivity)
 */
 void inv_set_gyro_sample_rate(long sample_rate_us)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_G_SAMPLE_RATE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&sample_rate_us, sizeof(sample_rate_us), 1, inv_data_builder.file);
-    }
-#endif
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_G_SAMPLE_RATE, 0, &sample_rate_us, 1, 0);
     sensors.gyro.sample_rate_us = sample_rate_us;
     sensors.gyro.sample_rate_ms = sample_rate_us / 1000;
     if (sensors.gyro.bandwidth == 0) {
@@ -208,13 +366,8 @@ void inv_set_gyro_sample_rate(long sample_rate_us)
 */
 void inv_set_accel_sample_rate(long sample_rate_us)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_A_SAMPLE_RATE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&sample_rate_us, sizeof(sample_rate_us), 1, inv_data_builder.file);
-    }
-#endif
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_A_SAMPLE_RATE, 0, &sample_rate_us, 1, 0);
     sensors.accel.sample_rate_us = sample_rate_us;
     sensors.accel.sample_rate_ms = sample_rate_us / 1000;
     if (sensors.accel.bandwidth == 0) {
@@ -227,13 +380,8 @@ void inv_set_accel_sample_rate(long sample_rate_us)
 */
 void inv_set_compass_sample_rate(long sample_rate_us)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_C_SAMPLE_RATE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&sample_rate_us, sizeof(sample_rate_us), 1, inv_data_builder.file);
-    }
-#endif
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_C_SAMPLE_RATE, 0, &sample_rate_us, 1, 0);
     sensors.compass.sample_rate_us = sample_rate_us;
     sensors.compass.sample_rate_ms = sample_rate_us / 1000;
     if (sensors.compass.bandwidth == 0) {
@@ -261,13 +409,8 @@ void inv_get_compass_sample_rate_ms(long *sample_rate_ms)
 */
 void inv_set_quat_sample_rate(long sample_rate_us)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_Q_SAMPLE_RATE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&sample_rate_us, sizeof(sample_rate_us), 1, inv_data_builder.file);
-    }
-#endif
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_Q_SAMPLE_RATE, 0, &sample_rate_us, 1, 0);
     sensors.quat.sample_rate_us = sample_rate_us;
     sensors.quat.sample_rate_ms = sample_rate_us / 1000;
 }
@@ -358,14 +501,10 @@ inv_time_t inv_get_last_timestamp()
 */
 void inv_set_accel_orientation_and_scale(int orientation, long sensitivity)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_A_ORIENT;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&orientation, sizeof(orientation), 1, inv_data_builder.file);
-        fwrite(&sensitivity, sizeof(sensitivity), 1, inv_data_builder.file);
+    if (inv_db_tracing()) {
+        long data[2] = { orientation, sensitivity };
+        inv_trace_write(PLAYBACK_DBG_TYPE_A_ORIENT, 0, data, 2, 0);
     }
-#endif
     set_sensor_orientation_and_scale(&sensors.accel, orientation,
                                      sensitivity);
 }
@@ -381,14 +520,10 @@ void inv_set_accel_orientation_and_scale(int orientation, long sensitivity)
 */
 void inv_set_compass_orientation_and_scale(int orientation, long sensitivity)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_C_ORIENT;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&orientation, sizeof(orientation), 1, inv_data_builder.file);
-        fwrite(&sensitivity, sizeof(sensitivity), 1, inv_data_builder.file);
+    if (inv_db_tracing()) {
+        long data[2] = { orientation, sensitivity };
+        inv_trace_write(PLAYBACK_DBG_TYPE_C_ORIENT, 0, data, 2, 0);
     }
-#endif
     set_sensor_orientation_and_scale(&sensors.compass, orientation, sensitivity);
 }
 
@@ -409,6 +544,8 @@ void inv_apply_calibration(struct inv_single_sensor_t *sensor, const long *bias)
 {
     long raw32[3];
 
+    inv_data_generation++;
+
     // Convert raw to calibrated
     raw32[0] = (long)sensor->raw[0] << 15;
     raw32[1] = (long)sensor->raw[1] << 15;
@@ -608,14 +745,11 @@ void inv_get_accel_bias(long *bias, long *temp)
  */
 inv_error_t inv_build_accel(const long *accel, int status, inv_time_t timestamp)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_ACCEL;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(accel, sizeof(accel[0]), 3, inv_data_builder.file);
-        fwrite(&timestamp, sizeof(timestamp), 1, inv_data_builder.file);
-    }
-#endif
+    INV_PROF_START(start);
+
+    inv_data_generation++;
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_ACCEL, status, accel, 3, timestamp);
 
     if ((status & INV_CALIBRATED) == 0) {
         sensors.accel.raw[0] = (short)accel[0];
@@ -635,6 +769,7 @@ inv_error_t inv_build_accel(const long *accel, int status, inv_time_t timestamp)
     sensors.accel.timestamp_prev = sensors.accel.timestamp;
     sensors.accel.timestamp = timestamp;
 
+    INV_PROF_END(INV_PROF_BUILD_ACCEL, start);
     return INV_SUCCESS;
 }
 
@@ -647,14 +782,11 @@ inv_error_t inv_build_accel(const long *accel, int status, inv_time_t timestamp)
 */
 inv_error_t inv_build_gyro(const short *gyro, inv_time_t timestamp)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_GYRO;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(gyro, sizeof(gyro[0]), 3, inv_data_builder.file);
-        fwrite(&timestamp, sizeof(timestamp), 1, inv_data_builder.file);
+    INV_PROF_START(start);
+    if (inv_db_tracing()) {
+        long data[3] = { gyro[0], gyro[1], gyro[2] };
+        inv_trace_write(PLAYBACK_DBG_TYPE_GYRO, 0, data, 3, timestamp);
     }
-#endif
 
     memcpy(sensors.gyro.raw, gyro, 3 * sizeof(short));
     sensors.gyro.status |= INV_NEW_DATA | INV_RAW_DATA | INV_SENSOR_ON;
@@ -662,6 +794,7 @@ inv_error_t inv_build_gyro(const short *gyro, inv_time_t timestamp)
     sensors.gyro.timestamp = timestamp;
     inv_apply_calibration(&sensors.gyro, inv_data_builder.save.gyro_bias);
 
+    INV_PROF_END(INV_PROF_BUILD_GYRO, start);
     return INV_SUCCESS;
 }
 
@@ -679,14 +812,11 @@ inv_error_t inv_build_gyro(const short *gyro, inv_time_t timestamp)
 inv_error_t inv_build_compass(const long *compass, int status,
                               inv_time_t timestamp)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_COMPASS;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(compass, sizeof(compass[0]), 3, inv_data_builder.file);
-        fwrite(&timestamp, sizeof(timestamp), 1, inv_data_builder.file);
-    }
-#endif
+    INV_PROF_START(start);
+
+    inv_data_generation++;
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_COMPASS, status, compass, 3, timestamp);
 
     if ((status & INV_CALIBRATED) == 0) {
         long data[3];
@@ -709,6 +839,7 @@ inv_error_t inv_build_compass(const long *compass, int status,
     sensors.compass.timestamp = timestamp;
     sensors.compass.status |= INV_NEW_DATA | INV_SENSOR_ON;
 
+    INV_PROF_END(INV_PROF_BUILD_COMPASS, start);
     return INV_SUCCESS;
 }
 
@@ -720,20 +851,18 @@ inv_error_t inv_build_compass(const long *compass, int status,
  */
 inv_error_t inv_build_temp(const long temp, inv_time_t timestamp)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_TEMPERATURE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(&temp, sizeof(temp), 1, inv_data_builder.file);
-        fwrite(&timestamp, sizeof(timestamp), 1, inv_data_builder.file);
-    }
-#endif
+    INV_PROF_START(start);
+
+    inv_data_generation++;
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_TEMPERATURE, 0, &temp, 1, timestamp);
     sensors.temp.calibrated[0] = temp;
     sensors.temp.status |= INV_NEW_DATA | INV_RAW_DATA | INV_SENSOR_ON;
     sensors.temp.timestamp_prev = sensors.temp.timestamp;
     sensors.temp.timestamp = timestamp;
     /* TODO: Apply scale, remove offset. */
 
+    INV_PROF_END(INV_PROF_BUILD_TEMP, start);
     return INV_SUCCESS;
 }
 /** quaternion data
@@ -748,20 +877,18 @@ inv_error_t inv_build_temp(const long temp, inv_time_t timestamp)
 */
 inv_error_t inv_build_quat(const long *quat, int status, inv_time_t timestamp)
 {
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_QUAT;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-        fwrite(quat, sizeof(quat[0]), 4, inv_data_builder.file);
-        fwrite(&timestamp, sizeof(timestamp), 1, inv_data_builder.file);
-    }
-#endif
+    INV_PROF_START(start);
+
+    inv_data_generation++;
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_QUAT, status, quat, 4, timestamp);
 
     memcpy(sensors.quat.raw, quat, sizeof(sensors.quat.raw));
     sensors.quat.timestamp = timestamp;
     sensors.quat.status |= INV_NEW_DATA | INV_RAW_DATA | INV_SENSOR_ON;
     sensors.quat.status |= (INV_BIAS_APPLIED & status);
 
+    INV_PROF_END(INV_PROF_BUILD_QUAT, start);
     return INV_SUCCESS;
 }
 
@@ -770,6 +897,8 @@ inv_error_t inv_build_quat(const long *quat, int status, inv_time_t timestamp)
 */
 void inv_accel_was_turned_off()
 {
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_ACCEL_OFF, 0, NULL, 0, 0);
     sensors.accel.status = 0;
 }
 
@@ -778,6 +907,8 @@ void inv_accel_was_turned_off()
 */
 void inv_compass_was_turned_off()
 {
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_COMPASS_OFF, 0, NULL, 0, 0);
     sensors.compass.status = 0;
 }
 
@@ -786,6 +917,8 @@ void inv_compass_was_turned_off()
 */
 void inv_quaternion_sensor_was_turned_off(void)
 {
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_QUAT_OFF, 0, NULL, 0, 0);
     sensors.quat.status = 0;
 }
 
@@ -794,6 +927,8 @@ void inv_quaternion_sensor_was_turned_off(void)
 */
 void inv_gyro_was_turned_off()
 {
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_GYRO_OFF, 0, NULL, 0, 0);
     sensors.gyro.status = 0;
 }
 
@@ -802,9 +937,116 @@ void inv_gyro_was_turned_off()
  */
 void inv_temperature_was_turned_off()
 {
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_TEMP_OFF, 0, NULL, 0, 0);
     sensors.temp.status = 0;
 }
 
+/** Returns a counter that changes whenever values derived from the sensor
+* data may change: on every inv_build_*, calibration update and
+* inv_execute_on_data(). Caches of derived outputs are valid as long as it
+* has not moved.
+*/
+unsigned int inv_get_data_generation(void)
+{
+    return inv_data_generation;
+}
+
+/** Rebuilds the callback list of every mode, so inv_execute_on_data() does
+* not have to test data_required on each sample.
+*/
+static void inv_build_dispatch(void)
+{
+    int mode, kk, nn;
+
+    for (mode = 0; mode < INV_DATA_MODES; ++mode) {
+        nn = 0;
+        for (kk = 0; kk < inv_data_builder.num_cb; ++kk) {
+            if (mode & inv_data_builder.process[kk].data_required)
+                inv_data_builder.dispatch[mode][nn++] = (unsigned char)kk;
+        }
+        inv_data_builder.num_dispatch[mode] = (unsigned char)nn;
+    }
+}
+
+/** Turns timing of the data callbacks and inv_build_* entry points on or
+* off. Profiling is only compiled in when INV_PROFILE is defined, when off
+* it costs one test per callback.
+* @param[in] enable Non-zero to start recording.
+* @return INV_SUCCESS or INV_ERROR_FEATURE_NOT_IMPLEMENTED.
+*/
+inv_error_t inv_enable_profile(int enable)
+{
+#ifdef INV_PROFILE
+    inv_data_builder.profile = enable;
+    return INV_SUCCESS;
+#else
+    (void)enable;
+    return INV_ERROR_FEATURE_NOT_IMPLEMENTED;
+#endif
+}
+
+/** Clears the recorded profile of every entry point. */
+void inv_reset_profile(void)
+{
+#ifdef INV_PROFILE
+    int kk;
+
+    memset(inv_data_builder.build_prof, 0,
+           sizeof(inv_data_builder.build_prof));
+    for (kk = 0; kk < inv_data_builder.num_cb; ++kk)
+        memset(&inv_data_builder.process[kk].prof, 0,
+               sizeof(inv_data_builder.process[kk].prof));
+#endif
+}
+
+/** Copies the profile of the inv_build_* entry points followed by the data
+* callbacks in priority order. Times are in ns; an entry point running while
+* this is called may be seen half updated.
+* @param[out] profile Array of at least max entries, INV_MAX_PROFILE is
+*             enough for all of them.
+* @param[in] max Size of profile.
+* @return Number of entries filled, 0 when profiling is not compiled in.
+*/
+int inv_get_profile(struct inv_profile_t *profile, int max)
+{
+    int num = 0;
+#ifdef INV_PROFILE
+    const struct inv_prof_stat_t *stat;
+    int kk, nn;
+
+    for (kk = 0; kk < INV_PROF_NUM_BUILD + inv_data_builder.num_cb; ++kk) {
+        if (num >= max)
+            break;
+        if (kk < INV_PROF_NUM_BUILD) {
+            stat = &inv_data_builder.build_prof[kk];
+            profile[num].name = inv_prof_build_names[kk];
+            profile[num].priority = 0;
+        } else {
+            stat = &inv_data_builder.process[kk - INV_PROF_NUM_BUILD].prof;
+            profile[num].priority =
+                inv_data_builder.process[kk - INV_PROF_NUM_BUILD].priority;
+            profile[num].name = NULL;
+            for (nn = 0; nn < (int)ARRAY_SIZE(inv_prof_cb_names); ++nn) {
+                if (inv_prof_cb_names[nn].priority == profile[num].priority) {
+                    profile[num].name = inv_prof_cb_names[nn].name;
+                    break;
+                }
+            }
+        }
+        profile[num].calls = stat->calls;
+        profile[num].total_ns = stat->total_ns;
+        profile[num].max_ns = stat->max_ns;
+        profile[num].last_ns = stat->last_ns;
+        num++;
+    }
+#else
+    (void)profile;
+    (void)max;
+#endif
+    return num;
+}
+
 /** Registers to receive a callback when there is new sensor data.
 * @internal
 * @param[in] func Function pointer to receive callback when there is new sensor data
@@ -853,7 +1095,12 @@ inv_error_t inv_register_data_cb(
         inv_data_builder.process[kk].func = func;
         inv_data_builder.process[kk].priority = priority;
         inv_data_builder.process[kk].data_required = sensor_type;
+#ifdef INV_PROFILE
+        memset(&inv_data_builder.process[kk].prof, 0,
+               sizeof(inv_data_builder.process[kk].prof));
+#endif
         inv_data_builder.num_cb++;
+        inv_build_dispatch();
     } else {
         MPL_LOGE("Unable to add feature callback as too many were already registered\n");
         result = INV_ERROR_MEMORY_EXAUSTED;
@@ -886,6 +1133,7 @@ inv_error_t inv_unregister_data_cb(
                     inv_data_builder.process[nn];
             }
             inv_data_builder.num_cb--;
+            inv_build_dispatch();
             return INV_SUCCESS;
         }
     }
@@ -902,15 +1150,18 @@ inv_error_t inv_unregister_data_cb(
 inv_error_t inv_execute_on_data(void)
 {
     inv_error_t result, first_error;
-    int kk;
+    struct process_t *process;
+    const unsigned char *dispatch;
+    int kk, num;
     int mode;
-
-#ifdef INV_PLAYBACK_DBG
-    if (inv_data_builder.debug_mode == RD_RECORD) {
-        int type = PLAYBACK_DBG_TYPE_EXECUTE;
-        fwrite(&type, sizeof(type), 1, inv_data_builder.file);
-    }
+    INV_PROF_START(start);
+#ifdef INV_PROFILE
+    unsigned long long cb_start;
 #endif
+
+    inv_data_generation++;
+    if (inv_db_tracing())
+        inv_trace_write(PLAYBACK_DBG_TYPE_EXECUTE, 0, NULL, 0, 0);
     // Determine what new data we have
     mode = 0;
     if (sensors.gyro.status & INV_NEW_DATA)
@@ -926,17 +1177,26 @@ inv_error_t inv_execute_on_data(void)
 
     first_error = INV_SUCCESS;
 
-    for (kk = 0; kk < inv_data_builder.num_cb; ++kk) {
-        if (mode & inv_data_builder.process[kk].data_required) {
-            result = inv_data_builder.process[kk].func(&sensors);
-            if (result && !first_error) {
-                first_error = result;
-            }
+    dispatch = inv_data_builder.dispatch[mode];
+    num = inv_data_builder.num_dispatch[mode];
+    for (kk = 0; kk < num; ++kk) {
+        process = &inv_data_builder.process[dispatch[kk]];
+#ifdef INV_PROFILE
+        if (start) {
+            cb_start = inv_prof_now();
+            result = process->func(&sensors);
+            inv_prof_record(&process->prof, cb_start);
+        } else
+#endif
+        result = process->func(&sensors);
+        if (result && !first_error) {
+            first_error = result;
         }
     }
 
     inv_set_contiguous();
 
+    INV_PROF_END(INV_PROF_EXECUTE, start);
     return first_error;
 }
 
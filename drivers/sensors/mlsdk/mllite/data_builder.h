@@ -13,9 +13,6 @@
 extern "C" {
 #endif
 
-// Uncomment this flag to enable playback debug and record or playback scenarios
-//#define INV_PLAYBACK_DBG
-
 /** This is a new sample of accel data */
 #define INV_ACCEL_NEW 1
 /** This is a new sample of gyro data */
@@ -125,13 +122,7 @@ struct inv_sensor_cal_t {
     int status;
 };
 
-// Useful for debug record and playback
-typedef enum {
-    RD_NO_DEBUG,
-    RD_RECORD,
-    RD_PLAYBACK
-} rd_dbg_mode;
-
+// Record types of the data_trace.h format, values must not change
 typedef enum {
     PLAYBACK_DBG_TYPE_GYRO,
     PLAYBACK_DBG_TYPE_ACCEL,
@@ -148,7 +139,12 @@ typedef enum {
     PLAYBACK_DBG_TYPE_ACCEL_OFF,
     PLAYBACK_DBG_TYPE_COMPASS_OFF,
     PLAYBACK_DBG_TYPE_Q_SAMPLE_RATE,
-    PLAYBACK_DBG_TYPE_QUAT
+    PLAYBACK_DBG_TYPE_QUAT,
+    PLAYBACK_DBG_TYPE_TEMP_OFF,
+    PLAYBACK_DBG_TYPE_QUAT_OFF,
+    PLAYBACK_DBG_TYPE_G_BIAS,
+    PLAYBACK_DBG_TYPE_A_BIAS,
+    PLAYBACK_DBG_TYPE_C_BIAS
 } inv_rd_dbg_states;
 
 /** Change this key if the definition of the struct inv_db_save_t changes.
@@ -178,11 +174,25 @@ struct inv_db_save_t {
 /** Maximum number of data callbacks that are supported. Safe to increase if needed.*/
 #define INV_MAX_DATA_CB 20
 
-#ifdef INV_PLAYBACK_DBG
-#include <stdio.h>
-void inv_turn_on_data_logging(FILE *file);
+/** Entries returned by inv_get_profile(): the inv_build_* entry points,
+* inv_execute_on_data() and every data callback.
+*/
+#define INV_MAX_PROFILE (INV_MAX_DATA_CB + 6)
+
+/** Cost of one entry point as recorded while profiling, in ns */
+struct inv_profile_t {
+    /** Function or feature name, NULL for an unknown callback priority */
+    const char *name;
+    /** Priority of a data callback, 0 for the inv_build_* entry points */
+    int priority;
+    unsigned long calls;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long last_ns;
+};
+
+inv_error_t inv_turn_on_data_logging(const char *path);
 void inv_turn_off_data_logging();
-#endif
 
 void inv_set_gyro_orientation_and_scale(int orientation, long sensitivity);
 void inv_set_accel_orientation_and_scale(int orientation,
@@ -206,6 +216,9 @@ inv_error_t inv_register_data_cb(inv_error_t (*func)
                                  int sensor_type);
 inv_error_t inv_unregister_data_cb(inv_error_t (*func)
                                    (struct inv_sensor_cal_t * data));
+inv_error_t inv_enable_profile(int enable);
+void inv_reset_profile(void);
+int inv_get_profile(struct inv_profile_t *profile, int max);
 
 inv_error_t inv_build_gyro(const short *gyro, inv_time_t timestamp);
 inv_error_t inv_build_compass(const long *compass, int status,
@@ -215,6 +228,7 @@ inv_error_t inv_build_accel(const long *accel, int status,
 inv_error_t inv_build_temp(const long temp, inv_time_t timestamp);
 inv_error_t inv_build_quat(const long *quat, int status, inv_time_t timestamp);
 inv_error_t inv_execute_on_data(void);
+unsigned int inv_get_data_generation(void);
 
 void inv_get_compass_bias(long *bias);
 
@@ -246,6 +260,7 @@ void inv_gyro_was_turned_off(void);
 void inv_accel_was_turned_off(void);
 void inv_compass_was_turned_off(void);
 void inv_quaternion_sensor_was_turned_off(void);
+void inv_temperature_was_turned_off(void);
 inv_error_t inv_init_data_builder(void);
 long inv_get_gyro_sensitivity(void);
 long inv_get_accel_sensitivity(void);
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "data_builder.h"
+#include "data_trace.h"
+
+#include "log.h"
+#undef MPL_LOG_TAG
+#define MPL_LOG_TAG "MPL"
+
+int inv_trace_on;
+
+/*
+ * Single producer, single consumer ring: the producer is whoever feeds the
+ * data builder, which is already serialized, the consumer is the flush
+ * thread.  head and tail only ever grow, their difference is the fill.
+ */
+static struct {
+    int fd;
+    int wake_fd;
+    int stop;
+    pthread_t thread;
+    unsigned int head;
+    unsigned int tail;
+    uint32_t records;
+    uint32_t dropped;
+    struct inv_trace_record_t ring[INV_TRACE_RING_SIZE];
+} inv_trace;
+
+static int inv_trace_write_all(const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = write(inv_trace.fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/** Writes out everything the producer published so far. */
+static void inv_trace_flush(void)
+{
+    unsigned int head = __atomic_load_n(&inv_trace.head, __ATOMIC_ACQUIRE);
+    unsigned int tail = inv_trace.tail;
+    unsigned int start, count;
+
+    while (tail != head) {
+        start = tail & (INV_TRACE_RING_SIZE - 1);
+        count = head - tail;
+        if (count > INV_TRACE_RING_SIZE - start)
+            count = INV_TRACE_RING_SIZE - start;
+        if (inv_trace_write_all(&inv_trace.ring[start],
+                                count * sizeof(inv_trace.ring[0]))) {
+            MPL_LOGE("trace write failed (%s)\n", strerror(errno));
+            /* keep draining so the producer is not stalled */
+        }
+        inv_trace.records += count;
+        tail += count;
+        __atomic_store_n(&inv_trace.tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static void *inv_trace_thread(void *arg)
+{
+    struct pollfd pfd;
+    uint64_t val;
+
+    (void)arg;
+    pfd.fd = inv_trace.wake_fd;
+    pfd.events = POLLIN;
+    while (!__atomic_load_n(&inv_trace.stop, __ATOMIC_ACQUIRE)) {
+        if (poll(&pfd, 1, INV_TRACE_FLUSH_MS) > 0)
+            read(inv_trace.wake_fd, &val, sizeof(val));
+        inv_trace_flush();
+    }
+    inv_trace_flush();
+    return NULL;
+}
+
+/** Starts recording the data builder inputs to a new trace file.
+* @param[in] path File to create, truncated if it exists.
+* @return INV_SUCCESS or an error code.
+*/
+inv_error_t inv_trace_open(const char *path)
+{
+    struct inv_trace_header_t header;
+
+    if (inv_trace_enabled())
+        return INV_ERROR_INVALID_PARAMETER;
+
+    inv_trace.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (inv_trace.fd < 0) {
+        MPL_LOGE("cannot create trace %s (%s)\n", path, strerror(errno));
+        return INV_ERROR_FILE_OPEN;
+    }
+    inv_trace.wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (inv_trace.wake_fd < 0)
+        goto err_close;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INV_TRACE_MAGIC, sizeof(header.magic));
+    header.version = INV_TRACE_VERSION;
+    header.record_size = sizeof(struct inv_trace_record_t);
+    if (inv_trace_write_all(&header, sizeof(header)))
+        goto err_wake;
+
+    inv_trace.head = 0;
+    inv_trace.tail = 0;
+    inv_trace.records = 0;
+    inv_trace.dropped = 0;
+    inv_trace.stop = 0;
+    if (pthread_create(&inv_trace.thread, NULL, inv_trace_thread, NULL))
+        goto err_wake;
+
+    __atomic_store_n(&inv_trace_on, 1, __ATOMIC_RELEASE);
+    MPL_LOGI("tracing data builder input to %s\n", path);
+    return INV_SUCCESS;
+
+err_wake:
+    close(inv_trace.wake_fd);
+err_close:
+    MPL_LOGE("cannot start trace %s (%s)\n", path, strerror(errno));
+    close(inv_trace.fd);
+    return INV_ERROR_FILE_WRITE;
+}
+
+/** Stops recording, flushes the ring and completes the header. Must not
+* race with the calls being recorded.
+*/
+void inv_trace_close(void)
+{
+    struct inv_trace_header_t header;
+    uint64_t one = 1;
+
+    if (!inv_trace_enabled())
+        return;
+
+    __atomic_store_n(&inv_trace_on, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&inv_trace.stop, 1, __ATOMIC_RELEASE);
+    write(inv_trace.wake_fd, &one, sizeof(one));
+    pthread_join(inv_trace.thread, NULL);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INV_TRACE_MAGIC, sizeof(header.magic));
+    header.version = INV_TRACE_VERSION;
+    header.record_size = sizeof(struct inv_trace_record_t);
+    header.records = inv_trace.records;
+    header.dropped = inv_trace.dropped;
+    if (pwrite(inv_trace.fd, &header, sizeof(header), 0) != sizeof(header))
+        MPL_LOGE("cannot complete trace header (%s)\n", strerror(errno));
+    if (inv_trace.dropped)
+        MPL_LOGW("trace lost %u records\n", inv_trace.dropped);
+
+    close(inv_trace.wake_fd);
+    close(inv_trace.fd);
+}
+
+/** Appends a record to the ring, never blocks.
+* @param[in] type One of PLAYBACK_DBG_TYPE_*.
+* @param[in] count Number of values in data, up to 4.
+*/
+void inv_trace_write(int type, int status, const long *data, int count,
+                     inv_time_t timestamp)
+{
+    struct inv_trace_record_t *record;
+    unsigned int head = inv_trace.head;
+    unsigned int tail = __atomic_load_n(&inv_trace.tail, __ATOMIC_ACQUIRE);
+    uint64_t one = 1;
+    int ii;
+
+    if (head - tail >= INV_TRACE_RING_SIZE) {
+        inv_trace.dropped++;
+        return;
+    }
+
+    record = &inv_trace.ring[head & (INV_TRACE_RING_SIZE - 1)];
+    memset(record, 0, sizeof(*record));
+    record->type = (uint16_t)type;
+    record->status = (uint16_t)status;
+    for (ii = 0; ii < count && ii < 4; ++ii)
+        record->data[ii] = (int32_t)data[ii];
+    record->timestamp = timestamp;
+    __atomic_store_n(&inv_trace.head, head + 1, __ATOMIC_RELEASE);
+
+    /* wake the flush thread once per half ring, not per record */
+    if (head + 1 - tail == INV_TRACE_RING_SIZE / 2)
+        write(inv_trace.wake_fd, &one, sizeof(one));
+}
+
+/** Checks that a trace header can be replayed by this build. */
+inv_error_t inv_trace_check_header(const struct inv_trace_header_t *header)
+{
+    if (memcmp(header->magic, INV_TRACE_MAGIC, sizeof(header->magic)))
+        return INV_ERROR_INVALID_PARAMETER;
+    if (header->version != INV_TRACE_VERSION ||
+            header->record_size != sizeof(struct inv_trace_record_t))
+        return INV_ERROR_FEATURE_NOT_IMPLEMENTED;
+    return INV_SUCCESS;
+}
+
+/** Replays one record into the data builder, as the recorded call did.
+* @return The result of the replayed call, INV_ERROR_INVALID_PARAMETER for
+*         an unknown type.
+*/
+inv_error_t inv_trace_apply(const struct inv_trace_record_t *record)
+{
+    long data[4];
+    short gyro[3];
+    int ii;
+
+    for (ii = 0; ii < 4; ++ii)
+        data[ii] = record->data[ii];
+
+    switch (record->type) {
+    case PLAYBACK_DBG_TYPE_GYRO:
+        for (ii = 0; ii < 3; ++ii)
+            gyro[ii] = (short)data[ii];
+        return inv_build_gyro(gyro, record->timestamp);
+    case PLAYBACK_DBG_TYPE_ACCEL:
+        return inv_build_accel(data, record->status, record->timestamp);
+    case PLAYBACK_DBG_TYPE_COMPASS:
+        return inv_build_compass(data, record->status, record->timestamp);
+    case PLAYBACK_DBG_TYPE_TEMPERATURE:
+        return inv_build_temp(data[0], record->timestamp);
+    case PLAYBACK_DBG_TYPE_QUAT:
+        return inv_build_quat(data, record->status, record->timestamp);
+    case PLAYBACK_DBG_TYPE_EXECUTE:
+        return inv_execute_on_data();
+    case PLAYBACK_DBG_TYPE_A_ORIENT:
+        inv_set_accel_orientation_and_scale(data[0], data[1]);
+        break;
+    case PLAYBACK_DBG_TYPE_G_ORIENT:
+        inv_set_gyro_orientation_and_scale(data[0], data[1]);
+        break;
+    case PLAYBACK_DBG_TYPE_C_ORIENT:
+        inv_set_compass_orientation_and_scale(data[0], data[1]);
+        break;
+    case PLAYBACK_DBG_TYPE_A_SAMPLE_RATE:
+        inv_set_accel_sample_rate(data[0]);
+        break;
+    case PLAYBACK_DBG_TYPE_C_SAMPLE_RATE:
+        inv_set_compass_sample_rate(data[0]);
+        break;
+    case PLAYBACK_DBG_TYPE_G_SAMPLE_RATE:
+        inv_set_gyro_sample_rate(data[0]);
+        break;
+    case PLAYBACK_DBG_TYPE_Q_SAMPLE_RATE:
+        inv_set_quat_sample_rate(data[0]);
+        break;
+    case PLAYBACK_DBG_TYPE_GYRO_OFF:
+        inv_gyro_was_turned_off();
+        break;
+    case PLAYBACK_DBG_TYPE_ACCEL_OFF:
+        inv_accel_was_turned_off();
+        break;
+    case PLAYBACK_DBG_TYPE_COMPASS_OFF:
+        inv_compass_was_turned_off();
+        break;
+    case PLAYBACK_DBG_TYPE_TEMP_OFF:
+        inv_temperature_was_turned_off();
+        break;
+    case PLAYBACK_DBG_TYPE_QUAT_OFF:
+        inv_quaternion_sensor_was_turned_off();
+        break;
+    case PLAYBACK_DBG_TYPE_G_BIAS:
+        inv_set_gyro_bias(data, record->status);
+        break;
+    case PLAYBACK_DBG_TYPE_A_BIAS:
+        inv_set_accel_bias(data, record->status);
+        break;
+    case PLAYBACK_DBG_TYPE_C_BIAS:
+        inv_set_compass_bias(data, record->status);
+        break;
+    default:
+        return INV_ERROR_INVALID_PARAMETER;
+    }
+    return INV_SUCCESS;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INV_DATA_TRACE_H__
+#define INV_DATA_TRACE_H__
+
+#include <stdint.h>
+
+#include "mltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary trace of the data builder inputs, replayable with
+ * inv_trace_apply().
+ *
+ * A trace is one inv_trace_header_t followed by fixed size records in
+ * little endian.  Every field has an explicit width so a trace recorded on
+ * the 32-bit target replays on a 64-bit host.  Record types are the
+ * PLAYBACK_DBG_TYPE_* values of data_builder.h; any change to the record
+ * layout or to the meaning of a type must bump INV_TRACE_VERSION.
+ *
+ * Recording only appends to an in-memory ring; a flush thread writes it to
+ * the file when half full or every INV_TRACE_FLUSH_MS.  Records that do not
+ * fit in the ring are counted in the header and lost.
+ */
+
+#define INV_TRACE_MAGIC     "INVT"
+#define INV_TRACE_VERSION   1
+
+/* records, power of two */
+#define INV_TRACE_RING_SIZE 4096
+#define INV_TRACE_FLUSH_MS  200
+
+struct inv_trace_header_t {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    /** Records written and lost, set when the trace is closed */
+    uint32_t records;
+    uint32_t dropped;
+};
+
+struct inv_trace_record_t {
+    uint16_t type;
+    /** status argument of inv_build_accel/compass/quat, bias accuracy */
+    uint16_t status;
+    /** sample, {orientation, sensitivity} or {sample rate in us} */
+    int32_t data[4];
+    int32_t reserved;
+    int64_t timestamp;
+};
+
+extern int inv_trace_on;
+
+static inline int inv_trace_enabled(void)
+{
+    return __atomic_load_n(&inv_trace_on, __ATOMIC_RELAXED);
+}
+
+inv_error_t inv_trace_open(const char *path);
+void inv_trace_close(void);
+void inv_trace_write(int type, int status, const long *data, int count,
+                     inv_time_t timestamp);
+
+inv_error_t inv_trace_check_header(const struct inv_trace_header_t *header);
+inv_error_t inv_trace_apply(const struct inv_trace_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INV_DATA_TRACE_H__
@@ -24,6 +24,7 @@
 #include "start_manager.h"
 #include "data_builder.h"
 #include "results_holder.h"
+#include "mpl_context.h"
 
 struct hal_output_t {
     int accuracy_mag;    /**< Compass accuracy */
@@ -42,9 +43,35 @@ struct hal_output_t {
     int nine_axis_status;
     inv_biquad_filter_t lp_filter[3];
     float compass_float[3];
+    /* rotation and orientation from nav_quat, computed on first use */
+    unsigned int cache_generation;
+    int cache_valid;
+    float rotation[3][3];
+    float orientation[3];
 };
 
-static struct hal_output_t hal_out;
+#define HAL_CACHE_ROTATION      0x01
+#define HAL_CACHE_ORIENTATION   0x02
+
+struct hal_output_t inv_default_hal_out;
+const size_t inv_hal_out_state_size = sizeof(struct hal_output_t);
+
+/* outputs of the calling thread's MPL context */
+#define hal_out (*inv_mpl_ctx()->hal_out)
+
+/** Returns the cached bits of what, the cache lasts one data generation and
+* is dropped whenever nav_quat is updated.
+*/
+static int hal_cached(int what)
+{
+    unsigned int generation = inv_get_data_generation();
+
+    if (hal_out.cache_generation != generation) {
+        hal_out.cache_generation = generation;
+        hal_out.cache_valid = 0;
+    }
+    return hal_out.cache_valid & what;
+}
 
 /** Acceleration (m/s^2) in body frame.
 * @param[out] values Acceleration in m/s^2 includes gravity. So while not in motion, it
@@ -257,30 +284,39 @@ static void inv_get_rotation(float r[3][3])
     long rot[9];
     float conv = 1.f / (1L<<30);
 
-    inv_quaternion_to_rotation(hal_out.nav_quat, rot);
-    r[0][0] = rot[0]*conv;
-    r[0][1] = rot[1]*conv;
-    r[0][2] = rot[2]*conv;
-    r[1][0] = rot[3]*conv;
-    r[1][1] = rot[4]*conv;
-    r[1][2] = rot[5]*conv;
-    r[2][0] = rot[6]*conv;
-    r[2][1] = rot[7]*conv;
-    r[2][2] = rot[8]*conv;
+    if (!hal_cached(HAL_CACHE_ROTATION)) {
+        inv_quaternion_to_rotation(hal_out.nav_quat, rot);
+        hal_out.rotation[0][0] = rot[0]*conv;
+        hal_out.rotation[0][1] = rot[1]*conv;
+        hal_out.rotation[0][2] = rot[2]*conv;
+        hal_out.rotation[1][0] = rot[3]*conv;
+        hal_out.rotation[1][1] = rot[4]*conv;
+        hal_out.rotation[1][2] = rot[5]*conv;
+        hal_out.rotation[2][0] = rot[6]*conv;
+        hal_out.rotation[2][1] = rot[7]*conv;
+        hal_out.rotation[2][2] = rot[8]*conv;
+        hal_out.cache_valid |= HAL_CACHE_ROTATION;
+    }
+    memcpy(r, hal_out.rotation, sizeof(hal_out.rotation));
 }
 
 static void google_orientation(float *g)
 {
     float rad2deg = (float)(180.0 / M_PI);
     float R[3][3];
+    float *o = hal_out.orientation;
 
-    inv_get_rotation(R);
+    if (!hal_cached(HAL_CACHE_ORIENTATION)) {
+        inv_get_rotation(R);
 
-    g[0] = atan2f(-R[1][0], R[0][0]) * rad2deg;
-    g[1] = atan2f(-R[2][1], R[2][2]) * rad2deg;
-    g[2] = asinf ( R[2][0])          * rad2deg;
-    if (g[0] < 0)
-        g[0] += 360;
+        o[0] = atan2f(-R[1][0], R[0][0]) * rad2deg;
+        o[1] = atan2f(-R[2][1], R[2][2]) * rad2deg;
+        o[2] = asinf ( R[2][0])          * rad2deg;
+        if (o[0] < 0)
+            o[0] += 360;
+        hal_out.cache_valid |= HAL_CACHE_ORIENTATION;
+    }
+    memcpy(g, o, sizeof(hal_out.orientation));
 }
 
 
@@ -332,6 +368,7 @@ inv_error_t inv_generate_hal_outputs(struct inv_sensor_cal_t *sensor_cal)
 
     inv_get_quaternion_set(hal_out.nav_quat, &hal_out.accuracy_quat,
                            &hal_out.nav_timestamp);
+    hal_out.cache_valid = 0;
     hal_out.gyro_status = sensor_cal->gyro.status;
     hal_out.accel_status = sensor_cal->accel.status;
     hal_out.compass_status = sensor_cal->compass.status;
@@ -17,7 +17,10 @@
  *      @file     ml_load_dmp.c
  *      @brief    functions for writing dmp firmware.
  */
+#include <errno.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 #undef MPL_LOG_TAG
 #define MPL_LOG_TAG "MPL-loaddmp"
@@ -32,7 +35,8 @@
 #define NUM_LOCAL_KEYS (sizeof(dmpTConfig)/sizeof(dmpTConfig[0]))
 #define DMP_CODE_SIZE 3058
 
-static const unsigned char dmpMemory[DMP_CODE_SIZE] = {
+static const unsigned char dmpMemory[DMP_CODE_SIZE]
+    __attribute__((aligned(64))) = {
    /* bank # 0 */
     0x00, 0x00, 0x70, 0x00, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00, 0x02, 0x00, 0x03, 0x00, 0x00, 
     0x00, 0x65, 0x00, 0x54, 0xff, 0xef, 0x00, 0x00, 0xfa, 0x80, 0x00, 0x0b, 0x12, 0x82, 0x00, 0x01, 
@@ -240,40 +244,39 @@ static const unsigned char dmpMemory[DMP_CODE_SIZE] = {
     0xf1, 0xff
 };
 
-#define DMP_VERSION (dmpMemory)
-
-inv_error_t inv_write_dmp_data(FILE *fd, const unsigned char *dmp, size_t len)
+static long long inv_dmp_now_us(void)
 {
-    inv_error_t result = INV_SUCCESS;
-    int bytesWritten = 0;
-   
-    if (len <= 0) {
-        MPL_LOGE("Nothing to write");
-        return INV_ERROR_FILE_WRITE;
-    }
-    else {
-        MPL_LOGI("dmp firmware size to write = %d", len);
-    }
-    if ( fd == NULL ) {
-        return INV_ERROR_FILE_OPEN;
-    }
-    bytesWritten = fwrite(dmp, 1, len, fd);
-    if (bytesWritten != len) {
-        MPL_LOGE("bytes written (%d) don't match requested length (%d)\n",
-                 bytesWritten, len);
-        result = INV_ERROR_FILE_WRITE;
-    }
-    else {
-        MPL_LOGI("Bytes written = %d", bytesWritten);
-    }
-    return result;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
 
+/**
+ *  @brief  Writes the built-in DMP image in one pwrite() from its aligned
+ *          buffer, bypassing the stdio buffer of fd.
+ *  @param  fd  dmp_firmware sysfs node, opened for writing.
+ *  @return INV_SUCCESS or an error code.
+ */
 inv_error_t inv_load_dmp(FILE *fd)
 {
-    inv_error_t result = INV_SUCCESS;
-    result = inv_write_dmp_data(fd, DMP_VERSION, DMP_CODE_SIZE);
-    return result;
+    long long start = inv_dmp_now_us();
+    ssize_t n;
+
+    if (fd == NULL)
+        return INV_ERROR_FILE_OPEN;
+    fflush(fd);
+    do {
+        n = pwrite(fileno(fd), dmpMemory, DMP_CODE_SIZE, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n != DMP_CODE_SIZE) {
+        MPL_LOGE("dmp write returned %d of %d bytes (%d)\n",
+                 (int)n, DMP_CODE_SIZE, errno);
+        return INV_ERROR_FILE_WRITE;
+    }
+    LOADDMP_LOG("dmp firmware written, %d bytes in %lld us",
+                DMP_CODE_SIZE, inv_dmp_now_us() - start);
+    return INV_SUCCESS;
 }
 
 /**
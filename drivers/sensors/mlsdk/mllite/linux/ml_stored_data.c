@@ -24,7 +24,13 @@
  *                Typically, these functions process stored calibration data.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "log.h"
 #undef MPL_LOG_TAG
@@ -114,90 +120,150 @@ const char *inv_get_cal_protected_path(void)
         return NULL;
 }
 
-inv_error_t inv_copy_cal(size_t len)
+/* maps a calibration file read only, unmap with munmap(*cal, *len) */
+static inv_error_t inv_map_cal(const char *path, unsigned char **cal,
+                               size_t *len)
 {
-    FILE *default_fp, *protected_fp;
-    int bytesRead;
-    unsigned char cal[len];
+    struct stat st;
+    void *map;
+    int fd;
 
-    if (!inv_exist_cal_default_path() || !inv_exist_cal_protected_path())
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
         return INV_ERROR_FILE_OPEN;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return INV_ERROR_FILE_READ;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        MPL_LOGE("Cannot map \"%s\" (%d)\n", path, errno);
+        return INV_ERROR_FILE_READ;
+    }
+    *cal = map;
+    *len = st.st_size;
+    return INV_SUCCESS;
+}
 
-    default_fp = fopen(mpl_cal_default_path, "rb");
-    if (!default_fp) {
-        protected_fp = fopen(mpl_cal_protected_path, "rb");
-        if (!protected_fp)
-            return INV_ERROR_FILE_OPEN;
-        else {
-            default_fp = fopen(mpl_cal_default_path , "wb");
-            if (!default_fp) {
-                fclose(protected_fp);
-                return INV_ERROR_FILE_OPEN;
-            }
-            bytesRead = fread(cal, 1, len, protected_fp);
-            fwrite(cal, 1, bytesRead, default_fp);
-            fclose(default_fp);
-            fclose(protected_fp);
-        }
-    } else
-        fclose(default_fp);
+/* fsync the directory holding path so a rename into it is durable */
+static void inv_sync_cal_dir(const char *path)
+{
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    size_t n;
+    int fd;
+
+    if (!slash)
+        return;
+    n = slash == path ? 1 : (size_t)(slash - path);
+    memcpy(dir, path, n);
+    dir[n] = 0;
+    fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
 
+/* replaces path with cal: a crash leaves either the old or the new file */
+static inv_error_t inv_replace_cal(const char *path,
+                                   const unsigned char *cal, size_t len)
+{
+    char tmp[PATH_MAX + 4];
+    inv_error_t result = INV_SUCCESS;
+    ssize_t n;
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        MPL_LOGE("Cannot open file \"%s\" for write (%d)\n", tmp, errno);
+        return INV_ERROR_FILE_OPEN;
+    }
+    while (len) {
+        n = write(fd, cal, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            result = INV_ERROR_FILE_WRITE;
+            break;
+        }
+        cal += n;
+        len -= n;
+    }
+    if (result == INV_SUCCESS && fsync(fd) < 0)
+        result = INV_ERROR_FILE_WRITE;
+    if (close(fd) < 0)
+        result = INV_ERROR_FILE_WRITE;
+    if (result == INV_SUCCESS && rename(tmp, path) < 0)
+        result = INV_ERROR_FILE_WRITE;
+    if (result != INV_SUCCESS) {
+        MPL_LOGE("Cannot write \"%s\" (%d)\n", path, errno);
+        unlink(tmp);
+        return result;
+    }
+    inv_sync_cal_dir(path);
     return INV_SUCCESS;
 }
 
-inv_error_t inv_read_cal(unsigned char **calData, size_t *bytesRead)
+/** Seeds the default calibration file from the protected one when there is
+* none yet.
+* @param len Unused, the whole protected file is copied.
+*/
+inv_error_t inv_copy_cal(size_t len)
 {
-    FILE *fp;
-    inv_error_t result = INV_SUCCESS;
-    size_t fsize;
+    unsigned char *cal;
+    size_t size;
+    inv_error_t result;
 
-    if (inv_copy_cal(*bytesRead) != INV_SUCCESS)
+    (void)len;
+    if (!inv_exist_cal_default_path() || !inv_exist_cal_protected_path())
         return INV_ERROR_FILE_OPEN;
 
-    if (!inv_exist_cal_default_path())
+    if (access(mpl_cal_default_path, F_OK) == 0)
+        return INV_SUCCESS;
+
+    result = inv_map_cal(mpl_cal_protected_path, &cal, &size);
+    if (result != INV_SUCCESS)
         return INV_ERROR_FILE_OPEN;
+    result = inv_replace_cal(mpl_cal_default_path, cal, size);
+    munmap(cal, size);
+    return result;
+}
 
-    fp = fopen(mpl_cal_default_path, "rb");
+inv_error_t inv_read_cal(unsigned char **calData, size_t *bytesRead)
+{
+    unsigned char *cal;
+    size_t size;
+    inv_error_t result;
 
-    if (fp == NULL) {
-        MPL_LOGE("Cannot open file \"%s\" for read\n", MLCAL_FILE);
+    if (inv_copy_cal(*bytesRead) != INV_SUCCESS)
         return INV_ERROR_FILE_OPEN;
-    }
 
-    // obtain file size
-    fseek (fp, 0 , SEEK_END);
-    fsize = ftell (fp);
-    rewind (fp);
+    result = inv_map_cal(mpl_cal_default_path, &cal, &size);
+    if (result != INV_SUCCESS) {
+        MPL_LOGE("Cannot open file \"%s\" for read\n", MLCAL_FILE);
+        return result;
+    }
 
-    *calData = (unsigned char *)inv_malloc(fsize);
-    if (*calData==NULL) {
+    *calData = (unsigned char *)inv_malloc(size);
+    if (*calData == NULL) {
         MPL_LOGE("Could not allocate buffer of %d bytes - "
-                 "aborting\n", fsize);
-        fclose(fp);
+                 "aborting\n", size);
+        munmap(cal, size);
         return INV_ERROR_MEMORY_EXAUSTED;
     }
-
-    *bytesRead = fread(*calData, 1, fsize, fp);
-    if (*bytesRead != fsize) {
-        MPL_LOGE("bytes read (%d) don't match file size (%d)\n",
-                 *bytesRead, fsize);
-        result = INV_ERROR_FILE_READ;
-        goto read_cal_end;
-    }
-    else {
-        MPL_LOGI("Bytes read = %d", *bytesRead);
-    }
-
-read_cal_end:
-    fclose(fp);
-    return result;
+    memcpy(*calData, cal, size);
+    *bytesRead = size;
+    munmap(cal, size);
+    MPL_LOGI("Bytes read = %d", *bytesRead);
+    return INV_SUCCESS;
 }
 
 inv_error_t inv_write_cal(unsigned char *cal, size_t len)
 {
-    FILE *fp;
-    size_t bytesWritten;
-    inv_error_t result = INV_SUCCESS;
+    inv_error_t result;
 
     if (len <= 0) {
         MPL_LOGE("Nothing to write");
@@ -210,21 +276,9 @@ inv_error_t inv_write_cal(unsigned char *cal, size_t len)
     if (!inv_exist_cal_default_path())
         return INV_ERROR_FILE_OPEN;
 
-    fp = fopen(mpl_cal_default_path, "wb");
-    if (fp == NULL) {
-        MPL_LOGE("Cannot open file \"%s\" for write\n", MLCAL_FILE);
-        return INV_ERROR_FILE_OPEN;
-    }
-    bytesWritten = fwrite(cal, 1, len, fp);
-    if (bytesWritten != len) {
-        MPL_LOGE("bytes written (%d) don't match requested length (%d)\n",
-                 bytesWritten, len);
-        result = INV_ERROR_FILE_WRITE;
-    }
-    else {
-        MPL_LOGI("Bytes written = %d", bytesWritten);
-    }
-    fclose(fp);
+    result = inv_replace_cal(mpl_cal_default_path, cal, len);
+    if (result == INV_SUCCESS)
+        MPL_LOGI("Bytes written = %d", len);
     return result;
 }
 
@@ -383,6 +437,7 @@ inv_error_t inv_store_cal(unsigned char *calData, size_t length)
 
 /**
  *  @brief  Load a calibration file.
+ *          The file is mapped and handed to inv_load_mpl_states() in place.
  *
  *  @pre    Must be in INV_STATE_DMP_OPENED state.
  *          inv_dmp_open() or inv_dmp_stop() must have been called.
@@ -393,31 +448,121 @@ inv_error_t inv_store_cal(unsigned char *calData, size_t length)
  */
 inv_error_t inv_load_calibration(void)
 {
-    unsigned char *calData= NULL;
-    inv_error_t result = 0;
-    size_t bytesRead = 0;
+    unsigned char *calData;
+    inv_error_t result;
+    size_t size;
 
-    result = inv_read_cal(&calData, &bytesRead);
-    if(result != INV_SUCCESS) {
+    if (inv_copy_cal(0) != INV_SUCCESS) {
         MPL_LOGE("Could not load cal file - "
                  "aborting\n");
-        goto free_mem_n_exit;
+        return INV_ERROR_FILE_OPEN;
     }
 
-    result = inv_load_mpl_states(calData, bytesRead);
+    result = inv_map_cal(mpl_cal_default_path, &calData, &size);
+    if (result != INV_SUCCESS) {
+        MPL_LOGE("Could not load cal file - "
+                 "aborting\n");
+        return result;
+    }
+
+    result = inv_load_mpl_states(calData, size);
     if (result != INV_SUCCESS) {
         MPL_LOGE("Could not load the calibration data - "
                  "error %d - aborting\n", result);
-        goto free_mem_n_exit;
     }
 
-free_mem_n_exit:
-    inv_free(calData);
+    munmap(calData, size);
     return result;
 }
 
+/*
+ * Writer of inv_store_calibration_async().  Only the latest snapshot is
+ * kept, a newer one replaces a snapshot the thread did not get to yet.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int busy;
+    /* a write failed, the next store writes even if nothing changed */
+    int failed;
+    unsigned char *pending;
+    size_t pending_len;
+} cal_writer = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+};
+
+static void *inv_cal_writer_thread(void *arg)
+{
+    unsigned char *cal;
+    size_t len;
+    inv_error_t result;
+
+    (void)arg;
+    pthread_mutex_lock(&cal_writer.lock);
+    for (;;) {
+        while (!cal_writer.pending)
+            pthread_cond_wait(&cal_writer.cond, &cal_writer.lock);
+        cal = cal_writer.pending;
+        len = cal_writer.pending_len;
+        cal_writer.pending = NULL;
+        cal_writer.busy = 1;
+        pthread_mutex_unlock(&cal_writer.lock);
+
+        result = inv_write_cal(cal, len);
+        if (result != INV_SUCCESS)
+            MPL_LOGE("Could not store calibrated data on file - "
+                     "error %d\n", result);
+        inv_free(cal);
+
+        pthread_mutex_lock(&cal_writer.lock);
+        cal_writer.failed = result != INV_SUCCESS;
+        cal_writer.busy = 0;
+        pthread_cond_broadcast(&cal_writer.cond);
+    }
+    return NULL;
+}
+
+/* saves the mpl states, *calData is NULL when nothing needs writing */
+static inv_error_t inv_snapshot_calibration(unsigned char **calData,
+                                            size_t *length)
+{
+    inv_error_t result;
+    int failed;
+
+    inv_get_mpl_state_size(length);
+    *calData = (unsigned char *)inv_malloc(*length);
+    if (!*calData) {
+        MPL_LOGE("Could not allocate buffer of %d bytes - "
+                 "aborting\n", *length);
+        return INV_ERROR_MEMORY_EXAUSTED;
+    }
+
+    result = inv_save_mpl_states(*calData, *length);
+    if (result != INV_SUCCESS) {
+        MPL_LOGE("Could not save mpl states - "
+                 "error %d - aborting\n", result);
+        inv_free(*calData);
+        *calData = NULL;
+        return result;
+    }
+
+    pthread_mutex_lock(&cal_writer.lock);
+    failed = cal_writer.failed;
+    pthread_mutex_unlock(&cal_writer.lock);
+    if (!inv_get_mpl_states_changed() && !failed) {
+        MPL_LOGV("mpl states unchanged, cal file not rewritten\n");
+        inv_free(*calData);
+        *calData = NULL;
+    }
+    return INV_SUCCESS;
+}
+
 /**
  *  @brief  Store runtime calibration data to a file
+ *          Nothing is written when no mpl state changed since the last
+ *          load or store.  The file is replaced atomically.
  *
  *  @pre    Must be in INV_STATE_DMP_OPENED state.
  *          inv_dmp_open() or inv_dmp_stop() must have been called.
@@ -432,41 +577,81 @@ inv_error_t inv_store_calibration(void)
     inv_error_t result;
     size_t length;
 
-    result = inv_get_mpl_state_size(&length);
-    calData = (unsigned char *)inv_malloc(length);
-    if (!calData) {
-        MPL_LOGE("Could not allocate buffer of %d bytes - "
-                 "aborting\n", length);
-        return INV_ERROR_MEMORY_EXAUSTED;
-    }
-    else {
-        MPL_LOGI("mpl state size = %d", length);
-    }
-
-    result = inv_save_mpl_states(calData, length);
-    if (result != INV_SUCCESS) {
-        MPL_LOGE("Could not save mpl states - "
-                 "error %d - aborting\n", result);
-        goto free_mem_n_exit;
-    }
-    else {
-        MPL_LOGE("calData from inv_save_mpl_states, size=%d", 
-                 strlen((char *)calData));
-    }
+    result = inv_snapshot_calibration(&calData, &length);
+    if (result != INV_SUCCESS || !calData)
+        return result;
 
     result = inv_write_cal(calData, length);
     if (result != INV_SUCCESS) {
         MPL_LOGE("Could not store calibrated data on file - "
                  "error %d - aborting\n", result);
-        goto free_mem_n_exit;
-
     }
 
-free_mem_n_exit:
+    pthread_mutex_lock(&cal_writer.lock);
+    cal_writer.failed = result != INV_SUCCESS;
+    pthread_mutex_unlock(&cal_writer.lock);
     inv_free(calData);
     return result;
 }
 
+/**
+ *  @brief  Like inv_store_calibration() but the file is written by a
+ *          background thread.  Only the mpl states are saved in the
+ *          calling thread.
+ *
+ *  @return 0 or error code, write errors are only logged.
+ */
+inv_error_t inv_store_calibration_async(void)
+{
+    unsigned char *calData;
+    inv_error_t result;
+    pthread_t thread;
+    size_t length;
+
+    result = inv_snapshot_calibration(&calData, &length);
+    if (result != INV_SUCCESS || !calData)
+        return result;
+
+    pthread_mutex_lock(&cal_writer.lock);
+    if (!cal_writer.started) {
+        if (pthread_create(&thread, NULL, inv_cal_writer_thread, NULL)) {
+            pthread_mutex_unlock(&cal_writer.lock);
+            MPL_LOGE("Could not start the cal writer, storing in place\n");
+            result = inv_write_cal(calData, length);
+            inv_free(calData);
+            pthread_mutex_lock(&cal_writer.lock);
+            cal_writer.failed = result != INV_SUCCESS;
+            pthread_mutex_unlock(&cal_writer.lock);
+            return result;
+        }
+        pthread_detach(thread);
+        cal_writer.started = 1;
+    }
+    if (cal_writer.pending)
+        inv_free(cal_writer.pending);
+    cal_writer.pending = calData;
+    cal_writer.pending_len = length;
+    pthread_cond_broadcast(&cal_writer.cond);
+    pthread_mutex_unlock(&cal_writer.lock);
+    return INV_SUCCESS;
+}
+
+/**
+ *  @brief  Waits for the writes queued by inv_store_calibration_async().
+ *  @return INV_SUCCESS or INV_ERROR_FILE_WRITE if the last write failed.
+ */
+inv_error_t inv_flush_calibration(void)
+{
+    inv_error_t result;
+
+    pthread_mutex_lock(&cal_writer.lock);
+    while (cal_writer.pending || cal_writer.busy)
+        pthread_cond_wait(&cal_writer.cond, &cal_writer.lock);
+    result = cal_writer.failed ? INV_ERROR_FILE_WRITE : INV_SUCCESS;
+    pthread_mutex_unlock(&cal_writer.lock);
+    return result;
+}
+
 /**
  *  @}
  */
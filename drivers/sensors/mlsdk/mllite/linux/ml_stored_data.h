@@ -39,6 +39,8 @@ extern "C" {
 */
 inv_error_t inv_load_calibration(void);
 inv_error_t inv_store_calibration(void);
+inv_error_t inv_store_calibration_async(void);
+inv_error_t inv_flush_calibration(void);
 
 /*
     Internal APIs
@@ -1,8 +1,14 @@
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "ml_sysfs_helper.h"
 #include <dirent.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "input_devices.h"
 #define MPU_SYSFS_ABS_PATH "/sys/class/invensense/mpu"
 
 enum PROC_SYSFS_CMD {
@@ -37,179 +43,277 @@ static int iio_dev_num = 0;
 
 static const char *iio_dir = "/sys/bus/iio/devices/";
 
+/* /sys/bus/iio/devices entries and their name, see find_type_by_name() */
+#define IIO_MAX_ENTRIES 32
+
+struct iio_entry {
+	char dir[IIO_MAX_NAME_LENGTH];
+	char name[IIO_MAX_NAME_LENGTH];
+};
+
+static struct iio_entry iio_entries[IIO_MAX_ENTRIES];
+static int iio_num_entries = -1;
+static pthread_mutex_t iio_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* rereads the directory, only the name of new entries is read from sysfs */
+static void scan_iio_entries(void)
+{
+	struct iio_entry entries[IIO_MAX_ENTRIES];
+	const struct dirent *ent;
+	char path[PATH_MAX];
+	FILE *fp;
+	DIR *dp;
+	int i, n = 0;
+
+	dp = opendir(iio_dir);
+	if (dp == NULL) {
+		iio_num_entries = 0;
+		return;
+	}
+	while ((ent = readdir(dp)) != NULL && n < IIO_MAX_ENTRIES) {
+		if (ent->d_name[0] == '.' ||
+		    strlen(ent->d_name) >= IIO_MAX_NAME_LENGTH)
+			continue;
+		strcpy(entries[n].dir, ent->d_name);
+		for (i = 0; i < iio_num_entries; i++) {
+			if (!strcmp(iio_entries[i].dir, ent->d_name))
+				break;
+		}
+		if (i < iio_num_entries) {
+			strcpy(entries[n].name, iio_entries[i].name);
+			n++;
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s%s/name", iio_dir, ent->d_name);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (fscanf(fp, "%29s", entries[n].name) == 1)
+			n++;
+		fclose(fp);
+	}
+	closedir(dp);
+	memcpy(iio_entries, entries, n * sizeof(entries[0]));
+	iio_num_entries = n;
+}
+
+static int lookup_iio_entry(const char *name, const char *type)
+{
+	size_t len = strlen(type);
+	const char *dir;
+	char *end;
+	long number;
+	int i;
+
+	for (i = 0; i < iio_num_entries; i++) {
+		dir = iio_entries[i].dir;
+		if (strncmp(dir, type, len) || !isdigit((unsigned char)dir[len]))
+			continue;
+		/* typeN only, not typeN:something */
+		number = strtol(dir + len, &end, 10);
+		if (*end != 0)
+			continue;
+		if (!strcmp(name, iio_entries[i].name))
+			return number;
+	}
+	return -ENODEV;
+}
+
 /**
  * find_type_by_name() - function to match top level types by name
  * @name: top level type instance name
  * @type: the type of top level instance being sort
  *
- * Typical types this is used for are device and trigger.
+ * Typical types this is used for are device and trigger.  The names are
+ * cached, a miss only rereads the directory in case the device probed
+ * since.
  **/
 int find_type_by_name(const char *name, const char *type)
 {
-	const struct dirent *ent;
-	int number, numstrlen;
+	int number;
 
-	FILE *nameFile;
-	DIR *dp;
-	char thisname[IIO_MAX_NAME_LENGTH];
-	char *filename;
+	pthread_mutex_lock(&iio_lock);
+	if (iio_num_entries < 0)
+		scan_iio_entries();
+	number = lookup_iio_entry(name, type);
+	if (number < 0) {
+		scan_iio_entries();
+		number = lookup_iio_entry(name, type);
+	}
+	pthread_mutex_unlock(&iio_lock);
+	return number;
+}
 
-	dp = opendir(iio_dir);
-	if (dp == NULL) {
-		printf("No industrialio devices available");
-		return -ENODEV;
+/* same as parsing_proc_input() below, from the shared input registry */
+static int find_input_device(int mode, char *name)
+{
+	struct input_device dev;
+	int j;
+
+	if (mode == 0) {
+		for (j = 0; j < CHIP_NUM; j++) {
+			if (input_device_find_prefix(chip_name[j], &dev) < 0)
+				continue;
+			chip_ind = j;
+			snprintf(sysfs_path, sizeof(sysfs_path), "%s", dev.sysfs);
+			status = 1;
+			return 0;
+		}
+		return -1;
 	}
 
-	while (ent = readdir(dp), ent != NULL) {
-		if (strcmp(ent->d_name, ".") != 0 &&
-			strcmp(ent->d_name, "..") != 0 &&
-			strlen(ent->d_name) > strlen(type) &&
-			strncmp(ent->d_name, type, strlen(type)) == 0) {
-			numstrlen = sscanf(ent->d_name + strlen(type),
-					   "%d",
-					   &number);
-			/* verify the next character is not a colon */
-			if (strncmp(ent->d_name + strlen(type) + numstrlen,
-					":",
-					1) != 0) {
-				filename = malloc(strlen(iio_dir)
-						+ strlen(type)
-						+ numstrlen
-						+ 6);
-				if (filename == NULL)
-					return -ENOMEM;
-				sprintf(filename, "%s%s%d/name",
-					iio_dir,
-					type,
-					number);
-				nameFile = fopen(filename, "r");
-				if (!nameFile)
-					continue;
-				free(filename);
-				fscanf(nameFile, "%s", thisname);
-				if (strcmp(name, thisname) == 0)
-					return number;
-				fclose(nameFile);
-			}
+	if (input_device_find_prefix(name, &dev) < 0)
+		return -1;
+	return mode == 1 ? dev.event : dev.input;
+}
+
+/* /proc/bus/input/devices, parsed once for parsing_proc_input() */
+#define PROC_INPUT_MAX 64
+
+struct proc_input_device {
+	char name[INPUT_DEVICE_NAME_MAX];
+	char sysfs[100];	/* /sys + Sysfs= */
+	int event;		/* eventN of Handlers=, -1 if none */
+	int input;		/* inputN at the end of Sysfs= */
+};
+
+static struct proc_input_device proc_input[PROC_INPUT_MAX];
+static int proc_input_num = -1;
+static pthread_mutex_t proc_input_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* reads the whole file, /proc reports no size so the buffer grows */
+static char *read_proc_input(void)
+{
+	size_t len = 0, size = 16384;
+	char *buf, *tmp;
+	ssize_t n;
+	int fd;
+
+	fd = open("/proc/bus/input/devices", O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	buf = malloc(size);
+	while (buf) {
+		n = read(fd, buf + len, size - len - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+		if (len + 1 == size) {
+			size *= 2;
+			tmp = realloc(buf, size);
+			if (!tmp)
+				free(buf);
+			buf = tmp;
 		}
 	}
-	return -ENODEV;
+	close(fd);
+	if (buf)
+		buf[len] = 0;
+	return buf;
 }
 
-/* mode 0: search for which chip in the system and fill sysfs path
-   mode 1: return event number
- */
-static int parsing_proc_input(int mode, char *name){
-	const char input[] = "/proc/bus/input/devices";
-	char line[4096], d;
-	char tmp[100];
-	FILE *fp;
-	int i, j, result, find_flag;
-	int event_number = -1;
-	int input_number = -1;
+static void load_proc_input(void)
+{
+	struct proc_input_device *dev = NULL;
+	char *buf, *line, *next, *p, *q;
+	int n = 0;
 
-	if(NULL == (fp = fopen(input, "rt")) ){
-		return -1;
+	buf = read_proc_input();
+	if (!buf) {
+		proc_input_num = 0;
+		return;
 	}
-	result = 1;
-	find_flag = 0;
-	while(result != 0 && find_flag < 2){
-		i = 0;
-		d = 0;
-		memset(line, 0, 100);
-		while(d != '\n'){		
-			result = fread(&d, 1, 1, fp);
-			if(result == 0){
-				line[0] = 0;
-				break;
-			}
-			sprintf(&line[i], "%c", d);		
-			i ++;
+	for (line = buf; line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		if (line[0] == 'I' && n < PROC_INPUT_MAX) {
+			/* I: starts a device */
+			dev = &proc_input[n++];
+			memset(dev, 0, sizeof(*dev));
+			dev->event = -1;
+			dev->input = -1;
+		} else if (!dev) {
+			continue;
+		} else if (!strncmp(line, "N: Name=\"", 9)) {
+			p = line + 9;
+			q = strrchr(p, '"');
+			if (q)
+				*q = 0;
+			snprintf(dev->name, sizeof(dev->name), "%s", p);
+		} else if (!strncmp(line, "H: Handlers=", 12)) {
+			p = strstr(line + 12, "event");
+			if (p)
+				dev->event = atoi(p + 5);
+		} else if (!strncmp(line, "S: Sysfs=", 9)) {
+			snprintf(dev->sysfs, sizeof(dev->sysfs), "/sys%s", line + 9);
+			p = strrchr(line, '/');
+			if (p && !strncmp(p + 1, "input", 5))
+				dev->input = atoi(p + 6);
 		}
-		if(line[0] == 'N'){
-			i = 1;
-			while(line[i] != '"'){
-				i++;
-			}
-			i++;
-			j = 0;
-			find_flag = 0;
-			if (mode == 0){
-				while(j < CHIP_NUM){
-					if(!memcmp(&line[i], chip_name[j], strlen(chip_name[j]))){
-						find_flag = 1;
-						chip_ind = j;
-					}
-					j++;
-				}
-			} else if (mode  != 0){
-				if(!memcmp(&line[i], name, strlen(name))){
-					find_flag = 1;
-				}
-			}
-		}		
-		if(find_flag){
-			if(mode == 0){
-				if(line[0] == 'S'){
-					memset(tmp, 0, 100);
-					i =1;
-					while(line[i] != '=') i++;
-					i++;
-					j = 0;
-					while(line[i] != '\n'){
-						tmp[j] = line[i];
-						i ++; j++;
-					}	
-					sprintf(sysfs_path, "%s%s", "/sys", tmp);
-					find_flag++;
-				}
-			} else if(mode == 1){
-				if(line[0] == 'H') {
-					i = 2;
-					while(line[i] != '=') i++;
-					while(line[i] != 't') i++;	
-					i++;
-					event_number = 0;
-					while(line[i] != '\n'){
-						if(line[i] >= '0' && line[i] <= '9')
-							event_number = event_number*10 + line[i]-0x30;
-						i ++;
-					}
-					find_flag ++;
-				}
-			} else if (mode == 2) {
-				if(line[0] == 'S'){
-					memset(tmp, 0, 100);
-					i =1;
-					while(line[i] != '=') i++;
-					i++;
-					j = 0;
-					while(line[i] != '\n'){
-						tmp[j] = line[i];
-						i ++; j++;
-					}
-					input_number = 0;
-					if(tmp[j-2] >= '0' && tmp[j-2] <= '9') 
-						input_number += (tmp[j-2]-0x30)*10;
-					if(tmp[j-1] >= '0' && tmp[j-1] <= '9') 
-						input_number += (tmp[j-1]-0x30);
-					find_flag++;
+	}
+	free(buf);
+	proc_input_num = n;
+}
+
+/* index of the device mode is after, the chip sets chip_ind */
+static int find_proc_input(int mode, const char *name)
+{
+	int i, j;
+
+	for (i = 0; i < proc_input_num; i++) {
+		if (mode == 0) {
+			for (j = 0; j < CHIP_NUM; j++) {
+				if (!strncmp(proc_input[i].name, chip_name[j],
+					     strlen(chip_name[j]))) {
+					chip_ind = j;
+					return i;
 				}
 			}
+		} else if (!strncmp(proc_input[i].name, name, strlen(name))) {
+			return i;
 		}
 	}
-	fclose(fp);
-	if(find_flag == 0){
+	return -1;
+}
+
+/* mode 0: search for which chip in the system and fill sysfs path
+   mode 1: return event number
+   mode 2: return input number
+ */
+static int parsing_proc_input(int mode, char *name){
+	struct proc_input_device *dev;
+	int i, result;
+
+	result = find_input_device(mode, name);
+	if (result >= 0)
+		return result;
+
+	pthread_mutex_lock(&proc_input_lock);
+	if (proc_input_num < 0)
+		load_proc_input();
+	i = find_proc_input(mode, name);
+	if (i < 0) {
+		/* probed since the table was built */
+		load_proc_input();
+		i = find_proc_input(mode, name);
+	}
+	if (i < 0) {
+		pthread_mutex_unlock(&proc_input_lock);
 		return -1;
 	}
-	if(0 == mode)
+	dev = &proc_input[i];
+	if (mode == 0) {
+		strcpy(sysfs_path, dev->sysfs);
 		status = 1;
-	if (mode == 1)
-		return event_number;
-	if (mode == 2)
-		return input_number;
-	return 0;
-
+		result = 0;
+	} else {
+		result = mode == 1 ? dev->event : dev->input;
+	}
+	pthread_mutex_unlock(&proc_input_lock);
+	return result;
 }
 static void init_iio() {
 	int i, j;
@@ -367,7 +471,6 @@ inv_error_t inv_get_chip_name(char *name)
  */
 inv_error_t  inv_get_handler_number(const char *name, int *num)
 {
-	initialized = 0;
 	if ((*num = parsing_proc_input(1, (char *)name)) < 0)
 		return INV_ERROR_NOT_OPENED;
 	else
@@ -385,7 +488,6 @@ inv_error_t  inv_get_handler_number(const char *name, int *num)
  */
 inv_error_t  inv_get_input_number(const char *name, int *num)
 {
-	initialized = 0;
 	if ((*num = parsing_proc_input(2, (char *)name)) < 0)
 		return INV_ERROR_NOT_OPENED;
 	else {
@@ -15,12 +15,16 @@
  */
 #include "message_layer.h"
 #include "log.h"
+#include "mpl_context.h"
 
 struct message_holder_t {
     long message;
 };
 
-static struct message_holder_t mh;
+struct message_holder_t inv_default_messages;
+const size_t inv_messages_state_size = sizeof(struct message_holder_t);
+
+#define mh (*inv_mpl_ctx()->messages)
 
 /** Sets a message.
 * @param[in] set The flags to set.
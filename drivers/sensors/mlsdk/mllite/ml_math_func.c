@@ -23,6 +23,7 @@
 
 #include "mlmath.h"
 #include "ml_math_func.h"
+#include "ml_math_simd.h"
 #include "mlinclude.h"
 #include <string.h>
 
@@ -161,7 +162,7 @@ long inv_q_shift_mult(long a, long b, int shift)
 * @param[out] qProd Product after quaternion multiply. Length 4.
 *             1.0 scaled to 2^30.
 */
-void inv_q_mult(const long *q1, const long *q2, long *qProd)
+void inv_q_mult_c(const long *q1, const long *q2, long *qProd)
 {
     INVENSENSE_FUNC_START;
     qProd[0] = inv_q30_mult(q1[0], q2[0]) - inv_q30_mult(q1[1], q2[1]) -
@@ -216,7 +217,7 @@ void inv_vector_normalize(long *vec, int length)
     }
 }
 
-void inv_q_normalize(long *q)
+void inv_q_normalize_c(long *q)
 {
     INVENSENSE_FUNC_START;
     inv_vector_normalize(q, 4);
@@ -244,7 +245,7 @@ double quaternion_to_rotation_angle(const long *quat) {
 
 /** Rotates a 3-element vector by Rotation defined by Q
 */
-void inv_q_rotate(const long *q, const long *in, long *out)
+void inv_q_rotate_c(const long *q, const long *in, long *out)
 {
     long q_temp1[4], q_temp2[4];
     long in4[4], out4[4];
@@ -252,13 +253,13 @@ void inv_q_rotate(const long *q, const long *in, long *out)
     // Fixme optimize
     in4[0] = 0;
     memcpy(&in4[1], in, 3 * sizeof(long));
-    inv_q_mult(q, in4, q_temp1);
+    inv_q_mult_c(q, in4, q_temp1);
     inv_q_invert(q, q_temp2);
-    inv_q_mult(q_temp1, q_temp2, out4);
+    inv_q_mult_c(q_temp1, q_temp2, out4);
     memcpy(out, &out4[1], 3 * sizeof(long));
 }
 
-void inv_q_multf(const float *q1, const float *q2, float *qProd)
+void inv_q_multf_c(const float *q1, const float *q2, float *qProd)
 {
     INVENSENSE_FUNC_START;
     qProd[0] =
@@ -280,7 +281,7 @@ void inv_q_addf(const float *q1, const float *q2, float *qSum)
     qSum[3] = q1[3] + q2[3];
 }
 
-void inv_q_normalizef(float *q)
+void inv_q_normalizef_c(float *q)
 {
     INVENSENSE_FUNC_START;
     float normSF = 0;
@@ -343,7 +344,7 @@ void inv_q_invertf(const float *q, float *qInverted)
  *             by a 3 element column vector transform a vector from Body
  *             to World.
  */
-void inv_quaternion_to_rotation(const long *quat, long *rot)
+void inv_quaternion_to_rotation_c(const long *quat, long *rot)
 {
     rot[0] =
         inv_q29_mult(quat[1], quat[1]) + inv_q29_mult(quat[0],
@@ -701,7 +702,7 @@ void inv_get_cross_product_vec(float *cgcross, float compass[3], float grav[3])
     cgcross[2] = (float)compass[0] * grav[1] - (float)compass[1] * grav[0];
 }
 
-void mlMatrixVectorMult(long matrix[9], const long vecIn[3], long *vecOut)  {
+void mlMatrixVectorMult_c(const long matrix[9], const long vecIn[3], long *vecOut)  {
         // matrix format
         //  [ 0  3  6;
         //    1  4  7;
@@ -720,6 +721,90 @@ void mlMatrixVectorMult(long matrix[9], const long vecIn[3], long *vecOut)  {
         }
 }
 
+/*
+ * The quaternion and rotation entry points below go through the kernel
+ * table picked for this CPU by inv_math_get_kernels(), the *_c functions
+ * above are the scalar reference every table is checked against.
+ */
+
+void inv_q_mult(const long *q1, const long *q2, long *qProd)
+{
+    inv_math_get_kernels()->q_mult(q1, q2, qProd, 1);
+}
+
+void inv_q_normalize(long *q)
+{
+    inv_math_get_kernels()->q_normalize(q, 1);
+}
+
+void inv_q_rotate(const long *q, const long *in, long *out)
+{
+    inv_math_get_kernels()->q_rotate(q, in, out, 1);
+}
+
+void inv_q_multf(const float *q1, const float *q2, float *qProd)
+{
+    inv_math_get_kernels()->q_multf(q1, q2, qProd, 1);
+}
+
+void inv_q_normalizef(float *q)
+{
+    inv_math_get_kernels()->q_normalizef(q, 1);
+}
+
+void inv_quaternion_to_rotation(const long *quat, long *rot)
+{
+    inv_math_get_kernels()->quaternion_to_rotation(quat, rot, 1);
+}
+
+void mlMatrixVectorMult(long matrix[9], const long vecIn[3], long *vecOut)
+{
+    inv_math_get_kernels()->matrix_vector_mult(matrix, vecIn, vecOut, 1);
+}
+
+/** Multiplies n pairs of quaternions, 4 elements each, see inv_q_mult(). */
+void inv_q_mult_batch(const long *q1, const long *q2, long *qProd, int n)
+{
+    inv_math_get_kernels()->q_mult(q1, q2, qProd, n);
+}
+
+/** Normalizes n quaternions in place, see inv_q_normalize(). */
+void inv_q_normalize_batch(long *q, int n)
+{
+    inv_math_get_kernels()->q_normalize(q, n);
+}
+
+/** Rotates n 3-element vectors, each by its own quaternion. */
+void inv_q_rotate_batch(const long *q, const long *in, long *out, int n)
+{
+    inv_math_get_kernels()->q_rotate(q, in, out, n);
+}
+
+/** Multiplies n pairs of float quaternions, see inv_q_multf(). */
+void inv_q_multf_batch(const float *q1, const float *q2, float *qProd, int n)
+{
+    inv_math_get_kernels()->q_multf(q1, q2, qProd, n);
+}
+
+/** Normalizes n float quaternions in place, see inv_q_normalizef(). */
+void inv_q_normalizef_batch(float *q, int n)
+{
+    inv_math_get_kernels()->q_normalizef(q, n);
+}
+
+/** Converts n quaternions to n 9-element rotation matrices. */
+void inv_quaternion_to_rotation_batch(const long *quat, long *rot, int n)
+{
+    inv_math_get_kernels()->quaternion_to_rotation(quat, rot, n);
+}
+
+/** Multiplies n 3-element vectors by the same matrix. */
+void mlMatrixVectorMult_batch(const long matrix[9], const long *vecIn,
+                              long *vecOut, int n)
+{
+    inv_math_get_kernels()->matrix_vector_mult(matrix, vecIn, vecOut, n);
+}
+
 /**
  * @}
  */
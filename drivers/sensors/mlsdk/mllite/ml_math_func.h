@@ -116,6 +116,17 @@ extern "C" {
 
     void mlMatrixVectorMult(long matrix[9], const long vecIn[3], long *vecOut);
 
+    /* n samples at once, laid out back to back */
+    void inv_q_mult_batch(const long *q1, const long *q2, long *qProd, int n);
+    void inv_q_normalize_batch(long *q, int n);
+    void inv_q_rotate_batch(const long *q, const long *in, long *out, int n);
+    void inv_q_multf_batch(const float *q1, const float *q2, float *qProd,
+                           int n);
+    void inv_q_normalizef_batch(float *q, int n);
+    void inv_quaternion_to_rotation_batch(const long *quat, long *rot, int n);
+    void mlMatrixVectorMult_batch(const long matrix[9], const long *vecIn,
+                                  long *vecOut, int n);
+
 #ifdef __cplusplus
 }
 #endif
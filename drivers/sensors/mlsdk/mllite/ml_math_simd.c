@@ -0,0 +1,555 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Kernel tables for the ml_math_func quaternion entry points, see
+ * ml_math_simd.h for the accuracy guarantees.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ml_math_func.h"
+#include "ml_math_simd.h"
+#include "log.h"
+#undef MPL_LOG_TAG
+#define MPL_LOG_TAG "MPL-math"
+
+#if defined(UMPL_ELIMINATE_64BIT)
+/* the float based multiply-shift is not reproducible with integer lanes */
+#elif defined(__i386__) || defined(__x86_64__)
+#define INV_MATH_SSE
+#include <smmintrin.h>
+#define SSE_TARGET __attribute__((target("sse4.1")))
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#define INV_MATH_NEON
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#endif
+#endif
+
+#define Q_ONE (1073741824L)
+
+/* scalar reference, one sample at a time ************************************/
+
+static void q_mult_c(const long *q1, const long *q2, long *qProd, int n)
+{
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4)
+        inv_q_mult_c(q1, q2, qProd);
+}
+
+static void q_normalize_c(long *q, int n)
+{
+    for (; n > 0; n--, q += 4)
+        inv_q_normalize_c(q);
+}
+
+static void q_rotate_c(const long *q, const long *in, long *out, int n)
+{
+    for (; n > 0; n--, q += 4, in += 3, out += 3)
+        inv_q_rotate_c(q, in, out);
+}
+
+static void q_multf_c(const float *q1, const float *q2, float *qProd, int n)
+{
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4)
+        inv_q_multf_c(q1, q2, qProd);
+}
+
+static void q_normalizef_c(float *q, int n)
+{
+    for (; n > 0; n--, q += 4)
+        inv_q_normalizef_c(q);
+}
+
+static void quaternion_to_rotation_c(const long *quat, long *rot, int n)
+{
+    for (; n > 0; n--, quat += 4, rot += 9)
+        inv_quaternion_to_rotation_c(quat, rot);
+}
+
+static void matrix_vector_mult_c(const long *matrix, const long *vecIn,
+                                 long *vecOut, int n)
+{
+    for (; n > 0; n--, vecIn += 3, vecOut += 3)
+        mlMatrixVectorMult_c(matrix, vecIn, vecOut);
+}
+
+static const struct inv_math_kernels scalar_kernels = {
+    "scalar",
+    q_mult_c,
+    q_normalize_c,
+    q_rotate_c,
+    q_multf_c,
+    q_normalizef_c,
+    quaternion_to_rotation_c,
+    matrix_vector_mult_c,
+};
+
+#if defined(INV_MATH_SSE) || defined(INV_MATH_NEON)
+/*
+ * Scale of inv_q_normalizef_c, computed the same way. Returns 0 when the
+ * quaternion has to be reset to identity instead.
+ */
+static int normalizef_scale(const float *q, float *scale)
+{
+    float normSF = 0;
+    float xHalf = 0;
+
+    normSF = (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    if (normSF >= 2)
+        return 0;
+
+    xHalf = 0.5f * normSF;
+    normSF = normSF * (1.5f - xHalf * normSF * normSF);
+    normSF = normSF * (1.5f - xHalf * normSF * normSF);
+    normSF = normSF * (1.5f - xHalf * normSF * normSF);
+    normSF = normSF * (1.5f - xHalf * normSF * normSF);
+    *scale = normSF;
+    return 1;
+}
+
+/*
+ * Rotation matrix from the ten q29 products, in 32-bit wrapping arithmetic
+ * like the reference on 32-bit targets: q0 * q0 alone may not fit but the
+ * final elements always do.
+ */
+static void rotation_from_products(const int *p, long *rot)
+{
+    /* p: 11 12 13 22 | 23 33 00 01 | 02 03 */
+    unsigned int one = (unsigned int)Q_ONE;
+
+    rot[0] = (int)((unsigned int)p[0] + (unsigned int)p[6] - one);
+    rot[1] = (int)((unsigned int)p[1] - (unsigned int)p[9]);
+    rot[2] = (int)((unsigned int)p[2] + (unsigned int)p[8]);
+    rot[3] = (int)((unsigned int)p[1] + (unsigned int)p[9]);
+    rot[4] = (int)((unsigned int)p[3] + (unsigned int)p[6] - one);
+    rot[5] = (int)((unsigned int)p[4] - (unsigned int)p[7]);
+    rot[6] = (int)((unsigned int)p[2] - (unsigned int)p[8]);
+    rot[7] = (int)((unsigned int)p[4] + (unsigned int)p[7]);
+    rot[8] = (int)((unsigned int)p[5] + (unsigned int)p[6] - one);
+}
+#endif
+
+/* SSE4.1 *********************************************************************/
+
+#ifdef INV_MATH_SSE
+
+/* 4 longs to 4 int lanes, longs are 64-bit on LP64 hosts */
+static SSE_TARGET inline __m128i sse_load4(const long *p)
+{
+#ifdef __LP64__
+    __m128 lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p));
+    __m128 hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(p + 2)));
+    return _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+#else
+    return _mm_loadu_si128((const __m128i *)p);
+#endif
+}
+
+static SSE_TARGET inline void sse_store4(long *p, __m128i v)
+{
+#ifdef __LP64__
+    _mm_storeu_si128((__m128i *)p, _mm_cvtepi32_epi64(v));
+    _mm_storeu_si128((__m128i *)(p + 2),
+                     _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+#else
+    _mm_storeu_si128((__m128i *)p, v);
+#endif
+}
+
+static SSE_TARGET inline __m128i sse_load3(const long *p)
+{
+    return _mm_setr_epi32((int)p[0], (int)p[1], (int)p[2], 0);
+}
+
+static SSE_TARGET inline void sse_store3(long *p, __m128i v)
+{
+    p[0] = _mm_cvtsi128_si32(v);
+    p[1] = _mm_extract_epi32(v, 1);
+    p[2] = _mm_extract_epi32(v, 2);
+}
+
+/* (int)(((long long)a * b) >> shift) on every lane */
+static SSE_TARGET inline __m128i sse_mulshift(__m128i a, __m128i b, int shift)
+{
+    __m128i even = _mm_mul_epi32(a, b);
+    __m128i odd = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    /* lanes 0, 2 land in the low halves and lanes 1, 3 in the high ones */
+    even = _mm_srl_epi64(even, _mm_cvtsi32_si128(shift));
+    odd = _mm_sll_epi64(odd, _mm_cvtsi32_si128(32 - shift));
+    return _mm_blend_epi16(even, odd, 0xcc);
+}
+
+static SSE_TARGET inline __m128i sse_q_mult(__m128i a, __m128i b)
+{
+    const __m128i s1 = _mm_setr_epi32(-1, 1, -1, 1);
+    const __m128i s2 = _mm_setr_epi32(-1, 1, 1, -1);
+    const __m128i s3 = _mm_setr_epi32(-1, -1, 1, 1);
+    __m128i r, t;
+
+    r = sse_mulshift(_mm_shuffle_epi32(a, 0x00), b, 30);
+    t = sse_mulshift(_mm_shuffle_epi32(a, 0x55),
+                     _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)), 30);
+    r = _mm_add_epi32(r, _mm_sign_epi32(t, s1));
+    t = sse_mulshift(_mm_shuffle_epi32(a, 0xaa),
+                     _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2)), 30);
+    r = _mm_add_epi32(r, _mm_sign_epi32(t, s2));
+    t = sse_mulshift(_mm_shuffle_epi32(a, 0xff),
+                     _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)), 30);
+    return _mm_add_epi32(r, _mm_sign_epi32(t, s3));
+}
+
+static SSE_TARGET void q_mult_sse(const long *q1, const long *q2, long *qProd,
+                                  int n)
+{
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4)
+        sse_store4(qProd, sse_q_mult(sse_load4(q1), sse_load4(q2)));
+}
+
+static SSE_TARGET void q_rotate_sse(const long *q, const long *in, long *out,
+                                    int n)
+{
+    const __m128i conj = _mm_setr_epi32(1, -1, -1, -1);
+    __m128i qv, v;
+
+    for (; n > 0; n--, q += 4, in += 3, out += 3) {
+        qv = sse_load4(q);
+        v = _mm_setr_epi32(0, (int)in[0], (int)in[1], (int)in[2]);
+        v = sse_q_mult(sse_q_mult(qv, v), _mm_sign_epi32(qv, conj));
+        sse_store3(out, _mm_srli_si128(v, 4));
+    }
+}
+
+static SSE_TARGET void q_multf_sse(const float *q1, const float *q2,
+                                   float *qProd, int n)
+{
+    const __m128 s1 = _mm_setr_ps(-1.f, 1.f, -1.f, 1.f);
+    const __m128 s2 = _mm_setr_ps(-1.f, 1.f, 1.f, -1.f);
+    const __m128 s3 = _mm_setr_ps(-1.f, -1.f, 1.f, 1.f);
+    __m128 b, r, t;
+
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4) {
+        b = _mm_loadu_ps(q2);
+        r = _mm_mul_ps(_mm_set1_ps(q1[0]), b);
+        t = _mm_mul_ps(_mm_set1_ps(q1[1]),
+                       _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)));
+        r = _mm_add_ps(r, _mm_mul_ps(t, s1));
+        t = _mm_mul_ps(_mm_set1_ps(q1[2]),
+                       _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)));
+        r = _mm_add_ps(r, _mm_mul_ps(t, s2));
+        t = _mm_mul_ps(_mm_set1_ps(q1[3]),
+                       _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3)));
+        r = _mm_add_ps(r, _mm_mul_ps(t, s3));
+        _mm_storeu_ps(qProd, r);
+    }
+}
+
+static SSE_TARGET void q_normalizef_sse(float *q, int n)
+{
+    float scale;
+
+    for (; n > 0; n--, q += 4) {
+        if (normalizef_scale(q, &scale))
+            _mm_storeu_ps(q, _mm_mul_ps(_mm_loadu_ps(q), _mm_set1_ps(scale)));
+        else
+            _mm_storeu_ps(q, _mm_setr_ps(1.f, 0.f, 0.f, 0.f));
+    }
+}
+
+static SSE_TARGET void quaternion_to_rotation_sse(const long *quat, long *rot,
+                                                  int n)
+{
+    int p[12];
+    int q0, q1, q2, q3;
+
+    for (; n > 0; n--, quat += 4, rot += 9) {
+        q0 = quat[0];
+        q1 = quat[1];
+        q2 = quat[2];
+        q3 = quat[3];
+        _mm_storeu_si128((__m128i *)&p[0],
+                sse_mulshift(_mm_setr_epi32(q1, q1, q1, q2),
+                             _mm_setr_epi32(q1, q2, q3, q2), 29));
+        _mm_storeu_si128((__m128i *)&p[4],
+                sse_mulshift(_mm_setr_epi32(q2, q3, q0, q0),
+                             _mm_setr_epi32(q3, q3, q0, q1), 29));
+        _mm_storeu_si128((__m128i *)&p[8],
+                sse_mulshift(_mm_setr_epi32(q0, q0, 0, 0),
+                             _mm_setr_epi32(q2, q3, 0, 0), 29));
+        rotation_from_products(p, rot);
+    }
+}
+
+static SSE_TARGET void matrix_vector_mult_sse(const long *matrix,
+                                              const long *vecIn, long *vecOut,
+                                              int n)
+{
+    __m128i c0 = sse_load3(matrix);
+    __m128i c1 = sse_load3(matrix + 3);
+    __m128i c2 = sse_load3(matrix + 6);
+    __m128i r;
+
+    for (; n > 0; n--, vecIn += 3, vecOut += 3) {
+        r = sse_mulshift(c0, _mm_set1_epi32((int)vecIn[0]), 30);
+        r = _mm_add_epi32(r,
+                sse_mulshift(c1, _mm_set1_epi32((int)vecIn[1]), 30));
+        r = _mm_add_epi32(r,
+                sse_mulshift(c2, _mm_set1_epi32((int)vecIn[2]), 30));
+        sse_store3(vecOut, r);
+    }
+}
+
+static const struct inv_math_kernels simd_kernels = {
+    "sse4.1",
+    q_mult_sse,
+    q_normalize_c,
+    q_rotate_sse,
+    q_multf_sse,
+    q_normalizef_sse,
+    quaternion_to_rotation_sse,
+    matrix_vector_mult_sse,
+};
+
+#endif /* INV_MATH_SSE */
+
+/* NEON ***********************************************************************/
+
+#ifdef INV_MATH_NEON
+
+static inline int32x4_t neon_load4(const long *p)
+{
+#ifdef __LP64__
+    return vcombine_s32(vmovn_s64(vld1q_s64((const int64_t *)p)),
+                        vmovn_s64(vld1q_s64((const int64_t *)(p + 2))));
+#else
+    return vld1q_s32((const int32_t *)p);
+#endif
+}
+
+static inline void neon_store4(long *p, int32x4_t v)
+{
+#ifdef __LP64__
+    vst1q_s64((int64_t *)p, vmovl_s32(vget_low_s32(v)));
+    vst1q_s64((int64_t *)(p + 2), vmovl_s32(vget_high_s32(v)));
+#else
+    vst1q_s32((int32_t *)p, v);
+#endif
+}
+
+static inline int32x4_t neon_set4(int a, int b, int c, int d)
+{
+    int32_t v[4] = { a, b, c, d };
+
+    return vld1q_s32(v);
+}
+
+/* (int)(((long long)a * b) >> shift) on every lane, shift is immediate */
+#define NEON_MULSHIFT(a, b, shift) \
+    vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(a), vget_low_s32(b)), \
+                             shift), \
+                 vshrn_n_s64(vmull_s32(vget_high_s32(a), vget_high_s32(b)), \
+                             shift))
+
+static inline int32x4_t neon_q_mult(int32x4_t a, int32x4_t b)
+{
+    const int32x4_t s1 = neon_set4(-1, 1, -1, 1);
+    const int32x4_t s2 = neon_set4(-1, 1, 1, -1);
+    const int32x4_t s3 = neon_set4(-1, -1, 1, 1);
+    int32x4_t b1032 = vrev64q_s32(b);
+    int32x4_t b2301 = vcombine_s32(vget_high_s32(b), vget_low_s32(b));
+    int32x4_t b3210 = vrev64q_s32(b2301);
+    int32x4_t r, t;
+
+    r = NEON_MULSHIFT(vdupq_lane_s32(vget_low_s32(a), 0), b, 30);
+    t = NEON_MULSHIFT(vdupq_lane_s32(vget_low_s32(a), 1), b1032, 30);
+    r = vaddq_s32(r, vmulq_s32(t, s1));
+    t = NEON_MULSHIFT(vdupq_lane_s32(vget_high_s32(a), 0), b2301, 30);
+    r = vaddq_s32(r, vmulq_s32(t, s2));
+    t = NEON_MULSHIFT(vdupq_lane_s32(vget_high_s32(a), 1), b3210, 30);
+    return vaddq_s32(r, vmulq_s32(t, s3));
+}
+
+static void q_mult_neon(const long *q1, const long *q2, long *qProd, int n)
+{
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4)
+        neon_store4(qProd, neon_q_mult(neon_load4(q1), neon_load4(q2)));
+}
+
+static void q_rotate_neon(const long *q, const long *in, long *out, int n)
+{
+    const int32x4_t conj = neon_set4(1, -1, -1, -1);
+    int32x4_t qv, v;
+
+    for (; n > 0; n--, q += 4, in += 3, out += 3) {
+        qv = neon_load4(q);
+        v = neon_set4(0, (int)in[0], (int)in[1], (int)in[2]);
+        v = neon_q_mult(neon_q_mult(qv, v), vmulq_s32(qv, conj));
+        out[0] = vgetq_lane_s32(v, 1);
+        out[1] = vgetq_lane_s32(v, 2);
+        out[2] = vgetq_lane_s32(v, 3);
+    }
+}
+
+static void q_multf_neon(const float *q1, const float *q2, float *qProd, int n)
+{
+    static const float sign[3][4] = {
+        { -1.f, 1.f, -1.f, 1.f },
+        { -1.f, 1.f, 1.f, -1.f },
+        { -1.f, -1.f, 1.f, 1.f },
+    };
+    const float32x4_t s1 = vld1q_f32(sign[0]);
+    const float32x4_t s2 = vld1q_f32(sign[1]);
+    const float32x4_t s3 = vld1q_f32(sign[2]);
+    float32x4_t b, b2301, r, t;
+
+    for (; n > 0; n--, q1 += 4, q2 += 4, qProd += 4) {
+        b = vld1q_f32(q2);
+        b2301 = vcombine_f32(vget_high_f32(b), vget_low_f32(b));
+        r = vmulq_f32(vdupq_n_f32(q1[0]), b);
+        t = vmulq_f32(vdupq_n_f32(q1[1]), vrev64q_f32(b));
+        r = vaddq_f32(r, vmulq_f32(t, s1));
+        t = vmulq_f32(vdupq_n_f32(q1[2]), b2301);
+        r = vaddq_f32(r, vmulq_f32(t, s2));
+        t = vmulq_f32(vdupq_n_f32(q1[3]), vrev64q_f32(b2301));
+        r = vaddq_f32(r, vmulq_f32(t, s3));
+        vst1q_f32(qProd, r);
+    }
+}
+
+static void q_normalizef_neon(float *q, int n)
+{
+    static const float identity[4] = { 1.f, 0.f, 0.f, 0.f };
+    float scale;
+
+    for (; n > 0; n--, q += 4) {
+        if (normalizef_scale(q, &scale))
+            vst1q_f32(q, vmulq_n_f32(vld1q_f32(q), scale));
+        else
+            vst1q_f32(q, vld1q_f32(identity));
+    }
+}
+
+static void quaternion_to_rotation_neon(const long *quat, long *rot, int n)
+{
+    int32_t p[12];
+    int q0, q1, q2, q3;
+    int32x4_t a, b;
+
+    for (; n > 0; n--, quat += 4, rot += 9) {
+        q0 = quat[0];
+        q1 = quat[1];
+        q2 = quat[2];
+        q3 = quat[3];
+        a = neon_set4(q1, q1, q1, q2);
+        b = neon_set4(q1, q2, q3, q2);
+        vst1q_s32(&p[0], NEON_MULSHIFT(a, b, 29));
+        a = neon_set4(q2, q3, q0, q0);
+        b = neon_set4(q3, q3, q0, q1);
+        vst1q_s32(&p[4], NEON_MULSHIFT(a, b, 29));
+        a = neon_set4(q0, q0, 0, 0);
+        b = neon_set4(q2, q3, 0, 0);
+        vst1q_s32(&p[8], NEON_MULSHIFT(a, b, 29));
+        rotation_from_products((const int *)p, rot);
+    }
+}
+
+static void matrix_vector_mult_neon(const long *matrix, const long *vecIn,
+                                    long *vecOut, int n)
+{
+    int32x4_t c0 = neon_set4(matrix[0], matrix[1], matrix[2], 0);
+    int32x4_t c1 = neon_set4(matrix[3], matrix[4], matrix[5], 0);
+    int32x4_t c2 = neon_set4(matrix[6], matrix[7], matrix[8], 0);
+    int32x4_t r, v;
+
+    for (; n > 0; n--, vecIn += 3, vecOut += 3) {
+        v = vdupq_n_s32((int)vecIn[0]);
+        r = NEON_MULSHIFT(c0, v, 30);
+        v = vdupq_n_s32((int)vecIn[1]);
+        r = vaddq_s32(r, NEON_MULSHIFT(c1, v, 30));
+        v = vdupq_n_s32((int)vecIn[2]);
+        r = vaddq_s32(r, NEON_MULSHIFT(c2, v, 30));
+        vecOut[0] = vgetq_lane_s32(r, 0);
+        vecOut[1] = vgetq_lane_s32(r, 1);
+        vecOut[2] = vgetq_lane_s32(r, 2);
+    }
+}
+
+static const struct inv_math_kernels simd_kernels = {
+    "neon",
+    q_mult_neon,
+    q_normalize_c,
+    q_rotate_neon,
+    q_multf_neon,
+    q_normalizef_neon,
+    quaternion_to_rotation_neon,
+    matrix_vector_mult_neon,
+};
+
+#endif /* INV_MATH_NEON */
+
+/* selection ******************************************************************/
+
+static const struct inv_math_kernels *kernels;
+
+const struct inv_math_kernels *inv_math_scalar_kernels(void)
+{
+    return &scalar_kernels;
+}
+
+const struct inv_math_kernels *inv_math_simd_kernels(void)
+{
+#if defined(INV_MATH_SSE)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+        return &simd_kernels;
+#elif defined(INV_MATH_NEON) && defined(__aarch64__)
+    return &simd_kernels;
+#elif defined(INV_MATH_NEON)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON)
+        return &simd_kernels;
+#endif
+    return NULL;
+}
+
+/*
+ * Picked once, racing callers all compute the same table so no lock is
+ * needed.
+ */
+const struct inv_math_kernels *inv_math_get_kernels(void)
+{
+    const struct inv_math_kernels *k = kernels;
+
+    if (k == NULL) {
+        k = inv_math_simd_kernels();
+        if (k == NULL)
+            k = &scalar_kernels;
+        MPL_LOGI("using %s quaternion kernels\n", k->name);
+        kernels = k;
+    }
+    return k;
+}
+
+void inv_math_use_kernels(const struct inv_math_kernels *k)
+{
+    kernels = k;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INV_ML_MATH_SIMD_H__
+#define INV_ML_MATH_SIMD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Quaternion and rotation kernels behind the ml_math_func entry points.
+ * Every kernel handles n samples laid out back to back, the single sample
+ * functions call them with n = 1.
+ *
+ * The SIMD tables (SSE4.1 on x86, NEON on ARM) are checked against the
+ * scalar *_c reference:
+ * - fixed point kernels round every product exactly like inv_q29_mult and
+ *   inv_q30_mult and are bit-exact as long as the sums fit in 32 bits,
+ *   which holds for unit quaternions and is what 32-bit targets compute
+ *   anyway.
+ * - float kernels do the same operations in the same order; they are
+ *   bit-exact unless the compiler fuses the reference into multiply-adds,
+ *   and always within 1e-6 on unit quaternions.
+ * - inv_q_normalize works in double precision and stays scalar.
+ */
+struct inv_math_kernels {
+    const char *name;
+    void (*q_mult)(const long *q1, const long *q2, long *qProd, int n);
+    void (*q_normalize)(long *q, int n);
+    void (*q_rotate)(const long *q, const long *in, long *out, int n);
+    void (*q_multf)(const float *q1, const float *q2, float *qProd, int n);
+    void (*q_normalizef)(float *q, int n);
+    void (*quaternion_to_rotation)(const long *quat, long *rot, int n);
+    void (*matrix_vector_mult)(const long *matrix, const long *vecIn,
+                               long *vecOut, int n);
+};
+
+/* table used by ml_math_func, the best one the CPU supports */
+const struct inv_math_kernels *inv_math_get_kernels(void);
+const struct inv_math_kernels *inv_math_scalar_kernels(void);
+/* NULL when the CPU or the build has no SIMD support */
+const struct inv_math_kernels *inv_math_simd_kernels(void);
+void inv_math_use_kernels(const struct inv_math_kernels *kernels);
+
+/* scalar reference implementations */
+void inv_q_mult_c(const long *q1, const long *q2, long *qProd);
+void inv_q_normalize_c(long *q);
+void inv_q_rotate_c(const long *q, const long *in, long *out);
+void inv_q_multf_c(const float *q1, const float *q2, float *qProd);
+void inv_q_normalizef_c(float *q);
+void inv_quaternion_to_rotation_c(const long *quat, long *rot);
+void mlMatrixVectorMult_c(const long matrix[9], const long vecIn[3],
+                          long *vecOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INV_ML_MATH_SIMD_H__
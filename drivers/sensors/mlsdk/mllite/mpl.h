@@ -5,6 +5,7 @@
  $
  */
 #include "mltypes.h"
+#include "mpl_context.h"
 
 #ifndef INV_MPL_H__
 #define INV_MPL_H__
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "mpl_context.h"
+
+/* state of the default context, defined next to each module */
+extern struct inv_data_builder_state_t inv_default_data_builder;
+extern struct hal_output_t inv_default_hal_out;
+extern struct results_t inv_default_results;
+extern struct data_storage_t inv_default_storage;
+extern struct message_holder_t inv_default_messages;
+extern struct inv_start_cb_t inv_default_start;
+
+extern const size_t inv_data_builder_state_size;
+extern const size_t inv_hal_out_state_size;
+extern const size_t inv_results_state_size;
+extern const size_t inv_storage_state_size;
+extern const size_t inv_messages_state_size;
+extern const size_t inv_start_state_size;
+
+struct inv_mpl_context inv_mpl_default_context = {
+    .data_builder = &inv_default_data_builder,
+    .hal_out = &inv_default_hal_out,
+    .results = &inv_default_results,
+    .storage = &inv_default_storage,
+    .messages = &inv_default_messages,
+    .start = &inv_default_start,
+};
+
+/* set once any thread selected a context of its own, never cleared */
+int inv_mpl_contexts_used;
+
+#ifdef __BIONIC__
+/* bionic has no ELF TLS, keep the selection in a pthread key */
+static pthread_once_t inv_mpl_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t inv_mpl_key;
+
+static void inv_mpl_key_create(void)
+{
+    pthread_key_create(&inv_mpl_key, NULL);
+}
+
+static struct inv_mpl_context *inv_mpl_get_selected(void)
+{
+    pthread_once(&inv_mpl_key_once, inv_mpl_key_create);
+    return pthread_getspecific(inv_mpl_key);
+}
+
+static void inv_mpl_select(struct inv_mpl_context *ctx)
+{
+    pthread_once(&inv_mpl_key_once, inv_mpl_key_create);
+    pthread_setspecific(inv_mpl_key, ctx);
+}
+#else
+static __thread struct inv_mpl_context *inv_mpl_selected;
+
+static struct inv_mpl_context *inv_mpl_get_selected(void)
+{
+    return inv_mpl_selected;
+}
+
+static void inv_mpl_select(struct inv_mpl_context *ctx)
+{
+    inv_mpl_selected = ctx;
+}
+#endif
+
+struct inv_mpl_context *inv_mpl_thread_context(void)
+{
+    struct inv_mpl_context *ctx = inv_mpl_get_selected();
+
+    return ctx ? ctx : &inv_mpl_default_context;
+}
+
+static void inv_mpl_context_free(struct inv_mpl_context *ctx)
+{
+    free(ctx->data_builder);
+    free(ctx->hal_out);
+    free(ctx->results);
+    free(ctx->storage);
+    free(ctx->messages);
+    free(ctx->start);
+    free(ctx);
+}
+
+/** Allocates a zeroed context, select it with inv_mpl_set_context() and
+* call inv_init_mpl() before using it.
+* @return The new context or NULL when out of memory.
+*/
+struct inv_mpl_context *inv_mpl_context_create(void)
+{
+    struct inv_mpl_context *ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+    ctx->data_builder = calloc(1, inv_data_builder_state_size);
+    ctx->hal_out = calloc(1, inv_hal_out_state_size);
+    ctx->results = calloc(1, inv_results_state_size);
+    ctx->storage = calloc(1, inv_storage_state_size);
+    ctx->messages = calloc(1, inv_messages_state_size);
+    ctx->start = calloc(1, inv_start_state_size);
+    if (!ctx->data_builder || !ctx->hal_out || !ctx->results ||
+        !ctx->storage || !ctx->messages || !ctx->start) {
+        inv_mpl_context_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/** Frees a context from inv_mpl_context_create().  No thread may still use
+* it, the calling thread falls back to the default context if it did.
+* @param[in] ctx Context to free.
+* @return INV_SUCCESS or INV_ERROR_INVALID_PARAMETER for the default context.
+*/
+inv_error_t inv_mpl_context_destroy(struct inv_mpl_context *ctx)
+{
+    if (!ctx || ctx == &inv_mpl_default_context)
+        return INV_ERROR_INVALID_PARAMETER;
+    if (inv_mpl_ctx() == ctx)
+        inv_mpl_set_context(NULL);
+    inv_mpl_context_free(ctx);
+    return INV_SUCCESS;
+}
+
+/** Selects the context the calling thread works on.
+* @param[in] ctx Context from inv_mpl_context_create() or NULL for the
+*            default context.
+*/
+void inv_mpl_set_context(struct inv_mpl_context *ctx)
+{
+    if (ctx == &inv_mpl_default_context)
+        ctx = NULL;
+    inv_mpl_select(ctx);
+    if (ctx)
+        __atomic_store_n(&inv_mpl_contexts_used, 1, __ATOMIC_RELAXED);
+}
+
+/** Returns the context of the calling thread. */
+struct inv_mpl_context *inv_mpl_get_context(void)
+{
+    return inv_mpl_ctx();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+#ifndef INV_MPL_CONTEXT_H__
+#define INV_MPL_CONTEXT_H__
+
+#include "mltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * All mllite state lives in an inv_mpl_context.  The existing API works
+ * on the context selected for the calling thread, which is the process
+ * wide default context unless inv_mpl_set_context() picked another one,
+ * so single pipeline users do not change.
+ *
+ * To run another pipeline, create a context, select it on the thread that
+ * feeds it and go through inv_init_mpl() and the usual enable and start
+ * calls.  A context must only be used by one thread at a time.
+ *
+ * The algorithms of the prebuilt libmplmpu keep their own globals, only
+ * one pipeline per process may enable them.
+ */
+
+struct inv_data_builder_state_t;
+struct hal_output_t;
+struct results_t;
+struct data_storage_t;
+struct message_holder_t;
+struct inv_start_cb_t;
+
+struct inv_mpl_context {
+    struct inv_data_builder_state_t *data_builder;
+    struct hal_output_t *hal_out;
+    struct results_t *results;
+    struct data_storage_t *storage;
+    struct message_holder_t *messages;
+    struct inv_start_cb_t *start;
+};
+
+struct inv_mpl_context *inv_mpl_context_create(void);
+inv_error_t inv_mpl_context_destroy(struct inv_mpl_context *ctx);
+/* NULL selects the default context */
+void inv_mpl_set_context(struct inv_mpl_context *ctx);
+struct inv_mpl_context *inv_mpl_get_context(void);
+
+extern struct inv_mpl_context inv_mpl_default_context;
+extern int inv_mpl_contexts_used;
+/* not const or pure: it reads thread local state that
+   inv_mpl_set_context() changes */
+struct inv_mpl_context *inv_mpl_thread_context(void);
+
+/** Context of the calling thread, for the mllite modules.  Only a load and
+* a branch until some thread selects a context of its own.
+*/
+static inline struct inv_mpl_context *inv_mpl_ctx(void)
+{
+    if (!inv_mpl_contexts_used)
+        return &inv_mpl_default_context;
+    return inv_mpl_thread_context();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INV_MPL_CONTEXT_H__
@@ -22,12 +22,31 @@
 #include "start_manager.h"
 #include "data_builder.h"
 #include "message_layer.h"
+#include "mpl_context.h"
 #include "log.h"
 
 // These 2 status bits are used to control when the 9 axis quaternion is updated
 #define INV_COMPASS_CORRECTION_SET 1
 #define INV_6_AXIS_QUAT_SET 2
 
+// Derived values held in results_t.cache
+#define RH_CACHE_GRAVITY       0x01
+#define RH_CACHE_QUAT_FLOAT    0x02
+#define RH_CACHE_LINEAR_ACCEL  0x04
+#define RH_CACHE_ACCEL_FLOAT   0x08
+
+/** Derived values computed on first use, valid for one data generation or
+* until the quaternion is stored again.
+*/
+struct rh_cache_t {
+    unsigned int generation;
+    int valid;
+    long gravity[3];
+    float quat_float[4];
+    long linear_accel[3];
+    float accel_float[3];
+};
+
 struct results_t {
     long nav_quat[4];
     long gam_quat[4];
@@ -48,8 +67,26 @@ struct results_t {
     long status;
     struct inv_sensor_cal_t *sensor;
     float quat_confidence_interval;
+    struct rh_cache_t cache;
 };
-static struct results_t rh;
+struct results_t inv_default_results;
+const size_t inv_results_state_size = sizeof(struct results_t);
+
+#define rh (*inv_mpl_ctx()->results)
+
+/** Returns the cached bits of what, after dropping the whole cache if the
+* sensor data moved to a new generation.
+*/
+static int rh_cached(int what)
+{
+    unsigned int generation = inv_get_data_generation();
+
+    if (rh.cache.generation != generation) {
+        rh.cache.generation = generation;
+        rh.cache.valid = 0;
+    }
+    return rh.cache.valid & what;
+}
 
 /** @internal
 * Store a quaternion more suitable for gaming. This quaternion is often determined
@@ -59,6 +96,7 @@ static struct results_t rh;
 void inv_store_gaming_quaternion(const long *quat, inv_time_t timestamp)
 {
     rh.status |= INV_6_AXIS_QUAT_SET;
+    rh.cache.valid = 0;
     memcpy(&rh.gam_quat, quat, sizeof(rh.gam_quat));
     rh.gam_timestamp = timestamp;
 }
@@ -71,6 +109,7 @@ void inv_store_gaming_quaternion(const long *quat, inv_time_t timestamp)
 void inv_set_compass_correction(const long *data, inv_time_t timestamp)
 {
     rh.status |= INV_COMPASS_CORRECTION_SET;
+    rh.cache.valid = 0;
     memcpy(rh.compass_correction, data, sizeof(rh.compass_correction));
     rh.nav_timestamp = timestamp;
 }
@@ -198,13 +237,19 @@ void inv_get_mag_scale(long *data)
  */
 inv_error_t inv_get_gravity(long *data)
 {
-    data[0] =
-        inv_q29_mult(rh.nav_quat[1], rh.nav_quat[3]) - inv_q29_mult(rh.nav_quat[2], rh.nav_quat[0]);
-    data[1] =
-        inv_q29_mult(rh.nav_quat[2], rh.nav_quat[3]) + inv_q29_mult(rh.nav_quat[1], rh.nav_quat[0]);
-    data[2] =
-        (inv_q29_mult(rh.nav_quat[3], rh.nav_quat[3]) + inv_q29_mult(rh.nav_quat[0], rh.nav_quat[0])) -
-        1073741824L;
+    long *gravity = rh.cache.gravity;
+
+    if (!rh_cached(RH_CACHE_GRAVITY)) {
+        gravity[0] =
+            inv_q29_mult(rh.nav_quat[1], rh.nav_quat[3]) - inv_q29_mult(rh.nav_quat[2], rh.nav_quat[0]);
+        gravity[1] =
+            inv_q29_mult(rh.nav_quat[2], rh.nav_quat[3]) + inv_q29_mult(rh.nav_quat[1], rh.nav_quat[0]);
+        gravity[2] =
+            (inv_q29_mult(rh.nav_quat[3], rh.nav_quat[3]) + inv_q29_mult(rh.nav_quat[0], rh.nav_quat[0])) -
+            1073741824L;
+        rh.cache.valid |= RH_CACHE_GRAVITY;
+    }
+    memcpy(data, gravity, sizeof(rh.cache.gravity));
 
     return INV_SUCCESS;
 }
@@ -228,6 +273,7 @@ inv_error_t inv_get_quaternion(long *data)
     if (rh.status & (INV_COMPASS_CORRECTION_SET | INV_6_AXIS_QUAT_SET)) {
         inv_q_mult(rh.compass_correction, rh.gam_quat, rh.nav_quat);
         rh.status &= ~(INV_COMPASS_CORRECTION_SET | INV_6_AXIS_QUAT_SET);
+        rh.cache.valid = 0;
     }
     memcpy(data, rh.nav_quat, sizeof(rh.nav_quat));
     return INV_SUCCESS;
@@ -241,10 +287,16 @@ inv_error_t inv_get_quaternion_float(float *data)
 {
     long ldata[4];
     inv_error_t result = inv_get_quaternion(ldata);
-    data[0] = inv_q30_to_float(ldata[0]);
-    data[1] = inv_q30_to_float(ldata[1]);
-    data[2] = inv_q30_to_float(ldata[2]);
-    data[3] = inv_q30_to_float(ldata[3]);
+    float *quat = rh.cache.quat_float;
+
+    if (!rh_cached(RH_CACHE_QUAT_FLOAT)) {
+        quat[0] = inv_q30_to_float(ldata[0]);
+        quat[1] = inv_q30_to_float(ldata[1]);
+        quat[2] = inv_q30_to_float(ldata[2]);
+        quat[3] = inv_q30_to_float(ldata[3]);
+        rh.cache.valid |= RH_CACHE_QUAT_FLOAT;
+    }
+    memcpy(data, quat, sizeof(rh.cache.quat_float));
     return result;
 }
 
@@ -402,14 +454,19 @@ void inv_get_compass_bias_error(long *bias_error)
 inv_error_t inv_get_linear_accel(long *data)
 {
     long gravity[3];
+    long *linear = rh.cache.linear_accel;
 
     if (data != NULL)
     {
-        inv_get_accel_set(data, NULL, NULL);
-        inv_get_gravity(gravity);
-        data[0] -= gravity[0] >> 14;
-        data[1] -= gravity[1] >> 14;
-        data[2] -= gravity[2] >> 14;
+        if (!rh_cached(RH_CACHE_LINEAR_ACCEL)) {
+            inv_get_accel_set(linear, NULL, NULL);
+            inv_get_gravity(gravity);
+            linear[0] -= gravity[0] >> 14;
+            linear[1] -= gravity[1] >> 14;
+            linear[2] -= gravity[2] >> 14;
+            rh.cache.valid |= RH_CACHE_LINEAR_ACCEL;
+        }
+        memcpy(data, linear, sizeof(rh.cache.linear_accel));
         return INV_SUCCESS;
     }
     else {
@@ -445,10 +502,16 @@ inv_error_t inv_get_accel_float(float *data)
     long tdata[3];
     unsigned char i;
 
+    if (data != NULL && rh_cached(RH_CACHE_ACCEL_FLOAT)) {
+        memcpy(data, rh.cache.accel_float, sizeof(rh.cache.accel_float));
+        return INV_SUCCESS;
+    }
     if (data != NULL && !inv_get_accel(tdata)) {
         for (i = 0; i < 3; ++i) {
             data[i] = ((float)tdata[i] / (1L << 16));
         }
+        memcpy(rh.cache.accel_float, data, sizeof(rh.cache.accel_float));
+        rh.cache.valid |= RH_CACHE_ACCEL_FLOAT;
         return INV_SUCCESS;
     }
     else {
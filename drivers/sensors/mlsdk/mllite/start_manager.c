@@ -24,6 +24,7 @@
 #include <string.h>
 #include "log.h"
 #include "start_manager.h"
+#include "mpl_context.h"
 
 typedef inv_error_t (*inv_start_cb_func)();
 struct inv_start_cb_t {
@@ -31,7 +32,11 @@ struct inv_start_cb_t {
     inv_start_cb_func start_cb[INV_MAX_START_CB];
 };
 
-static struct inv_start_cb_t inv_start_cb;
+struct inv_start_cb_t inv_default_start;
+const size_t inv_start_state_size = sizeof(struct inv_start_cb_t);
+
+/* callbacks of the calling thread's MPL context */
+#define inv_start_cb (*inv_mpl_ctx()->start)
 
 /** Initilize the start manager. Typically called by inv_start_mpl();
 * @return Returns INV_SUCCESS if successful or an error code if not.
@@ -21,6 +21,7 @@
 #include "log.h"
 #include "ml_math_func.h"
 #include "mlmath.h"
+#include "mpl_context.h"
 
 /* Must be changed if the format of storage changes */
 #define DEFAULT_KEY 29681
@@ -42,8 +43,14 @@ struct data_storage_t {
     load_func_t load[NUM_STORAGE_BOXES]; /**< Callback to load data */
     save_func_t save[NUM_STORAGE_BOXES]; /**< Callback to save data */
     struct data_header_t hd[NUM_STORAGE_BOXES]; /**< Header info for each entity */
+    uint32_t stored[NUM_STORAGE_BOXES]; /**< Checksum last loaded or saved */
+    unsigned long known; /**< Entities with a valid stored[] checksum */
+    unsigned long changed; /**< Entities that differed at the last save */
 };
-static struct data_storage_t ds;
+struct data_storage_t inv_default_storage;
+const size_t inv_storage_state_size = sizeof(struct data_storage_t);
+
+#define ds (*inv_mpl_ctx()->storage)
 
 /** Should be called once before using any of the storage methods. Typically
 * called first by inv_init_mpl().*/
@@ -114,54 +121,72 @@ static int inv_find_entry(unsigned int key)
 }
 
 /** This function takes a block of data that has been saved in non-volatile memory and pushes
-* to the proper locations. Multiple error checks are performed on the data.
+* to the proper locations. Multiple error checks are performed on the data: every entity
+* must lie within length and the block must match its checksum before anything is loaded.
 * @param[in] data Data that was saved to be loaded up by MPL
 * @param[in] length Length of data vector in bytes
 * @return Returns INV_SUCCESS if successful or an error code if not.
 */
 inv_error_t inv_load_mpl_states(const unsigned char *data, size_t length)
 {
-    struct data_header_t *hd;
+    const struct data_header_t *hd;
+    const unsigned char *cur;
     int entry;
-    uint32_t checksum;
-    long len;
+    uint32_t checksum, total;
+    size_t len, left;
 
-    len = length; // Important so we get negative numbers
-    if (len < sizeof(struct data_header_t))
+    if (length < sizeof(struct data_header_t))
         return INV_ERROR_CALIBRATION_LOAD;  // No data
-    hd = (struct data_header_t *)data;
+    hd = (const struct data_header_t *)data;
     if (hd->key != DEFAULT_KEY)
         return INV_ERROR_CALIBRATION_LOAD;  // Key changed or data corruption
-    len = MIN(hd->size, len);
-    len = hd->size;
-    len -= sizeof(struct data_header_t);
+    if (hd->size < sizeof(struct data_header_t) || hd->size > length)
+        return INV_ERROR_CALIBRATION_LOAD;  // Truncated file
+    total = hd->checksum;
+    len = hd->size - sizeof(struct data_header_t);
     data += sizeof(struct data_header_t);
+
+    // Every entity must fit before anything is copied, the block checksum
+    // below covers their contents and headers
+    cur = data;
+    left = len;
+    while (left > sizeof(struct data_header_t)) {
+        hd = (const struct data_header_t *)cur;
+        cur += sizeof(struct data_header_t);
+        left -= sizeof(struct data_header_t);
+        if (hd->size < 0 || (size_t)hd->size > left)
+            return INV_ERROR_CALIBRATION_LEN;
+        entry = inv_find_entry(hd->key);
+        if (entry >= 0 && hd->size != ds.hd[entry].size)
+            return INV_ERROR_CALIBRATION_LEN;
+        cur += hd->size;
+        left -= hd->size;
+    }
+
     checksum = inv_checksum(data, len);
-    if (checksum != hd->checksum)
+    if (checksum != total)
         return INV_ERROR_CALIBRATION_LOAD;  // Data corruption
 
-    while (len > (long)sizeof(struct data_header_t)) {
-        hd = (struct data_header_t *)data;
+    while (len > sizeof(struct data_header_t)) {
+        hd = (const struct data_header_t *)data;
         entry = inv_find_entry(hd->key);
         data += sizeof(struct data_header_t);
         len -= sizeof(struct data_header_t);
-        if (entry >= 0 && len >= hd->size) {
-            if (hd->size != ds.hd[entry].size)
-                return INV_ERROR_CALIBRATION_LEN;
-            checksum = inv_checksum(data, hd->size);
-            if (checksum != hd->checksum)
-                return INV_ERROR_CALIBRATION_LOAD;
+        if (entry >= 0) {
             ds.load[entry](data);
+            ds.stored[entry] = hd->checksum;
+            ds.known |= 1UL << entry;
         }
+        data += hd->size;
         len -= hd->size;
-        if (len >= 0)
-            data = data + hd->size;
     }
 
     return INV_SUCCESS;
 }
 
 /** This function fills up a block of memory to be stored in non-volatile memory.
+* The entities that differ from what was last loaded or saved are reported by
+* inv_get_mpl_states_changed() afterwards.
 * @param[out] data Place to store data, size of sz, must be at least size
 *                  returned by inv_get_mpl_state_size()
 * @param[in] sz Size of data.
@@ -174,6 +199,7 @@ inv_error_t inv_save_mpl_states(unsigned char *data, size_t sz)
     struct data_header_t *hd;
 
     if (sz >= ds.total_size) {
+        ds.changed = 0;
         cur = data + sizeof(struct data_header_t);
         for (kk = 0; kk < ds.num; ++kk) {
             hd = (struct data_header_t *)cur;
@@ -183,7 +209,11 @@ inv_error_t inv_save_mpl_states(unsigned char *data, size_t sz)
             hd->size = ds.hd[kk].size;
             hd->key = ds.hd[kk].key;
             cur += ds.hd[kk].size;
+            if (!(ds.known & (1UL << kk)) || ds.stored[kk] != hd->checksum)
+                ds.changed |= 1UL << kk;
+            ds.stored[kk] = hd->checksum;
         }
+        ds.known = (1UL << ds.num) - 1;
     } else {
         return INV_ERROR_CALIBRATION_LOAD;
     }
@@ -197,6 +227,15 @@ inv_error_t inv_save_mpl_states(unsigned char *data, size_t sz)
     return INV_SUCCESS;
 }
 
+/** Returns a bit per registered entity, in registration order, set when the
+* last inv_save_mpl_states() saved something different from what was loaded
+* or saved before.  0 means the stored copy is already up to date.
+*/
+unsigned long inv_get_mpl_states_changed(void)
+{
+    return ds.changed;
+}
+
 /**
  * @}
  */
@@ -22,6 +22,7 @@ void inv_init_storage_manager(void);
 inv_error_t inv_get_mpl_state_size(size_t *size);
 inv_error_t inv_load_mpl_states(const unsigned char *data, size_t len);
 inv_error_t inv_save_mpl_states(unsigned char *data, size_t len);
+unsigned long inv_get_mpl_states_changed(void);
 
 #ifdef __cplusplus
 }
@@ -214,21 +214,22 @@ int NvsInput::readEvents(sensors_event_t* data, int count)
 
     int numEventReceived = 0;
     input_event const* event;
+    size_t frame;
 
-    while (count && mInputReader.readEvent(&event)) {
-        if ((event->type == EV_ABS) || (event->type == EV_REL)) {
-            processEvent(event->code, (float)event->value);
-        } else if (event->type == EV_SYN) {
-            int64_t time = timevalToNano(event->time);
-            mPendingEvent.timestamp = time;
-            *data++ = mPendingEvent;
-            count--;
-            numEventReceived++;
-        } else {
-            ALOGE("%s %s unknown event->type %d\n",
-                 __func__, data_name, event->type);
+    while (count && (frame = mInputReader.readFrame(&event))) {
+        for (; --frame; event++) {
+            if ((event->type == EV_ABS) || (event->type == EV_REL))
+                processEvent(event->code, (float)event->value);
+            else
+                ALOGE("%s %s unknown event->type %d\n",
+                     __func__, data_name, event->type);
         }
-        mInputReader.next();
+        // event is the EV_SYN closing the frame
+        mPendingEvent.timestamp = timevalToNano(event->time);
+        *data++ = mPendingEvent;
+        count--;
+        numEventReceived++;
+        mInputReader.nextFrame();
     }
     return numEventReceived;
 }
@@ -263,12 +264,18 @@ int NvsInput::sysfsInputPaths(int inputNum)
         return -1;
     }
 
-    sprintf(sysFs.path, "/sys/class/input/input%d/%s", inputNum, data_name);
-    sprintf(sysFs.enable, "/sys/class/input/input%d/%s/enable", inputNum, data_name);
-    sprintf(sysFs.delay, "/sys/class/input/input%d/%s/delay", inputNum, data_name);
-    sprintf(sysFs.divisor, "/sys/class/input/input%d/%s/divisor", inputNum, data_name);
-    sprintf(sysFs.resolution, "/sys/class/input/input%d/%s/resolution", inputNum, data_name);
-    sprintf(sysFs.max_range, "/sys/class/input/input%d/%s/max_range", inputNum, data_name);
-    sprintf(sysFs.microamp, "/sys/class/input/input%d/%s/microamp", inputNum, data_name);
+    char buf[SYSFS_PATH_SIZE_MAX];
+    const char *base;
+
+    snprintf(buf, sizeof(buf), "/sys/class/input/input%d/%s", inputNum, data_name);
+    base = sensorsPath(buf, sysFs.path, SYSFS_PATH_SIZE_MAX);
+    if (base != sysFs.path)
+        strcpy(sysFs.path, base);
+    snprintf(sysFs.enable, SYSFS_PATH_SIZE_MAX, "%s/enable", sysFs.path);
+    snprintf(sysFs.delay, SYSFS_PATH_SIZE_MAX, "%s/delay", sysFs.path);
+    snprintf(sysFs.divisor, SYSFS_PATH_SIZE_MAX, "%s/divisor", sysFs.path);
+    snprintf(sysFs.resolution, SYSFS_PATH_SIZE_MAX, "%s/resolution", sysFs.path);
+    snprintf(sysFs.max_range, SYSFS_PATH_SIZE_MAX, "%s/max_range", sysFs.path);
+    snprintf(sysFs.microamp, SYSFS_PATH_SIZE_MAX, "%s/microamp", sysFs.path);
     return 0;
 }
@@ -16,7 +16,7 @@
 #ifndef NVS_INPUT_H
 #define NVS_INPUT_H
 
-#define SYSFS_PATH_SIZE_MAX             (50)
+#define SYSFS_PATH_SIZE_MAX             (128)
 
 #include "sensors.h"
 #include "SensorBase.h"
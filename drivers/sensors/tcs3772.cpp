@@ -55,6 +55,7 @@ Tcs3772Base::Tcs3772Base(const char *sysPath,int sid)
         sysValuePath = strcpy(sysValuePath, in_name);
         sysValuePath = strcat(sysValuePath, "_raw");
         mSysValuePath = sysValuePath;
+        mValue.setPath(mSysValuePath);
         sysEnablePath = strcpy(sysEnablePath, in_name);
         sysEnablePath = strcat(sysEnablePath, "_enable");
         mSysEnablePath = sysEnablePath;
@@ -138,7 +139,7 @@ int Tcs3772Base::readEvents(sensors_event_t* data, int count) {
     if (!hasPendingEvents())
         return 0;
 
-    ret = readIntFromFile(mSysValuePath, &value);
+    ret = mValue.readInt(&value);
     if (ret <= 0) {
         ALOGV("read from %s failed", mSysValuePath);
         return 0;
@@ -21,6 +21,7 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "SensorUtil.h"
 
 #define TCS3772_INTEGRATION_TIME 700000000 /* 700 ms */
 #define TCS3772_LUX_CONV_FACTOR 0.06
@@ -36,6 +37,7 @@ class Tcs3772Base : public SensorBase {
     const char *mSysValuePath;
     const char *mSysEnablePath;
     const char *mSysRegulatorEnablePath;
+    SysfsAttr mValue;
 public:
             Tcs3772Base(const char *sysPath, int sid);
     virtual ~Tcs3772Base();
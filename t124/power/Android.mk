@@ -21,7 +21,8 @@ include $(NVIDIA_DEFAULTS)
 
 LOCAL_C_INCLUDES += device/nvidia/common/power
 LOCAL_MODULE_RELATIVE_PATH := hw
-LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libdl libnvos
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libdl libnvos \
+                          libinputdevices
 LOCAL_STATIC_LIBRARIES := libpowerhal
 LOCAL_SRC_FILES := power.cpp
 LOCAL_MODULE := power.$(TARGET_BOARD_PLATFORM)
@@ -33,11 +33,12 @@ LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/HAL/include
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mllite
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mllite/linux
 LOCAL_C_INCLUDES += device/nvidia/drivers/sensors/mlsdk/mpl
+LOCAL_C_INCLUDES += device/nvidia/drivers/input/include
 LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libdl libsensors.base \
                           libinvensense_hal libsensors.mpl \
                           libsensors.nvs_input libsensors.iio.lights \
                           libsensors.max44005 libsensors.bmpx80 \
-                          libsensors.ltr558als
+                          libsensors.ltr558als libinputdevices
 LOCAL_CPPFLAGS+=-DLINUX=1
 LOCAL_MODULE_RELATIVE_PATH := hw
 
@@ -15,7 +15,13 @@
  */
 
 #include <fcntl.h>
+#include <time.h>
+#include <cutils/properties.h>
 
+#include "SensorPollMux.h"
+#include "SensorPollLoop.h"
+#include "SensorEventRing.h"
+#include "SensorStats.h"
 #include "nvs_input.h"
 #include "lightsensor.h"
 #include "max44005.h"
@@ -24,6 +30,36 @@
 #include "MPLSensorDefs.h"
 #include "CompassSensor.h"
 #include "bmpx80.h"
+#include "input_devices.h"
+
+/*
+ * Events of a batched sensor are held in a per handle ring of this size
+ * until the sensor's max report latency expires.
+ */
+static const int batchRingSize = 256;
+
+/*
+ * Set to 1 to read each driver on its own thread so that a slow driver
+ * (sysfs reads, MPL temperature) cannot delay the others.
+ */
+#define SENSORS_THREADED_PROP "persist.sensors.threaded"
+static const int readerRingSize = 256;
+
+/*
+ * Set to 1 to run MPL fusion on its own real-time thread, the MPL driver
+ * then only decodes input and the fused events come back through the
+ * fusion thread's fd.
+ */
+#define SENSORS_FUSION_PROP "persist.sensors.fusion_thread"
+
+/*
+ * Set to N > 0 to collect latency and read cost statistics and write them
+ * to SENSORS_STATS_FILE every N seconds. Nothing is measured when unset.
+ * The MPL profile, when built in, goes to SENSORS_PROFILE_FILE alongside.
+ */
+#define SENSORS_STATS_PROP "persist.sensors.stats"
+#define SENSORS_STATS_FILE "/data/sensors_stats.txt"
+#define SENSORS_PROFILE_FILE "/data/mpl_profile.txt"
 
 /*
  * 10 is 3 bigger than the size it looks to be here in order to accomodate
@@ -31,10 +67,10 @@
  * depending on if it is TN8 or shield_ers respectively)
  *
  * NOTE:
- * For each sensor defn in sSensorList, a corresponding enum in sensor_id
- * has to be present. Also, the mapping from the corresponding handle to
- * sensor_id should be defined in handleToSensor. As a result, the order
- * in which the following sensor defn are enrolled does not matter.
+ * For each sensor defn in sSensorList, the driver serving its handle has to
+ * be registered with addDriver() and mapped with mapHandle() in the poll
+ * context constructor. As a result, the order in which the following sensor
+ * defn are enrolled does not matter.
  */
 static struct sensor_t sSensorList[10] = {
       MPLROTATIONVECTOR_DEF,
@@ -69,6 +105,11 @@ static int sensors__get_sensors_list(struct sensors_module_t* module,
     /* LTR659 proximity sensor. */
     ltr558Prox::fillSensorDef(sSensorList, size);
 
+    for (int i = 0; i < size; i++) {
+        sSensorList[i].fifoReservedEventCount = batchRingSize;
+        sSensorList[i].fifoMaxEventCount = batchRingSize;
+    }
+
     return size;
 }
 
@@ -92,269 +133,373 @@ struct sensors_module_t HAL_MODULE_INFO_SYM = {
 };
 
 struct sensors_poll_context_t {
-    struct sensors_poll_device_t device; // must be first
+    struct sensors_poll_device_1 device; // must be first
 
     sensors_poll_context_t();
     ~sensors_poll_context_t();
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
     int pollEvents(sensors_event_t* data, int count);
-    unsigned int polltime;
+    int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
 
 private:
     enum {
-        light             = 0,
-        mpl               = 1,
-        pressure,
-        compass,
-        proximity,
-        numSensorDrivers,       // wake pipe goes here
-        numFds,
+        maxDrivers        = 8,
+        numHandles        = ID_AP + 1,
     };
 
-    /* Should be in sync with struct sensor_t sSensorList[] */
-    enum sensor_ids {
-        SENSOR_RV = 0,
-        SENSOR_LA,
-        SENSOR_GR,
-        SENSOR_GY,
-        SENSOR_A,
-        SENSOR_M,
-        SENSOR_O,
-        SENSOR_L,
-        SENSOR_AP,
-        SENSOR_P,
-        MAX_SENSOR_TYPES,
+    /* used for polled drivers that do not report their own poll delay */
+    static const int64_t defaultPollDelay = 200000000LL;
+
+    struct driver_t {
+        SensorBase *sensor;
+        SensorPollMux *mux;     // mLoop's or the mux of its reader thread
+        int muxId;
+        bool polled;            // no fd, read on its poll deadline
+        /* real read callback when reads go through readTimed() */
+        SensorPollMux::read_cb_t read;
+        void *cookie;
+        sensors_poll_context_t *ctx;
     };
 
-    static const size_t wake = numFds - 1;
-    static const char WAKE_MESSAGE = 'W';
-    struct pollfd mPollFds[numFds];
-    SensorBase* mSensors[numSensorDrivers];
-    bool isSensorEnabled[MAX_SENSOR_TYPES];
-    unsigned int requestedPollTime[MAX_SENSOR_TYPES];
-    int mWritePipeFd;
+    SensorPollLoop mLoop;
+    driver_t mDrivers[maxDrivers];
+    int mNumDrivers;
+    int mHandleToDriver[numHandles];
+    bool isSensorEnabled[numHandles];
+    int64_t requestedDelay[numHandles];
 
-    int handleToDriver(int handle) const {
-        switch (handle) {
-            case ID_RV:
-            case ID_LA:
-            case ID_GR:
-            case ID_GY:
-            case ID_A:
-            case ID_O:
-            case ID_M:
-                return mpl;
-
-            case ID_L:
-                return light;
-
-            case ID_AP:
-                return pressure;
-
-            case ID_P:
-                return proximity;
-        }
+    /*
+     * Batching state, shared between the poll thread and batch()/flush().
+     * A handle with a max report latency, or with events still queued,
+     * has its events diverted to mBatchRing. All rings are delivered
+     * together once the earliest deadline expires, a ring fills up or a
+     * flush is requested.
+     */
+    pthread_mutex_t mBatchMutex;
+    SensorEventRing *mBatchRing[numHandles];
+    int64_t mBatchLatency[numHandles];
+    int64_t mBatchDeadline[numHandles];
+    bool mDeliverBatches;
+
+    int queueBatched(sensors_event_t *data, int count);
+    int deliverBatches(sensors_event_t *data, int count);
+    int batchTimeout();
+    static int queueBatched(void *cookie, sensors_event_t *data, int count);
+    static int deliverBatches(void *cookie, sensors_event_t *data, int count);
+    static int batchTimeout(void *cookie);
+
+    /* threaded mode: each driver is read by its own SensorReaderThread */
+    void initThreaded();
+    SensorPollMux *readerMux(int shareWith);
+
+    SensorStats *mStats;        // NULL unless statistics are enabled
+    int64_t mStatsInterval;
+    int64_t mStatsDue;
+    MPLSensor *mProfiledMpl;    // MPL profiled along with the stats
+
+    void initStats();
+    static int readTimed(void *cookie, sensors_event_t *data, int count);
 
-        return -EINVAL;
-    }
+    /*
+     * Register a driver with the poll loop. An fd >= 0 is watched by the
+     * multiplexer and calls read(cookie) when readable; otherwise the
+     * driver is read on the deadline set by updatePollPeriod(). In threaded
+     * mode a driver gets its own reader thread, unless shareWith names a
+     * driver whose thread it must share.
+     */
+    int addDriver(SensorBase *sensor, int fd,
+                  SensorPollMux::read_cb_t read, void *cookie,
+                  int shareWith = -1) {
+        SensorPollMux *mux;
+        int id;
+
+        if (mNumDrivers >= maxDrivers) {
+            ALOGE("%s too many sensor drivers", __func__);
+            return -ENOSPC;
+        }
 
-    int inputDevPathNum(const char *dev_name) {
-        char name[32] = {0};
-        char path[80];
-        int i;
-        int fd;
-        int err;
-
-        i = 0;
-        while(1)
-        {
-            sprintf(path, "/sys/class/input/input%d/name", i);
-            err = access(path, F_OK);
-            if (err < 0) {
-                break;
-            } else {
-                fd = open(path, O_RDONLY);
-                if (fd >= 0) {
-                    memset(name, 0, sizeof(name));
-                    read(fd, name, sizeof(name));
-                    close(fd);
-                    if (!strncmp(name, dev_name, strlen(dev_name))) {
-                        ALOGI("%s %s %s found", __func__, path, dev_name);
-                        err = i;
-                        break;
-                    }
-                }
-            }
-            i++;
+        mDrivers[mNumDrivers].read = read;
+        mDrivers[mNumDrivers].cookie = cookie;
+        mDrivers[mNumDrivers].ctx = this;
+        if (mStats) {
+            read = readTimed;
+            cookie = &mDrivers[mNumDrivers];
         }
 
-        return err;
+        mux = readerMux(shareWith);
+        if (fd >= 0)
+            id = mux->add(fd, read, cookie);
+        else
+            id = mux->addPolled(read, cookie);
+        if (id < 0)
+            return id;
+
+        mDrivers[mNumDrivers].sensor = sensor;
+        mDrivers[mNumDrivers].mux = mux;
+        mDrivers[mNumDrivers].muxId = id;
+        mDrivers[mNumDrivers].polled = (fd < 0);
+        return mNumDrivers++;
     }
 
-    int handleToSensor(int handle) {
-        switch (handle) {
-            case ID_RV: return SENSOR_RV;
-            case ID_LA: return SENSOR_LA;
-            case ID_GR: return SENSOR_GR;
-            case ID_GY: return SENSOR_GY;
-            case ID_A : return SENSOR_A;
-            case ID_O : return SENSOR_O;
-            case ID_M : return SENSOR_M;
-            case ID_L : return SENSOR_L;
-            case ID_P : return SENSOR_P;
-        }
-
-        return -EINVAL;
+    int addDriver(SensorBase *sensor) {
+        return addDriver(sensor, sensor->getFd(),
+                         SensorPollMux::readSensor, sensor);
     }
 
-    void setPollTime() {
-        unsigned int poll_time = UINT_MAX;
-        for (unsigned int i = 0; i < ARRAY_SIZE(sSensorList); i++) {
-            unsigned int poll_time_tmp = requestedPollTime[i];
-            if (poll_time_tmp < poll_time)
-                poll_time = poll_time_tmp;
+    void mapHandle(int handle, int driver) {
+        if (driver >= 0 && handle >= 0 && handle < numHandles) {
+            mHandleToDriver[handle] = driver;
+            if (!mBatchRing[handle])
+                mBatchRing[handle] = new SensorEventRing(batchRingSize);
         }
-        polltime = poll_time;
-        const char wakeMessage(WAKE_MESSAGE);
-        int result = write(mWritePipeFd, &wakeMessage, 1);
-        ALOGE_IF(result < 0, "error sending wake message (%s)", strerror(errno));
     }
 
-    /* poll should wait indefinitely for interrupt based sensors
-     * and poll should not block others, hence timeout is required
-     */
-    void updateSensorActivate(int handle, int activate) {
-        int driver = handleToDriver(handle);
-        if (mPollFds[driver].fd != -1)
-            return;
-        int sensor_type = handleToSensor(handle);
-        if (sensor_type < 0)
-            return;
-        isSensorEnabled[sensor_type] = activate;
-        if (!activate)
-            requestedPollTime[sensor_type] = UINT_MAX;
-        setPollTime();
+    /* -ENODEV for a known handle whose driver is not present */
+    int handleToDriver(int handle) const {
+        if (handle < 0 || handle >= numHandles)
+            return -EINVAL;
+        if (mHandleToDriver[handle] < 0)
+            return -ENODEV;
+
+        return mHandleToDriver[handle];
     }
 
-    void updateSensorPollTime(int handle, unsigned int ms) {
-        int driver = handleToDriver(handle);
-        if (mPollFds[driver].fd != -1)
-            return;
-        int sensor_type = handleToSensor(handle);
-        if (sensor_type < 0)
+    /*
+     * Polled drivers are read once per poll delay: the driver's own delay
+     * when it reports one, otherwise the fastest delay requested on the
+     * enabled handles it serves. Nothing is scheduled while all of them
+     * are disabled.
+     */
+    void updatePollPeriod(int driver) {
+        int64_t period = -1;
+        int i;
+
+        if (!mDrivers[driver].polled)
             return;
-        if ((isSensorEnabled[sensor_type]) && (requestedPollTime[sensor_type] > ms)) {
-            requestedPollTime[sensor_type] = ms;
+
+        for (i = 0; i < numHandles; i++) {
+            if (mHandleToDriver[i] != driver || !isSensorEnabled[i])
+                continue;
+            if (period < 0 || requestedDelay[i] < period)
+                period = requestedDelay[i];
         }
-        setPollTime();
+        if (period >= 0 && mDrivers[driver].sensor->getPollDelay() >= 0)
+            period = mDrivers[driver].sensor->getPollDelay();
+
+        mDrivers[driver].mux->setPeriod(mDrivers[driver].muxId, period);
     }
 };
 
+/* inputN of the first input device whose name starts with name, or -1 */
+static int inputDevNum(const char *name)
+{
+    struct input_device dev;
+
+    if (input_device_find_prefix(name, &dev) < 0)
+        return -1;
+
+    ALOGI("%s input%d %s found", __func__, dev.input, name);
+    return dev.input;
+}
+
+static int64_t nowNs()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+/* frames the MPL left in its reader when it hit its per call cap */
+static bool mplHasBacklog(void *cookie)
+{
+    return ((MPLSensor *)cookie)->hasBufferedFrames();
+}
+
+static int readFusionEvents(void *cookie, sensors_event_t *data, int count)
+{
+    return ((MPLSensor *)cookie)->readFusionEvents(data, count);
+}
+
+static int readCompassEvents(void *cookie, sensors_event_t *data, int count)
+{
+    return ((MPLSensor *)cookie)->readCompassEvents(data, count);
+}
+
+/*****************************************************************************/
+
+void sensors_poll_context_t::initThreaded()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(SENSORS_THREADED_PROP, value, "0");
+    if (atoi(value) <= 0)
+        return;
+
+    if (mLoop.setThreaded(readerRingSize)) {
+        ALOGE("%s reading drivers inline", __func__);
+        return;
+    }
+    ALOGI("%s reading sensor drivers on their own threads", __func__);
+}
+
+void sensors_poll_context_t::initStats()
+{
+    char value[PROPERTY_VALUE_MAX];
+    int seconds;
+
+    mStats = NULL;
+    mStatsInterval = 0;
+    mStatsDue = 0;
+    mProfiledMpl = NULL;
+
+    property_get(SENSORS_STATS_PROP, value, "0");
+    seconds = atoi(value);
+    if (seconds <= 0)
+        return;
+
+    mStats = new SensorStats();
+    mStatsInterval = seconds * 1000000000LL;
+    mStatsDue = nowNs() + mStatsInterval;
+    ALOGI("%s writing sensor stats to %s every %ds", __func__,
+          SENSORS_STATS_FILE, seconds);
+}
+
+/* read callback wrapper used when statistics are enabled */
+int sensors_poll_context_t::readTimed(void *cookie, sensors_event_t *data,
+                                      int count)
+{
+    driver_t *driver = (driver_t *)cookie;
+    sensors_poll_context_t *ctx = driver->ctx;
+    int64_t start = nowNs();
+    int n;
+
+    n = driver->read(driver->cookie, data, count);
+    ctx->mStats->recordRead(driver - ctx->mDrivers, start, nowNs(),
+                            data, n);
+    return n;
+}
+
+/* mux a new driver registers with, see addDriver() */
+SensorPollMux *sensors_poll_context_t::readerMux(int shareWith)
+{
+    if (shareWith >= 0 && shareWith < mNumDrivers)
+        return mLoop.readerMux(mDrivers[shareWith].mux);
+    return mLoop.readerMux();
+}
+
 /*****************************************************************************/
 
 sensors_poll_context_t::sensors_poll_context_t()
 {
     VFUNC_LOG;
 
+    char value[PROPERTY_VALUE_MAX];
     int inputNum;
+    int driver;
     unsigned i;
-    int fd;
-    int flags;
-    char name[32] = {0};
-    char path[80];
-
-    polltime = UINT_MAX;
 
     ALOGE("sensors_poll_context_t started");
 
-    memset(&mPollFds, 0, sizeof(mPollFds));
-    for (i = 0; i < numSensorDrivers; i++) {
-        mSensors[i] = NULL;
-    }
+    memset(mDrivers, 0, sizeof(mDrivers));
+    mNumDrivers = 0;
+    input_devices_watch();
+    initThreaded();
+    initStats();
+
+    pthread_mutex_init(&mBatchMutex, NULL);
+    mDeliverBatches = false;
 
-    for (i = 0; i < MAX_SENSOR_TYPES; i++) {
-        requestedPollTime[i] = UINT_MAX;
+    for (i = 0; i < numHandles; i++) {
+        mHandleToDriver[i] = -1;
+        requestedDelay[i] = defaultPollDelay;
         isSensorEnabled[i] = 0;
+        mBatchRing[i] = NULL;
+        mBatchLatency[i] = 0;
+        mBatchDeadline[i] = 0;
     }
 
     CompassSensor *mCompassSensor = NULL;
-    inputNum = inputDevPathNum("akm89xx");
+    inputNum = inputDevNum("akm89xx");
     if (inputNum >= 0)
         mCompassSensor = new CompassSensor("akm89xx", inputNum, 0);
     MPLSensor *mplSensor = new MPLSensor(mCompassSensor);
+    int mplDriver;
 
     // setup the callback object for handing mpl callbacks
     setCallbackObject(mplSensor);
-    mSensors[mpl] = mplSensor;
-    mPollFds[mpl].fd = mSensors[mpl]->getFd();
-    flags = fcntl(mPollFds[mpl].fd, F_GETFL, 0);
-    flags |= O_NONBLOCK;
-    fcntl(mPollFds[mpl].fd, F_SETFL, flags);
-    mPollFds[mpl].events = POLLIN;
-    mPollFds[mpl].revents = 0;
-
-    if (mCompassSensor != NULL) {
-        mSensors[compass] = mCompassSensor;
-        mPollFds[compass].fd = mplSensor->getCompassFd();
-        flags = fcntl(mPollFds[compass].fd, F_GETFL, 0);
-        flags |= O_NONBLOCK;
-        fcntl(mPollFds[compass].fd, F_SETFL, flags);
-        mPollFds[compass].events = POLLIN;
-        mPollFds[compass].revents = 0;
-    }
+    driver = mplDriver = addDriver(mplSensor);
+    if (mplDriver >= 0)
+        mDrivers[mplDriver].mux->setPending(mDrivers[mplDriver].muxId,
+                                            mplHasBacklog, mplSensor);
+    mapHandle(ID_RV, driver);
+    mapHandle(ID_LA, driver);
+    mapHandle(ID_GR, driver);
+    mapHandle(ID_GY, driver);
+    mapHandle(ID_A, driver);
+    mapHandle(ID_O, driver);
+    mapHandle(ID_M, driver);
+    if (mStats && !mplSensor->enableProfile(true))
+        mProfiledMpl = mplSensor;
+
+    /*
+     * compass samples are fed to the MPL, no handle maps to this driver and
+     * it has to be read on the MPL's thread
+     */
+    if (mCompassSensor != NULL)
+        addDriver(mCompassSensor, mplSensor->getCompassFd(),
+                  readCompassEvents, mplSensor, mplDriver);
+
+    property_get(SENSORS_FUSION_PROP, value, "0");
+    if (atoi(value) > 0 && !mplSensor->startFusionThread())
+        addDriver(NULL, mplSensor->getFusionFd(), readFusionEvents, mplSensor);
 
     /* Cm3217 ALS on TN8 or Cm3218 ALS on shield_ers */
-    mSensors[light] = LightSensorBase::getInstance(ID_L);
-    if (!mSensors[light])
-        mSensors[light] = Max44005Light::getInstance();
-    mPollFds[light].fd = -1;
+    SensorBase *light = LightSensorBase::getInstance(ID_L);
+    if (!light)
+        light = Max44005Light::getInstance();
+    if (light)
+        mapHandle(ID_L, addDriver(light, light->getFd(),
+                                  SensorPollMux::readSensor, light));
 
     char prox_path[MAX_SENSOR_PATH_LEN] = {0};
     char prox_enable_path[MAX_SENSOR_PATH_LEN] = {0};
     char prox_thres_path[MAX_SENSOR_PATH_LEN] = {0};
-    if (ltr558Prox::fillPaths(prox_path, prox_enable_path, prox_thres_path))
-        mSensors[proximity] = new ltr558Prox(prox_path, prox_enable_path,
-                                             prox_thres_path, ID_P);
-
-    mPollFds[proximity].fd = -1;
-
-    inputNum = inputDevPathNum(BMP180_DEV_NAME);
-    if (inputNum >= 0) {
-        mSensors[pressure] = new NvsInput(BMP180_DEV_NAME, inputNum,
-                                          ID_AP, SENSOR_TYPE_PRESSURE, 0);
-        mPollFds[pressure].fd = mSensors[pressure]->getFd();
-        flags = fcntl(mPollFds[pressure].fd, F_GETFL, 0);
-        flags |= O_NONBLOCK;
-        fcntl(mPollFds[pressure].fd, F_SETFL, flags);
-        mPollFds[pressure].events = POLLIN;
-        mPollFds[pressure].revents = 0;
+    if (ltr558Prox::fillPaths(prox_path, prox_enable_path, prox_thres_path)) {
+        SensorBase *proximity = new ltr558Prox(prox_path, prox_enable_path,
+                                               prox_thres_path, ID_P);
+        mapHandle(ID_P, addDriver(proximity, -1, SensorPollMux::readSensor,
+                                  proximity));
     }
 
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    ALOGE_IF(result < 0, "error creating wake pipe (%s)", strerror(errno));
-    fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
-    fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
-    mWritePipeFd = wakeFds[1];
+    inputNum = inputDevNum(BMP180_DEV_NAME);
+    if (inputNum >= 0)
+        mapHandle(ID_AP, addDriver(new NvsInput(BMP180_DEV_NAME, inputNum,
+                                                ID_AP, SENSOR_TYPE_PRESSURE,
+                                                0)));
 
-    mPollFds[wake].fd = wakeFds[0];
-    mPollFds[wake].events = POLLIN;
-    mPollFds[wake].revents = 0;
+    mLoop.setBatching(deliverBatches, queueBatched, batchTimeout, this);
+    mLoop.startReaders();
 }
 
 sensors_poll_context_t::~sensors_poll_context_t()
 {
     VFUNC_LOG;
 
-    unsigned i;
+    int i;
 
-    for (i = 0; i < numSensorDrivers; i++) {
-        if (mSensors[i] != NULL)
-            delete mSensors[i];
+    /* readers must be gone before their drivers */
+    mLoop.stopReaders();
+    for (i = 0; i < mNumDrivers; i++) {
+        mDrivers[i].mux->remove(mDrivers[i].muxId);
+        delete mDrivers[i].sensor;
     }
-    close(mPollFds[wake].fd);
-    close(mWritePipeFd);
+    delete mStats;
+    for (i = 0; i < numHandles; i++)
+        delete mBatchRing[i];
+    pthread_mutex_destroy(&mBatchMutex);
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled)
@@ -364,18 +509,27 @@ int sensors_poll_context_t::activate(int handle, int enabled)
     int err;
     int index = handleToDriver(handle);
 
+    if (index == -ENODEV)
+        return 0;
     if (index < 0)
         return index;
 
-    if (mSensors[index] == NULL)
-        return 0;
-
-    err =  mSensors[index]->enable(handle, enabled);
+    err =  mDrivers[index].sensor->enable(handle, enabled);
     if (!err) {
-        const char wakeMessage(WAKE_MESSAGE);
-        int result = write(mWritePipeFd, &wakeMessage, 1);
-        ALOGE_IF(result < 0, "error sending wake message (%s)", strerror(errno));
-        updateSensorActivate(handle, enabled);
+        isSensorEnabled[handle] = enabled;
+        updatePollPeriod(index);
+        if (!enabled) {
+            /* hand out whatever was batched before the sensor stopped */
+            pthread_mutex_lock(&mBatchMutex);
+            if (!mBatchRing[handle]->empty())
+                mDeliverBatches = true;
+            pthread_mutex_unlock(&mBatchMutex);
+        }
+        /* let the driver report any event generated by the enable */
+        mDrivers[index].mux->kick(mDrivers[index].muxId);
+        mDrivers[index].mux->wake();
+        if (mDrivers[index].mux != mLoop.mux())
+            mLoop.wake();
     } else {
         ALOGE("enable sensor error! handle: %d", handle);
     }
@@ -386,73 +540,228 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns)
 {
     VFUNC_LOG;
 
+    int err;
     int index = handleToDriver(handle);
 
+    if (index == -ENODEV)
+        return 0;
     if (index < 0)
         return index;
 
-    if (mSensors[index] == NULL)
+    err = mDrivers[index].sensor->setDelay(handle, ns);
+    requestedDelay[handle] = ns;
+    updatePollPeriod(index);
+
+    return err;
+}
+
+int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns,
+                                  int64_t timeout)
+{
+    VFUNC_LOG;
+
+    int err;
+    int index = handleToDriver(handle);
+
+    if (index < 0)
+        return -EINVAL;
+
+    /* every present sensor can be batched in the HAL */
+    if (flags & SENSORS_BATCH_DRY_RUN)
         return 0;
 
-    updateSensorPollTime(handle, ns/1000000);
+    err = setDelay(handle, period_ns);
+    if (err)
+        return err;
+
+    pthread_mutex_lock(&mBatchMutex);
+    mBatchLatency[handle] = timeout;
+    if (!mBatchRing[handle]->empty()) {
+        if (!timeout)
+            mDeliverBatches = true;
+        else if (mBatchDeadline[handle] > nowNs() + timeout)
+            mBatchDeadline[handle] = nowNs() + timeout;
+    }
+    pthread_mutex_unlock(&mBatchMutex);
 
-    return mSensors[index]->setDelay(handle, ns);
+    /* let the poll thread pick up the new deadline */
+    mLoop.wake();
+    return 0;
 }
 
-int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
+int sensors_poll_context_t::flush(int handle)
 {
-    VHANDLER_LOG;
+    VFUNC_LOG;
 
-    unsigned i;
-    int nb;
-    int nbEvents = 0;
-    int n = 0;
+    sensors_event_t event;
+    int err;
+    int index = handleToDriver(handle);
 
-    do {
-        for (i = 0; i < numSensorDrivers; i++) {
-            if (mSensors[i] == NULL)
-                continue;
+    if (index < 0 || !isSensorEnabled[handle])
+        return -EINVAL;
 
-            SensorBase* const sensor(mSensors[i]);
-            if ((mPollFds[i].revents & POLLIN) || (sensor->hasPendingEvents())) {
-                if (i == compass)
-                    nb = ((MPLSensor*)mSensors[mpl])->readCompassEvents(data, count);
-                else
-                    nb = sensor->readEvents(data, count);
-                if (nb > 0) {
-                    count -= nb;
-                    nbEvents += nb;
-                    data += nb;
-                }
-                if (nb < count)
-                    // no more data for this sensor
-                    mPollFds[i].revents = 0;
-            }
+    memset(&event, 0, sizeof(event));
+    event.version = META_DATA_VERSION;
+    event.type = SENSOR_TYPE_META_DATA;
+    event.meta_data.what = META_DATA_FLUSH_COMPLETE;
+    event.meta_data.sensor = handle;
+
+    /* queued behind the handle's batched events, then everything goes out */
+    pthread_mutex_lock(&mBatchMutex);
+    err = mBatchRing[handle]->push(event);
+    mDeliverBatches = true;
+    pthread_mutex_unlock(&mBatchMutex);
+
+    mLoop.wake();
+    /* only meta events are queued, try again once they are delivered */
+    if (err == -ENOSPC)
+        return -EAGAIN;
+    return 0;
+}
+
+/*
+ * Move the events of batched handles from data to their rings and compact
+ * the rest. Returns the number of events left in data.
+ */
+int sensors_poll_context_t::queueBatched(sensors_event_t *data, int count)
+{
+    int64_t now = 0;
+    int i, n;
+
+    pthread_mutex_lock(&mBatchMutex);
+    for (i = 0, n = 0; i < count; i++) {
+        int handle = data[i].sensor;
+        SensorEventRing *ring;
+
+        if (handle < 0 || handle >= numHandles || !mBatchRing[handle] ||
+            (!mBatchLatency[handle] && mBatchRing[handle]->empty())) {
+            if (n != i)
+                data[n] = data[i];
+            n++;
+            continue;
         }
 
-        if (count) {
-            // we still have some room, so try to see if we can get
-            // some events immediately or just wait for polltime
-            // if we don't have anything to return
-            n = poll(mPollFds, numFds, nbEvents ? 0 : polltime);
-            if (n < 0) {
-                ALOGE("poll() failed (%s)", strerror(errno));
-                if (errno == EINTR)
-                    return nbEvents;
-                else
-                    return -errno;
-            }
+        ring = mBatchRing[handle];
+        if (ring->empty()) {
+            if (!now)
+                now = nowNs();
+            mBatchDeadline[handle] = now + mBatchLatency[handle];
+        }
+        if (!ring->push(data[i]))
+            ALOGV_IF(EXTRA_VERBOSE, "batch ring of handle %d overrun", handle);
+        /* no room left or latency dropped to 0 while events were queued */
+        if (ring->full() || !mBatchLatency[handle])
+            mDeliverBatches = true;
+    }
+    pthread_mutex_unlock(&mBatchMutex);
+
+    return n;
+}
 
-            if (mPollFds[wake].revents & POLLIN) {
-                char msg;
-                int result = read(mPollFds[wake].fd, &msg, 1);
-                ALOGE_IF(result < 0, "error reading from wake pipe (%s)", strerror(errno));
-                ALOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
-                mPollFds[wake].revents = 0;
+/* Copy out all batched events if any batch is due. */
+int sensors_poll_context_t::deliverBatches(sensors_event_t *data, int count)
+{
+    int64_t now = 0;
+    int nb = 0;
+    bool pending = false;
+    int i;
+
+    pthread_mutex_lock(&mBatchMutex);
+    if (!mDeliverBatches) {
+        for (i = 0; i < numHandles; i++) {
+            if (!mBatchRing[i] || mBatchRing[i]->empty())
+                continue;
+            if (!now)
+                now = nowNs();
+            if (mBatchDeadline[i] <= now) {
+                mDeliverBatches = true;
+                break;
             }
         }
-        // if we have events and space, go read them
-    } while ((n || !nbEvents) && count);
+    }
+
+    if (mDeliverBatches) {
+        for (i = 0; i < numHandles; i++) {
+            if (!mBatchRing[i])
+                continue;
+            nb += mBatchRing[i]->pop(data + nb, count - nb);
+            if (!mBatchRing[i]->empty())
+                pending = true;
+        }
+        mDeliverBatches = pending;
+    }
+    pthread_mutex_unlock(&mBatchMutex);
+
+    return nb;
+}
+
+int sensors_poll_context_t::queueBatched(void *cookie, sensors_event_t *data,
+                                         int count)
+{
+    return ((sensors_poll_context_t *)cookie)->queueBatched(data, count);
+}
+
+int sensors_poll_context_t::deliverBatches(void *cookie,
+                                           sensors_event_t *data, int count)
+{
+    return ((sensors_poll_context_t *)cookie)->deliverBatches(data, count);
+}
+
+int sensors_poll_context_t::batchTimeout(void *cookie)
+{
+    return ((sensors_poll_context_t *)cookie)->batchTimeout();
+}
+
+/* poll timeout in ms until the earliest batch deadline, -1 if none */
+int sensors_poll_context_t::batchTimeout()
+{
+    int64_t deadline = 0;
+    int64_t now;
+    int timeout = -1;
+    int i;
+
+    pthread_mutex_lock(&mBatchMutex);
+    if (mDeliverBatches) {
+        timeout = 0;
+    } else {
+        for (i = 0; i < numHandles; i++) {
+            if (!mBatchRing[i] || mBatchRing[i]->empty())
+                continue;
+            if (!deadline || mBatchDeadline[i] < deadline)
+                deadline = mBatchDeadline[i];
+        }
+        if (deadline) {
+            now = nowNs();
+            timeout = deadline > now ?
+                      (int)((deadline - now + 999999) / 1000000) : 0;
+        }
+    }
+    pthread_mutex_unlock(&mBatchMutex);
+
+    return timeout;
+}
+
+int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
+{
+    VHANDLER_LOG;
+
+    int nbEvents;
+
+    nbEvents = mLoop.poll(data, count);
+    if (nbEvents < 0)
+        return nbEvents;
+
+    if (mStats) {
+        int64_t now = nowNs();
+
+        mStats->recordReturn(now, data, nbEvents);
+        if (now >= mStatsDue) {
+            mStats->dump(SENSORS_STATS_FILE);
+            if (mProfiledMpl)
+                mProfiledMpl->dumpProfile(SENSORS_PROFILE_FILE);
+            mStatsDue = now + mStatsInterval;
+        }
+    }
 
     return nbEvents;
 }
@@ -500,6 +809,26 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_1 *dev,
+                       int handle, int flags, int64_t period_ns,
+                       int64_t timeout)
+{
+    VFUNC_LOG;
+
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+
+    return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev, int handle)
+{
+    VFUNC_LOG;
+
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+
+    return ctx->flush(handle);
+}
+
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -512,14 +841,16 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
 
     sensors_poll_context_t *dev = new sensors_poll_context_t();
 
-    memset(&dev->device, 0, sizeof(sensors_poll_device_t));
+    memset(&dev->device, 0, sizeof(sensors_poll_device_1));
     dev->device.common.tag = HARDWARE_DEVICE_TAG;
-    dev->device.common.version  = 0;
+    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_1;
     dev->device.common.module   = const_cast<hw_module_t*>(module);
     dev->device.common.close    = poll__close;
     dev->device.activate        = poll__activate;
     dev->device.setDelay        = poll__setDelay;
     dev->device.poll            = poll__poll;
+    dev->device.batch           = poll__batch;
+    dev->device.flush           = poll__flush;
 
     *device = &dev->device.common;
     status = 0;